@@ -0,0 +1,43 @@
+#ifndef MEMPOOL_BENCH_H
+#define MEMPOOL_BENCH_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "type.h"
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Macros -------------------------- */
+/* ------------------------------------------------------------ */
+
+/** Print single benchmark result in a uniform format */
+#define BENCH_REPORT(NAME, OPS, NS) \
+    printf("%-40s %12llu ops %10.2f ns/op\n", (NAME), (unsigned long long)(OPS), (double)(NS) / (double)(OPS))
+
+/** Print duration of a one-off operation */
+#define BENCH_REPORT_TIME(NAME, NS) printf("%-40s %12.2f ms\n", (NAME), (double)(NS) / 1e6)
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Functions ------------------------- */
+/* ------------------------------------------------------------ */
+
+/** Monotonic time in nanoseconds */
+static inline u64 bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000u + (u64)ts.tv_nsec;
+}
+
+/** Simple xorshift generator, good enough to produce benchmark patterns */
+static inline u64 bench_rand(u64* state)
+{
+    u64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+#endif //MEMPOOL_BENCH_H
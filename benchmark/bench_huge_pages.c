@@ -0,0 +1,76 @@
+#include "bench.h"
+#include "mempool_vm.h"
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Macros -------------------------- */
+/* ------------------------------------------------------------ */
+
+/* Size of the pool - large enough to exceed the reach of the dTLB with regular pages */
+#define POOL_SIZE ((size)1 << 29)
+/* Size of blocks claimed to fill the pool */
+#define BLOCK_SIZE ((size)1 << 16)
+/* Number of random reads */
+#define ITERATIONS 20000000
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Functions ------------------------- */
+/* ------------------------------------------------------------ */
+
+static const char* backing_name(mempool_map_backing backing)
+{
+    switch (backing) {
+        case mempool_map_backing_pages:
+            return "regular pages";
+        case mempool_map_backing_thp:
+            return "transparent huge pages";
+        case mempool_map_backing_hugetlb:
+            return "hugetlb pages";
+        default:
+            return "none";
+    }
+}
+
+/* Fill the pool with blocks and read random words from them */
+static void run_random_access(const char* name, u32 flags)
+{
+    mempool_instance pool;
+    if (mempool_status_ok != mempool_create_mapped(&pool, POOL_SIZE, flags)) {
+        printf("%-40s mapping failed\n", name);
+        return;
+    }
+
+    static void* blocks[POOL_SIZE / BLOCK_SIZE];
+    size block_cnt = 0;
+    size usable = BLOCK_SIZE - mempool_calc_hdr_size();
+    while (mempool_status_ok == mempool_claim_memory(&pool, usable, &blocks[block_cnt])) {
+        u64* words = blocks[block_cnt++];
+        for (size i = 0; i < usable / sizeof(u64); ++i) {
+            words[i] = i;
+        }
+    }
+
+    u64 seed = 0x9E3779B97F4A7C15ull;
+    u64 sum = 0;
+    u64 start = bench_now_ns();
+    for (u32 i = 0; i < ITERATIONS; ++i) {
+        u64 r = bench_rand(&seed);
+        const u64* words = blocks[r % block_cnt];
+        sum += words[(r >> 32) % (usable / sizeof(u64))];
+    }
+    u64 elapsed = bench_now_ns() - start;
+
+    printf("%s backing: %s (checksum %llu)\n", name, backing_name(mempool_map_backing_get(&pool)),
+           (unsigned long long)sum);
+    BENCH_REPORT(name, ITERATIONS, elapsed);
+    mempool_destroy(&pool);
+}
+
+int main(void)
+{
+    printf("Pool size: %llu MiB, %llu KiB blocks\n", (unsigned long long)(POOL_SIZE >> 20),
+           (unsigned long long)(BLOCK_SIZE >> 10));
+    run_random_access("random read, regular pages", 0);
+    run_random_access("random read, THP", MEMPOOL_MAP_THP);
+    run_random_access("random read, hugetlb", MEMPOOL_MAP_HUGETLB | MEMPOOL_MAP_THP);
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <sys/mman.h>
+
+#include "bench.h"
+#include "mempool.h"
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Macros -------------------------- */
+/* ------------------------------------------------------------ */
+
+/* Size of the sparse buffer - only pages that hold partition headers are faulted in */
+#define POOL_SIZE ((size)1 << 36)
+/* Number of live allocations kept by the benchmark */
+#define LIVE_SLOTS 1024
+/* Number of claim/free pairs */
+#define ITERATIONS 100000
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Functions ------------------------- */
+/* ------------------------------------------------------------ */
+
+/* Claim and free blocks with sizes spread between 'min_order' and 'max_order' */
+static void run_pattern(mempool_instance* pool, const char* name, u32 min_order, u32 max_order)
+{
+    void* slots[LIVE_SLOTS] = {0};
+    u64 seed = 0x9E3779B97F4A7C15ull;
+    u64 ops = 0;
+
+    u64 start = bench_now_ns();
+    for (u32 i = 0; i < ITERATIONS; ++i) {
+        u64 r = bench_rand(&seed);
+        u32 idx = (u32)(r % LIVE_SLOTS);
+        if (NULL != slots[idx]) {
+            mempool_free_memory(pool, slots[idx]);
+            slots[idx] = NULL;
+        } else {
+            u32 order = min_order + (u32)((r >> 32) % (max_order - min_order + 1));
+            mempool_claim_memory(pool, (size)1 << order, &slots[idx]);
+        }
+        ops++;
+    }
+    u64 elapsed = bench_now_ns() - start;
+
+    for (u32 i = 0; i < LIVE_SLOTS; ++i) {
+        if (NULL != slots[i]) {
+            mempool_free_memory(pool, slots[i]);
+        }
+    }
+    BENCH_REPORT(name, ops, elapsed);
+}
+
+int main(void)
+{
+    void* buffer = mmap(NULL, POOL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == buffer) {
+        perror("mmap");
+        return 1;
+    }
+
+    mempool_instance pool;
+    pool.base_addr = buffer;
+    pool.size = POOL_SIZE;
+    if (mempool_status_ok != mempool_init(&pool)) {
+        fprintf(stderr, "mempool_init failed\n");
+        return 1;
+    }
+
+    printf("Pool size: %llu GiB (sparse mapping)\n", (unsigned long long)(POOL_SIZE >> 30));
+    run_pattern(&pool, "claim/free 64B-4KiB", 6, 12);
+    run_pattern(&pool, "claim/free 64KiB-16MiB", 16, 24);
+    run_pattern(&pool, "claim/free 256MiB-8GiB", 28, 33);
+
+    munmap(buffer, POOL_SIZE);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "mempool_vm.h"
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Macros -------------------------- */
+/* ------------------------------------------------------------ */
+
+/* Size of the pool */
+#define POOL_SIZE ((size)1 << 30)
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Functions ------------------------- */
+/* ------------------------------------------------------------ */
+
+/* Measure pool creation followed by prefaulting with the given number of threads. Zero threads means no prefault */
+static void run_startup(const char* name, u32 flags, u32 threads)
+{
+    mempool_instance pool;
+    u64 start = bench_now_ns();
+    if (mempool_status_ok != mempool_create_mapped(&pool, POOL_SIZE, flags)) {
+        printf("%-40s mapping failed\n", name);
+        return;
+    }
+    if (0 != threads) {
+        mempool_prefault(&pool, threads);
+    }
+    BENCH_REPORT_TIME(name, bench_now_ns() - start);
+    mempool_destroy(&pool);
+}
+
+int main(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    char name[64];
+
+    printf("Pool size: %llu MiB, %ld online CPUs\n", (unsigned long long)(POOL_SIZE >> 20), cpus);
+    run_startup("startup, no prefault", 0, 0);
+    run_startup("startup, MEMPOOL_MAP_POPULATE", MEMPOOL_MAP_POPULATE, 0);
+    for (u32 threads = 1; threads <= 8; threads *= 2) {
+        snprintf(name, sizeof(name), "startup, touch with %u threads", threads);
+        run_startup(name, 0, threads);
+    }
+    return 0;
+}
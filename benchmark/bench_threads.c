@@ -0,0 +1,198 @@
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "bench.h"
+#include "mempool.h"
+#include "mempool_percpu.h"
+#include "mempool_shard.h"
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Macros -------------------------- */
+/* ------------------------------------------------------------ */
+
+/* Size of the pool shared by all threads */
+#define POOL_SIZE ((size)1 << 28)
+/* Size of each pool of the per-CPU set */
+#define PERCPU_POOL_SIZE ((size)1 << 24)
+/* Number of shards of the sharded pool */
+#define SHARDS_NUM 8
+/* Maximum number of threads */
+#define THREADS_MAX 64
+/* Number of live allocations kept by each thread */
+#define LIVE_SLOTS 64
+/* Number of claim/free operations done by each thread */
+#define ITERATIONS 50000
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Data types ------------------------ */
+/* ------------------------------------------------------------ */
+
+/* Synchronization of the pool */
+typedef enum sync_mode_
+{
+    sync_global_mutex, /* Pool without own synchronization wrapped in a single mutex */
+    sync_order_locks, /* Thread-safe pool */
+    sync_lock_free, /* Lock-free pool */
+    sync_tcache, /* Thread-safe pool used through thread caches */
+    sync_percpu, /* Set of thread-safe pools, one per CPU */
+    sync_sharded /* Pool buffer split into shards assigned to threads by hash */
+} sync_mode;
+
+/* Arguments of a worker thread */
+typedef struct worker_args_
+{
+    mempool_instance* pool;
+    mempool_percpu_set* percpu; /* Used instead of the pool when not NULL */
+    mempool_sharded* sharded; /* Used instead of the pool when not NULL */
+    pthread_mutex_t* global_lock; /* NULL when the pool synchronizes itself */
+    bool use_tcache;
+    u64 seed;
+} worker_args;
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Functions ------------------------- */
+/* ------------------------------------------------------------ */
+
+/* Claim memory the way selected by the worker mode */
+static void worker_claim(worker_args* args, mempool_tcache* cache, size len, void** dst)
+{
+    if (NULL != args->percpu) {
+        mempool_percpu_claim(args->percpu, len, dst);
+    } else if (NULL != args->sharded) {
+        mempool_shard_claim(args->sharded, len, dst);
+    } else if (args->use_tcache) {
+        mempool_tcache_claim(cache, len, dst);
+    } else {
+        mempool_claim_memory(args->pool, len, dst);
+    }
+}
+
+/* Free memory the way selected by the worker mode */
+static void worker_free(worker_args* args, mempool_tcache* cache, void* memory)
+{
+    if (NULL != args->percpu) {
+        mempool_percpu_free(args->percpu, memory);
+    } else if (NULL != args->sharded) {
+        mempool_shard_free(args->sharded, memory);
+    } else if (args->use_tcache) {
+        mempool_tcache_free(cache, memory);
+    } else {
+        mempool_free_memory(args->pool, memory);
+    }
+}
+
+/* Claim and free blocks between 16 bytes and 2 KiB */
+static void* worker(void* arg)
+{
+    worker_args* args = arg;
+    mempool_tcache cache;
+    mempool_tcache_init(&cache, args->pool);
+    void* slots[LIVE_SLOTS] = {0};
+    for (u32 i = 0; i < ITERATIONS; ++i) {
+        u64 r = bench_rand(&args->seed);
+        u32 idx = (u32)(r % LIVE_SLOTS);
+        if (NULL != args->global_lock) {
+            pthread_mutex_lock(args->global_lock);
+        }
+        if (NULL != slots[idx]) {
+            worker_free(args, &cache, slots[idx]);
+            slots[idx] = NULL;
+        } else {
+            worker_claim(args, &cache, (size)16 << ((r >> 32) % 8), &slots[idx]);
+        }
+        if (NULL != args->global_lock) {
+            pthread_mutex_unlock(args->global_lock);
+        }
+    }
+
+    for (u32 i = 0; i < LIVE_SLOTS; ++i) {
+        if (NULL != slots[i]) {
+            if (NULL != args->global_lock) {
+                pthread_mutex_lock(args->global_lock);
+            }
+            worker_free(args, &cache, slots[i]);
+            if (NULL != args->global_lock) {
+                pthread_mutex_unlock(args->global_lock);
+            }
+        }
+    }
+    mempool_tcache_release(&cache);
+    return NULL;
+}
+
+/* Run all threads against a freshly initialized pool */
+static void run_threads(void* buffer, const char* name, sync_mode mode, u32 threads)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    config.thread_safe = (sync_order_locks == mode) || (sync_tcache == mode);
+    config.lock_free = (sync_lock_free == mode);
+    static mempool_ext ext;
+    config.ext = &ext;
+    mempool_instance pool;
+    pool.base_addr = buffer;
+    pool.size = POOL_SIZE;
+    mempool_init_ex(&pool, &config);
+
+    static mempool_percpu_set percpu;
+    if (sync_percpu == mode) {
+        mempool_percpu_create(&percpu, PERCPU_POOL_SIZE, 0);
+    }
+    static mempool_sharded sharded;
+    if (sync_sharded == mode) {
+        sharded.base_addr = buffer;
+        sharded.size = POOL_SIZE;
+        static mempool_ext shard_exts[SHARDS_NUM];
+        config.ext = shard_exts;
+        mempool_shard_init(&sharded, SHARDS_NUM, &config);
+    }
+
+    pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_t tids[THREADS_MAX];
+    worker_args args[THREADS_MAX];
+
+    u64 start = bench_now_ns();
+    for (u32 i = 0; i < threads; ++i) {
+        args[i].pool = &pool;
+        args[i].percpu = (sync_percpu == mode) ? &percpu : NULL;
+        args[i].sharded = (sync_sharded == mode) ? &sharded : NULL;
+        args[i].global_lock = (sync_global_mutex == mode) ? &global_lock : NULL;
+        args[i].use_tcache = (sync_tcache == mode);
+        args[i].seed = 0x9E3779B97F4A7C15ull * (i + 1);
+        pthread_create(&tids[i], NULL, worker, &args[i]);
+    }
+    for (u32 i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    u64 elapsed = bench_now_ns() - start;
+    if (sync_percpu == mode) {
+        mempool_percpu_destroy(&percpu);
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s, %u threads", name, threads);
+    BENCH_REPORT(label, (u64)threads * ITERATIONS, elapsed);
+}
+
+int main(void)
+{
+    void* buffer = mmap(NULL, POOL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == buffer) {
+        perror("mmap");
+        return 1;
+    }
+
+    printf("Pool size: %llu MiB, ns/op is wall time divided by operations of all threads\n",
+           (unsigned long long)(POOL_SIZE >> 20));
+    for (u32 threads = 1; threads <= THREADS_MAX; threads *= 2) {
+        run_threads(buffer, "global mutex", sync_global_mutex, threads);
+        run_threads(buffer, "per-order locks", sync_order_locks, threads);
+        run_threads(buffer, "lock-free caches", sync_lock_free, threads);
+        run_threads(buffer, "thread caches", sync_tcache, threads);
+        run_threads(buffer, "per-CPU pools", sync_percpu, threads);
+        run_threads(buffer, "8 shards", sync_sharded, threads);
+    }
+
+    munmap(buffer, POOL_SIZE);
+    return 0;
+}
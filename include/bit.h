@@ -14,7 +14,7 @@ extern "C" {
 /** Major version */
 #define BIT_API_VERSION_MAJOR 0
 /** Minor version */
-#define BIT_API_VERSION_MINOR 1
+#define BIT_API_VERSION_MINOR 2
 /** Revision version */
 #define BIT_API_VERSION_REVISION 0
 
@@ -42,6 +42,36 @@ extern "C" {
 /** Get multiple bits using MSK and POS values */
 #define BIT_32_GET_MUL(V, MSK, POS) (((u32)(V) & ((MSK) << (POS))) >> (POS))
 
+/** Get 64-bit value with bit set at specific position */
+#define BIT_64_GET_AT_POS(POS) ((u64)1 << (POS))
+
+/** Bitwise NOT (64-bit) */
+#define BIT_64_NOT(V) (~((u64)(V)))
+
+/** Set bit at specific position (64-bit) */
+#define BIT_64_SET(V, B) ((V) = ((u64)(V) | BIT_64_GET_AT_POS(B)))
+
+/** Clear bit at specific position (64-bit) */
+#define BIT_64_CLR(V, B) ((V) = ((V) & BIT_64_NOT(BIT_64_GET_AT_POS(B))))
+
+/** Check if specific bit is set (64-bit) */
+#define BIT_64_IS_SET(V, B) ((bool)((u64)(V) & BIT_64_GET_AT_POS(B)))
+
+/** Check if specific bit is not set (64-bit) */
+#define BIT_64_IS_NOT_SET(V, B) (!BIT_64_IS_SET(V, B))
+
+/** Count leading zeros of a 64-bit value. The result is undefined for zero */
+#define BIT_64_CLZ(V) ((u32)__builtin_clzll((unsigned long long)(V)))
+
+/** Count trailing zeros of a 64-bit value. The result is undefined for zero */
+#define BIT_64_CTZ(V) ((u32)__builtin_ctzll((unsigned long long)(V)))
+
+/** Floor of base-2 logarithm of a 64-bit value. The result is undefined for zero */
+#define BIT_64_LOG2_FLOOR(V) (63u - BIT_64_CLZ(V))
+
+/** Ceiling of base-2 logarithm of a 64-bit value (zero for both 0 and 1) */
+#define BIT_64_LOG2_CEIL(V) (((u64)(V) <= 1) ? 0u : (64u - BIT_64_CLZ((u64)(V) - 1)))
+
 #ifdef __cplusplus
 }
 #endif
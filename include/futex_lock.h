@@ -0,0 +1,127 @@
+#ifndef MEMPOOL_FUTEX_LOCK_H
+#define MEMPOOL_FUTEX_LOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "type.h"
+#include "common.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define FUTEX_LOCK_API_VERSION_MAJOR 0
+/** Minor version */
+#define FUTEX_LOCK_API_VERSION_MINOR 3
+/** Revision version */
+#define FUTEX_LOCK_API_VERSION_REVISION 0
+
+/** Timeout value of futex_wait() meaning no timeout */
+#define FUTEX_WAIT_FOREVER UINT64_MAX
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Data types ---------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Mutual exclusion lock built directly on futex. It takes a single word, so it can be embedded in large arrays
+ * without blowing up the size of the owning structure. The lock is not recursive. A lock placed in memory shared
+ * between processes has to be used with the *_pshared functions only.
+ */
+typedef struct futex_lock_
+{
+    u32 state; /**< 0 - unlocked, 1 - locked, 2 - locked with possible waiters */
+} futex_lock;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Initialize a lock in unlocked state.
+ *
+ * @param lock Pointer to a lock.
+ */
+void futex_lock_init(futex_lock* lock);
+
+/**
+ * Try to acquire a lock without blocking.
+ *
+ * @param lock Pointer to a lock.
+ * @return True if the lock was acquired.
+ */
+bool futex_lock_try_acquire(futex_lock* lock);
+
+/**
+ * Acquire a lock. The caller spins for a short while and then sleeps in the kernel until the lock is released.
+ *
+ * @param lock Pointer to a lock.
+ */
+void futex_lock_acquire(futex_lock* lock);
+
+/**
+ * Release a lock. A sleeping waiter, if any, is woken up.
+ *
+ * @param lock Pointer to a lock. It must be held by the caller.
+ */
+void futex_lock_release(futex_lock* lock);
+
+/**
+ * Acquire a lock placed in memory shared between processes. See futex_lock_acquire().
+ *
+ * @param lock Pointer to a lock.
+ */
+void futex_lock_acquire_pshared(futex_lock* lock);
+
+/**
+ * Release a lock placed in memory shared between processes. See futex_lock_release().
+ *
+ * @param lock Pointer to a lock. It must be held by the caller.
+ */
+void futex_lock_release_pshared(futex_lock* lock);
+
+/**
+ * Sleep while a word holds the expected value.
+ *
+ * The check and going to sleep are atomic with respect to futex_wake(), so a change of the word followed by a wake
+ * cannot be missed. The function may return spuriously - callers have to check their condition again.
+ *
+ * @param word Pointer to a word shared between threads of the process.
+ * @param expected Value the word must hold for the caller to sleep.
+ * @param timeout_ns Maximum time to sleep in nanoseconds. FUTEX_WAIT_FOREVER disables the timeout.
+ * @return False if the timeout expired, true otherwise.
+ */
+bool futex_wait(u32* word, u32 expected, u64 timeout_ns);
+
+/**
+ * Wake all threads sleeping on a word in futex_wait().
+ *
+ * @param word Pointer to a word shared between threads of the process.
+ */
+void futex_wake(u32* word);
+
+/**
+ * Sleep while a word placed in memory shared between processes holds the expected value. See futex_wait().
+ *
+ * @param word Pointer to a word shared between processes.
+ * @param expected Value the word must hold for the caller to sleep.
+ * @param timeout_ns Maximum time to sleep in nanoseconds. FUTEX_WAIT_FOREVER disables the timeout.
+ * @return False if the timeout expired, true otherwise.
+ */
+bool futex_wait_pshared(u32* word, u32 expected, u64 timeout_ns);
+
+/**
+ * Wake all threads of all processes sleeping on a word in futex_wait_pshared().
+ *
+ * @param word Pointer to a word shared between processes.
+ */
+void futex_wake_pshared(u32* word);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_FUTEX_LOCK_H
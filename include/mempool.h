@@ -7,6 +7,9 @@ extern "C" {
 
 #include "type.h"
 #include "common.h"
+#if !defined(MEMPOOL_THREAD_SAFE) || MEMPOOL_THREAD_SAFE
+#include "futex_lock.h"
+#endif
 
 /* ------------------------------------------------------------ */
 /* ---------------------------- Macros ------------------------ */
@@ -15,10 +18,34 @@ extern "C" {
 /** Major version */
 #define MEMPOOL_API_VERSION_MAJOR 0
 /** Minor version */
-#define MEMPOOL_API_VERSION_MINOR   2
+#define MEMPOOL_API_VERSION_MINOR   21
 /** Revision version */
 #define MEMPOOL_API_VERSION_REVISION 0
 
+/** Support of thread-safe pools built on Linux futexes. Define it as zero to build the core for targets without an OS -
+ *  it then relies on the C library only and thread-safe configurations are rejected */
+#ifndef MEMPOOL_THREAD_SAFE
+#define MEMPOOL_THREAD_SAFE 1
+#endif
+
+/** Timeout making mempool_claim_wait() wait without a limit */
+#define MEMPOOL_WAIT_FOREVER UINT64_MAX
+
+/** Number of partition orders (a partition of order N is 2^N bytes long) */
+#define MEMPOOL_ORDER_NUM 64
+
+/** Maximum number of memory regions managed by a single pool, including the buffer passed at init */
+#define MEMPOOL_REGIONS_MAX 16
+
+/** Number of partition orders served by thread caches (see mempool_tcache_init()) */
+#define MEMPOOL_TCACHE_ORDERS 16
+
+/** Number of blocks in a magazine exchanged between a thread cache and its pool */
+#define MEMPOOL_TCACHE_MAGAZINE 16
+
+/** Maximum number of thread caches of a single pool that may receive remote frees */
+#define MEMPOOL_TCACHE_OWNERS_MAX 64
+
 /* ------------------------------------------------------------ */
 /* -------------------------- Data types ---------------------- */
 /* ------------------------------------------------------------ */
@@ -31,22 +58,150 @@ typedef enum mempool_status_
     mempool_status_size_err, /**< Invalid size */
     mempool_status_out_of_memory, /**< Out of memory */
     mempool_status_nullptr, /**< Unexpected NULL pointer */
-    mempool_status_inv_memory /**< Invalid memory pointer */
+    mempool_status_inv_memory, /**< Invalid memory pointer */
+    mempool_status_not_supported /**< Operation not supported by the pool configuration */
 } mempool_status;
 
+/** Format of partition headers stored inside the pool buffer */
+typedef enum mempool_hdr_type_
+{
+    mempool_hdr_ptr, /**< Partitions linked with native pointers. Default format, no limit on pool size */
+    mempool_hdr_off16, /**< Partitions linked with 16-bit offsets from the base address. Pools up to 64 KiB */
+    mempool_hdr_off32 /**< Partitions linked with 32-bit offsets from the base address. Pools up to 4 GiB */
+} mempool_hdr_type;
+
+/**
+ * Function called before the pool touches a range of its memory. It allows backing providers to make the memory
+ * accessible on demand. Returns false when the memory cannot be provided.
+ */
+typedef bool (*mempool_commit_fn)(void* backing, void* addr, size len);
+
+/**
+ * Function releasing memory of a free partition to the backing provider. On success the whole range must read as
+ * zeros afterwards while pages fully covered by the range may be returned to the OS. Returns false when the range
+ * contains nothing that could be released - the memory is then left untouched.
+ */
+typedef bool (*mempool_release_fn)(void* backing, void* addr, size len);
+
+/**
+ * Function managing mappings that serve claims above the direct threshold (see mempool_set_direct_threshold()). When
+ * '*addr' is NULL a new mapping of at least '*len' bytes is created. Otherwise the mapping at '*addr' is resized to at
+ * least '*len' bytes, possibly moving it, or unmapped when '*len' is zero. Address and length of the resulting
+ * mapping are stored back. New memory must read as zeros. Returns mempool_status_inv_memory when '*addr' is not a live
+ * mapping and mempool_status_out_of_memory when memory cannot be mapped.
+ */
+typedef mempool_status (*mempool_direct_fn)(void* backing, void** addr, size* len);
+
+struct mempool_tcache_;
+
+/**
+ * State of optional pool features kept outside of the instance (see mempool_init_ex()). It is only accessed through
+ * the pool it was passed to.
+ */
+typedef struct mempool_ext_
+{
+#if MEMPOOL_THREAD_SAFE
+    futex_lock order_locks[MEMPOOL_ORDER_NUM]; /**< Lock of each free list */
+#endif
+    u32 detached; /**< Number of operations holding free partitions taken off their lists */
+    u32 detach_seq; /**< Futex word bumped whenever such an operation puts the partitions back */
+    u32 detach_waiters; /**< Number of threads sleeping on detach_seq */
+    u32 maint_waiting; /**< Non-zero while a maintenance thread sleeps and wants to be kicked */
+    u32 maint_seq; /**< Futex word bumped to kick a maintenance thread */
+    u64 cache_heads[MEMPOOL_ORDER_NUM]; /**< Tagged heads of lock-free caches of each order */
+    void* depot_heads[MEMPOOL_TCACHE_ORDERS]; /**< Full magazines returned by thread caches, guarded by order locks */
+    struct mempool_tcache_* owners[MEMPOOL_TCACHE_OWNERS_MAX]; /**< Thread caches indexed by owner id minus one */
+    u64 wait_map; /**< Bit N is set when a thread may be waiting for a partition of order N */
+    u32 wait_seqs[MEMPOOL_ORDER_NUM]; /**< Futex words bumped whenever waiters of each order are woken up */
+    u32 low_marks[MEMPOOL_ORDER_NUM]; /**< Number of free partitions of each order kept split in advance */
+    u64 stock_map; /**< Bit N is set when order N has a non-zero low watermark */
+} mempool_ext;
+
+/** Pool configuration used by mempool_init_ex() */
+typedef struct mempool_config_
+{
+    mempool_hdr_type hdr_type; /**< Format of partition headers */
+    mempool_commit_fn commit_fn; /**< Optional function making memory accessible before it is touched */
+    mempool_release_fn release_fn; /**< Optional function releasing memory of free partitions */
+    mempool_direct_fn direct_fn; /**< Optional function mapping memory for the largest claims */
+    void* backing; /**< Backing provider data passed to commit_fn, release_fn and direct_fn */
+    bool thread_safe; /**< Protect free lists with per-order locks, so the pool may be shared between threads */
+    bool lock_free; /**< Serve frees and exact-size claims from lock-free caches. Implies thread_safe */
+    bool shared; /**< Instance and buffer lie in one mapping shared between processes. Requires compact headers */
+    void* undo_log; /**< Optional undo log of metadata changes, placed in the mapping of a shared pool */
+    size undo_log_len; /**< Length of the undo log. Use mempool_calc_undo_log_size() to obtain the minimum */
+    mempool_ext* ext; /**< Optional extended state. Required by thread-safe pools, placed in the mapping of a shared
+                           pool */
+} mempool_config;
+
+/** Extra memory region attached to a pool */
+typedef struct mempool_region_
+{
+    char* base_addr; /**< Base address of the region */
+    size size; /**< Size of the region */
+} mempool_region;
+
 /** Mempool instance holding all information */
 typedef struct mempool_instance_
 {
     char* base_addr; /**< Base address of the pool buffer */
     size size; /**< Size of the pool buffer */
+    /* Fields below are set by init functions and must not be modified by the user */
+    mempool_hdr_type hdr_type; /**< Format of partition headers */
+    mempool_commit_fn commit_fn; /**< Function making memory accessible before it is touched. May be NULL */
+    mempool_release_fn release_fn; /**< Function releasing memory of free partitions. May be NULL */
+    mempool_direct_fn direct_fn; /**< Function mapping memory for claims above direct threshold. May be NULL */
+    void* backing; /**< Backing provider data */
+    uintptr_t trim_threshold; /**< Free partitions at least this large are released immediately. Zero disables it */
+    u16 hdr_size; /**< Size of a single partition header */
+    u16 region_cnt; /**< Number of regions, including the buffer passed at init */
+    u64 free_map; /**< Bit N is set when there is at least one free partition of order N */
+    uintptr_t free_heads[MEMPOOL_ORDER_NUM]; /**< Offsets of the first free partition of each order from base_addr */
+    mempool_region regions[MEMPOOL_REGIONS_MAX - 1]; /**< Regions attached with mempool_add_region() */
+    uintptr_t direct_threshold; /**< Claims at least this large get a dedicated mapping. Zero disables it */
+    bool thread_safe; /**< True if free lists are protected by the locks of the extended state */
+    bool lock_free; /**< True if lock-free caches are used */
+    bool shared; /**< True if the pool is shared between processes. Locks and futex words are process-shared then */
+    uintptr_t free_counts[MEMPOOL_ORDER_NUM]; /**< Number of free partitions of each order */
+    uintptr_t used_counts[MEMPOOL_ORDER_NUM]; /**< Number of occupied partitions of each order, cached blocks included */
+    u64 requested_bytes; /**< Number of bytes requested by claims the pool serves at the moment */
+    u64 granted_bytes; /**< Size of partitions serving these claims, headers included */
+    uintptr_t base_off; /**< Offset of the buffer from the instance, used instead of base_addr by shared pools */
+    uintptr_t log_off; /**< Offset of the undo log from the instance. Zero if metadata changes are not logged */
+    uintptr_t ext_off; /**< Offset of the extended state from the instance. Zero if the pool has none */
 } mempool_instance;
 
+/** Per-thread cache of blocks claimed from a pool. It must be used by a single thread at a time */
+typedef struct mempool_tcache_
+{
+    mempool_instance* pool; /**< Pool the blocks come from */
+    void* heads[MEMPOOL_TCACHE_ORDERS]; /**< Cached blocks of each order, linked through their usable space */
+    u32 counts[MEMPOOL_TCACHE_ORDERS]; /**< Number of cached blocks of each order */
+    void* remote_head; /**< Blocks freed by other threads, pushed without locks and drained by the owner */
+    u8 owner_id; /**< Id stored in headers of blocks claimed through the cache. Zero if the cache has no id */
+} mempool_tcache;
+
+/** Snapshot of pool statistics filled by mempool_get_stats() */
+typedef struct mempool_stats_
+{
+    size free_counts[MEMPOOL_ORDER_NUM]; /**< Number of free partitions of each order */
+    size used_counts[MEMPOOL_ORDER_NUM]; /**< Number of occupied partitions of each order, cached blocks included */
+    size free_bytes; /**< Total size of free partitions, headers included */
+    size largest_free; /**< Size of the largest free partition, header included. Zero if there is none */
+    u32 fragmentation; /**< External fragmentation in per mille - the part of free memory outside the largest free
+                            partition. Zero when free memory forms a single partition */
+    size requested_bytes; /**< See mempool_memory_requested() */
+    size granted_bytes; /**< See mempool_memory_granted() */
+} mempool_stats;
+
 /** Mempool debug info structure. May be used for testing purposes */
 typedef struct mempool_debug_info_
 {
-    bool is_first; /**< True if the partition does not have predecessor */
-    bool is_last; /**< True if the partition does not have successor */
+    bool is_first; /**< True if the partition does not have predecessor within its region */
+    bool is_last; /**< True if the partition does not have successor within its region */
     bool room_occupied; /**< True if the partition is occupied */
+    bool released; /**< True if the partition is free and its memory was released */
+    bool cached; /**< True if the partition is kept in a lock-free or thread cache. It is reported as occupied */
     size room_size; /**< Size of the partition */
     size usable_size; /**< Size available for the user */
     const void* base_addr; /** Base address of the partition */
@@ -63,7 +218,7 @@ typedef struct mempool_debug_info_
  * The function has to be invoked before any other API functions. It creates a single memory partition that occupies all
  * available space based on parameters inside 'pool' variable. Mempool module assumes that memory buffer was allocated
  * prior to calling this API function and it will be freed outside this module. Memory buffer has to follow below rules:
- *  1. Its size must be a power of two
+ *  1. Its size must be a power of two (sizes above 4 GiB are supported when size type is 64 bits wide)
  *  2. It has to be large enough to contain partition header + 1 extra byte - use mempool_calc_hdr_size() to calculate
  *     header length
  *  3. Alignment of the buffer must be safe for any object if CPU architecture does not support unaligned memory
@@ -79,21 +234,210 @@ typedef struct mempool_debug_info_
  */
 mempool_status mempool_init(mempool_instance* pool);
 
+/**
+ * Fill pool configuration with default values.
+ *
+ * The defaults are the same as the ones used by mempool_init(). The function does nothing when NULL is passed.
+ *
+ * @param config Pointer to a configuration struct.
+ */
+void mempool_default_config(mempool_config* config);
+
+/**
+ * Initialize mempool instance with custom configuration.
+ *
+ * The function works the same way as mempool_init() but allows to tune the pool. Compact header formats
+ * (mempool_hdr_off16, mempool_hdr_off32) store links between partitions as offsets from the base address, thus
+ * shrinking per-partition metadata and the smallest partition size. They are limited to 64 KiB and 4 GiB buffers
+ * respectively. When commit function is set, the pool calls it before writing a partition header or handing out a
+ * partition, so the buffer may be only partially accessible at the time of initialization.
+ *
+ * Thread-safe pools protect each free list with its own lock. Claim, free, realloc and trim functions may then be
+ * called from multiple threads at once. A split or a merge holds a single lock at a time and the final check of a buddy
+ * is done under the same lock as the insertion into a free list, so no lock ordering is needed. A claim that finds no
+ * free partition while other threads are splitting or merging some waits until they are done, thus it fails only when
+ * the memory is really taken. Functions that walk all partitions (usage and debug info) as well as mempool_add_region()
+ * are not synchronized and must not run concurrently with other calls. Thread-safe and lock-free pools are available
+ * only when the library is built with MEMPOOL_THREAD_SAFE.
+ *
+ * Lock-free pools put freed partitions onto per-order Treiber stacks instead of merging them. A claim first pops
+ * a partition of the exact order, so claims and frees of cached orders never block. Heads are tagged pointers
+ * updated with a single 64-bit compare-and-swap, which keeps them safe from the ABA problem. Cached partitions are
+ * coalesced by mempool_drain_cache(), which is also called when the buddy tree cannot serve a claim. The tag takes
+ * the upper 16 bits of a head, so the whole buffer has to lie below 2^48 - addresses with 57-bit virtual address
+ * spaces or with tags in the top byte are rejected.
+ *
+ * Shared pools keep the instance and the buffer in one mapping shared between processes, which may map it at
+ * different addresses. The buffer is then located relatively to the instance and base_addr is valid in the
+ * initializing process only. Compact headers are required and callbacks as well as lock-free caches are not
+ * supported. Locks and futex words use process-shared futexes. See mempool_shm.h for a ready-made segment layout.
+ *
+ * Locks, caches, waits and low watermarks live in an extended state passed in the configuration, so pools that do
+ * not use them stay small. Thread-safe and lock-free pools need it, thread caches and low watermarks are not supported
+ * without it. The state is located relatively to the instance - neither of them may be moved while the pool is in
+ * use. A shared pool keeps its state in the shared mapping.
+ *
+ * A shared pool that is not thread-safe may keep an undo log of its metadata, which makes it crash-consistent: every
+ * header and free list field modified by a claim, free or split is recorded before the change and the log is
+ * cleared once the operation is complete. mempool_recover() rolls back the operation a crashed process was in the
+ * middle of. See mempool_persist.h for pools kept in files.
+ *
+ * @param pool Pointer to a struct containing pool properties. The struct has to be initialized with valid values.
+ * @param config Pointer to a configuration. Use mempool_default_config() to obtain default values.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case size of the memory buffer is not a power of two or it is too large for
+ *           the selected header format
+ *         - mempool_status_out_of_memory when the buffer is to small to allocate first partition or the commit
+ *           function failed
+ *         - mempool_status_nok in case the configuration is not valid
+ *         - mempool_status_not_supported in case a shared pool or an undo log is requested with unsupported options,
+ *           a lock-free pool is requested for a buffer that lies above 2^48 or a thread-safe pool is requested while
+ *           MEMPOOL_THREAD_SAFE is zero or without an extended state
+ *         - mempool_status_size_err in case the undo log is too small
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_init_ex(mempool_instance* pool, const mempool_config* config);
+
+/**
+ * Attach an extra memory region to an initialized pool.
+ *
+ * The region becomes a further root partition and its memory is shared with the rest of the pool, thus claims are
+ * served from any region that has enough free memory. Live partitions are never moved. The buffer has to follow the
+ * same rules as the one passed to mempool_init() and it must stay valid as long as the pool is used. Regions cannot
+ * be detached. Only the default header format supports regions, since compact offsets are relative to base_addr.
+ *
+ * @param pool Pointer to an initialized pool instance.
+ * @param buf Pointer to a memory buffer.
+ * @param len Size of the buffer.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case size of the buffer is not a power of two
+ *         - mempool_status_out_of_memory when the buffer is to small to allocate a partition or the commit function
+ *           failed
+ *         - mempool_status_inv_memory when the buffer overlaps with a region already managed by the pool
+ *         - mempool_status_not_supported when the pool uses compact header format or the pool is lock-free and the
+ *           buffer lies above 2^48
+ *         - mempool_status_nok when MEMPOOL_REGIONS_MAX regions are already attached
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_add_region(mempool_instance* pool, void* buf, size len);
+
+/**
+ * Get address of the pool buffer in the calling process.
+ *
+ * Processes map shared pools at different addresses, so base_addr of a shared pool is valid in the initializing
+ * process only. The function locates the buffer relatively to the instance then.
+ *
+ * @param pool Pointer to an initialized pool instance.
+ * @return Address of the buffer or NULL when NULL was passed.
+ */
+char* mempool_base_addr(const mempool_instance* pool);
+
+/**
+ * Get address of the extended state of a pool in the calling process.
+ *
+ * The state is located relatively to the instance, so it is found in the mapping of a shared pool as well.
+ *
+ * @param pool Pointer to an initialized pool instance.
+ * @return Address of the extended state or NULL when the pool has none or NULL was passed.
+ */
+mempool_ext* mempool_ext_addr(const mempool_instance* pool);
+
 /**
  * Calculate how many bytes are needed to store partition's metadata.
  *
  * This chunk of memory is excluded from general usage and it is hidden from the user (no need to manually move N bytes
- * forward to get usable memory pointer).
+ * forward to get usable memory pointer). The value is valid for pools using the default header format.
  *
  * @return The number of bytes.
  */
 size mempool_calc_hdr_size();
 
+/**
+ * Calculate how many bytes are needed to store partition's metadata for a specific header format.
+ *
+ * @param hdr_type Header format.
+ * @return The number of bytes or zero when the format is not valid.
+ */
+size mempool_calc_hdr_size_ex(mempool_hdr_type hdr_type);
+
+/**
+ * Calculate how many bytes an undo log needs (see mempool_config).
+ *
+ * @return Minimum length of an undo log.
+ */
+size mempool_calc_undo_log_size();
+
+/**
+ * Bring a shared pool back into a usable state after the processes using it crashed or exited.
+ *
+ * Locks are released and waiters are forgotten. With an undo log the operation interrupted by a crash is rolled back,
+ * which takes time proportional to the log and not to the size of the pool. An interrupted claim leaves the memory
+ * free and an interrupted free leaves the block claimed. The function must not run concurrently with other calls.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param undone Optional pointer where the number of rolled back metadata changes is stored.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_inv_memory in case the undo log is corrupted or the pool creation was never completed
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_recover(mempool_instance* pool, size* undone);
+
+/**
+ * Calculate how many bytes a snapshot of the current pool state needs (see mempool_snapshot()).
+ *
+ * @param pool Pointer to a pool instance.
+ * @return Length of a snapshot. Zero is returned when NULL was passed or the pool cannot be snapshotted.
+ */
+size mempool_calc_snapshot_size(const mempool_instance* pool);
+
+/**
+ * Copy the state of a pool into a buffer, so it can be brought back with mempool_restore().
+ *
+ * Only the instance, occupied partitions and headers of free partitions are copied - usable space of free partitions
+ * is skipped. A snapshot is therefore about as large as the memory in use and rolling speculative work back does not
+ * require freeing each block claimed since the snapshot was taken. Pools whose memory may be committed, released,
+ * mapped directly or spread over several regions, as well as pools with an undo log, are not supported. Thread caches
+ * should be flushed first and no other calls may run concurrently.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param buf Buffer for the snapshot.
+ * @param buf_len Length of the buffer.
+ * @param snap_len Optional pointer where the length of the snapshot is stored, even if the buffer is too small.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_not_supported in case the pool configuration does not allow snapshots
+ *         - mempool_status_size_err in case the buffer is too small
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_snapshot(const mempool_instance* pool, void* buf, size buf_len, size* snap_len);
+
+/**
+ * Bring a pool back to the state stored by mempool_snapshot().
+ *
+ * All blocks claimed since the snapshot was taken become free and blocks freed since then are claimed again, with
+ * their content from the time of the snapshot. The same snapshot may be restored any number of times. Thread caches
+ * should be flushed first and no other calls may run concurrently, except for threads sleeping in
+ * mempool_claim_wait() - they are woken up to check the restored pool.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param buf Buffer holding the snapshot.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_not_supported in case the pool configuration does not allow snapshots
+ *         - mempool_status_inv_memory in case the buffer does not hold a snapshot of the pool
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_restore(mempool_instance* pool, const void* buf);
+
 /**
  * Calculate how many partitions are available.
  *
  * The function counts both occupied and not occupied ones. The pool has to be initialized at the time this function is
- * called.
+ * called. The value is kept up to date by claims and frees, so the call takes constant time. It may be slightly off
+ * while other threads split or merge partitions.
  *
  * @param pool Pointer to a pool instance.
  * @return The number of partitions used or zero when NULL was passed.
@@ -103,13 +447,51 @@ size mempool_partitions_used(const mempool_instance* pool);
 /**
  * Check how much memory is used.
  *
- * The function returns zero when NULL is passed.
+ * Occupied partitions count whole, free ones count only their headers. The value is derived from numbers of free
+ * partitions of each order, so the call does not depend on the number of partitions. The function returns zero when
+ * NULL is passed.
  *
  * @param pool Pointer to a pool instance
  * @return Total number of bytes used.
  */
 size mempool_memory_used(const mempool_instance* pool);
 
+/**
+ * Check how many bytes are requested by claims the pool serves at the moment.
+ *
+ * Claims count until their memory is freed, resizing in place updates them. Claims served by thread caches without
+ * reaching the pool are not counted. Compared with mempool_memory_granted() it shows how much memory is lost to
+ * rounding up to partition sizes.
+ *
+ * @param pool Pointer to a pool instance.
+ * @return Total number of bytes requested or zero when NULL was passed.
+ */
+size mempool_memory_requested(const mempool_instance* pool);
+
+/**
+ * Check how many bytes are held by claims counted by mempool_memory_requested().
+ *
+ * @param pool Pointer to a pool instance.
+ * @return Total size of partitions serving the claims, headers included, or zero when NULL was passed.
+ */
+size mempool_memory_granted(const mempool_instance* pool);
+
+/**
+ * Take a snapshot of pool statistics.
+ *
+ * All values come from counters kept up to date by claims and frees, so the call takes constant time and may be made
+ * right after a claim failed with mempool_status_out_of_memory, e.g. to tell whether the memory is exhausted or only
+ * too fragmented to fit the request. The largest free partition is found with the map of non-empty free lists. Values
+ * may be slightly inconsistent with each other while other threads claim or free memory.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param stats Pointer to a structure where the statistics are stored.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_get_stats(const mempool_instance* pool, mempool_stats* stats);
+
 /**
  * Decode pool's debug data.
  *
@@ -129,7 +511,9 @@ size mempool_decode_debug_info(const mempool_instance* pool, mempool_debug_info*
  *
  * The pool must be initialized prior to calling this function. The memory has to be returned to the pool afterwards.
  * Note that in fact more memory than requested is allocated due to implementation constraints but this information is
- * hidden to the caller.
+ * hidden to the caller. The smallest free partition that fits the request is used, regardless of its region.
+ * Requests at least as large as the direct threshold are served by a dedicated mapping instead - when the mapping
+ * cannot be created the request falls back to the pool.
  *
  * @param pool Pointer to a pool instance.
  * @param len Requested size in bytes.
@@ -137,11 +521,46 @@ size mempool_decode_debug_info(const mempool_instance* pool, mempool_debug_info*
  * @return Status code:
  *         - mempool_status_nullptr in case when NULL was passed instead of a valid pointer
  *         - mempool_status_size_err in case zero was passed as a requested length
- *         - mempool_status_out_of_memory when there is no free memory
+ *         - mempool_status_out_of_memory when there is no free memory or backing memory could not be committed
  *         - mempool_status_nok in case of general error that cannot be handled
  *         - mempool_status_ok on success
  */
-mempool_status mempool_claim_memory(const mempool_instance* pool, size len, void** dst);
+mempool_status mempool_claim_memory(mempool_instance* pool, size len, void** dst);
+
+/**
+ * Claim zero-initialized memory from the pool.
+ *
+ * The function works as mempool_claim_memory() but the requested bytes are set to zero. Partitions carved out of
+ * memory released by mempool_trim() already read as zeros, so they are not cleared again and their pages are not
+ * faulted in by the call.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param len Requested size in bytes.
+ * @param dst Destination buffer where memory address will be stored.
+ * @return Status code - the same as for mempool_claim_memory().
+ */
+mempool_status mempool_claim_zeroed(mempool_instance* pool, size len, void** dst);
+
+/**
+ * Claim memory from the pool, waiting until it becomes available.
+ *
+ * The function works as mempool_claim_memory(), but when the pool is exhausted the calling thread sleeps on a futex
+ * instead of failing. Frees wake only threads waiting for partitions no larger than the freed (and merged) one, so
+ * small frees do not disturb threads waiting for large blocks. Waiting is available for thread-safe pools only.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param len Requested size in bytes.
+ * @param dst Destination buffer where memory address will be stored.
+ * @param timeout_ns Maximum time to wait in nanoseconds. Zero makes a single attempt, MEMPOOL_WAIT_FOREVER waits
+ *                   without a limit.
+ * @return Status code:
+ *         - mempool_status_nullptr in case when NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case zero was passed as a requested length
+ *         - mempool_status_not_supported in case the pool is not thread-safe
+ *         - mempool_status_out_of_memory when memory did not become available before the timeout expired
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_claim_wait(mempool_instance* pool, size len, void** dst, u64 timeout_ns);
 
 /**
  * Free reserved memory.
@@ -159,7 +578,228 @@ mempool_status mempool_claim_memory(const mempool_instance* pool, size len, void
  *         - mempool_status_nok when general error that cannot be handled occurred
  *         - mempool_status_ok on success
  */
-mempool_status mempool_free_memory(const mempool_instance* pool, void* memory);
+mempool_status mempool_free_memory(mempool_instance* pool, void* memory);
+
+/**
+ * Free many blocks of a pool at once.
+ *
+ * Blocks are grouped by order and merged with their buddies order by order, so the lock of each order is taken once
+ * per call rather than once per block and per merge step. Blocks freed together merge with each other as well.
+ * Blocks served by direct mappings are unmapped one by one. Pools with lock-free caches or an undo log free each block
+ * separately. An invalid block does not stop the call - the remaining blocks are still freed.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param blocks Array of 'cnt' pointers returned by claim functions.
+ * @param cnt Number of blocks.
+ * @return Instance of mempool_status:
+ *         - mempool_status_nullptr when NULL was passed instead of a valid pointer, including any of the blocks
+ *         - mempool_status_inv_memory when any of the blocks is not claimed
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_free_batch(mempool_instance* pool, void* const* blocks, size cnt);
+
+/**
+ * Resize claimed memory.
+ *
+ * Memory served by a direct mapping is resized by the pool direct_fn as long as the new size stays above the direct
+ * threshold, so its content is never copied. Memory claimed from the pool stays in place when the new size fits into
+ * its partition. Otherwise new memory is claimed, the content is copied and the old memory is freed. In case of an
+ * error the original memory stays valid.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param memory Pointer to a variable holding address of claimed memory. It is updated on success. When it holds
+ *               NULL the function works as mempool_claim_memory().
+ * @param len New size in bytes.
+ * @return Status code:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case zero was passed as a requested length
+ *         - mempool_status_inv_memory when memory pointer seems not to be valid
+ *         - mempool_status_out_of_memory when there is not enough memory for the new size
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_realloc_memory(mempool_instance* pool, void** memory, size len);
+
+/**
+ * Set direct mapping threshold.
+ *
+ * Claims of at least 'threshold' bytes bypass the buddy tree and get their own mapping from the pool direct_fn, so
+ * huge buffers do not force the tree to split and do not leave fragmentation behind when they are freed. The mappings
+ * are returned by mempool_free_memory(). Pools created by functions of mempool_vm.h come with such a function.
+ * Direct mappings are not partitions, thus they are not reported by mempool_partitions_used(), mempool_memory_used()
+ * and mempool_decode_debug_info().
+ *
+ * @param pool Pointer to a pool instance.
+ * @param threshold Size of the smallest claim served by a direct mapping. Zero disables direct mappings.
+ * @return Status code:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_not_supported in case the pool uses compact headers or has no direct_fn
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_set_direct_threshold(mempool_instance* pool, size threshold);
+
+/**
+ * Coalesce partitions held in lock-free caches and magazines returned by thread caches.
+ *
+ * Each cache is detached at once and its partitions are returned to the buddy tree, where they merge with their
+ * buddies. The function may run concurrently with claims and frees. Blocks held by thread caches themselves are not
+ * touched - use mempool_tcache_flush() for them.
+ *
+ * @param pool Pointer to a pool instance.
+ * @return The number of partitions returned to the buddy tree. Zero is returned when NULL was passed.
+ */
+size mempool_drain_cache(mempool_instance* pool);
+
+/**
+ * Release memory of free partitions to the backing provider.
+ *
+ * Free partitions are released starting from the largest ones until at most 'keep_bytes' of free memory stays
+ * backed. Only the page-aligned interior of a partition is returned to the OS - headers are kept, so the pool layout
+ * does not change. Released partitions read as zeros, which is used by mempool_claim_zeroed(). A released partition
+ * loses this state when it is merged with a partition that was just freed. Lock-free caches are drained first.
+ * For pools committing memory on demand the function must not run concurrently with claims of lock-free pools, since
+ * they may read links of cached blocks whose memory is released in the meantime.
+ *
+ * @param pool Pointer to a pool instance. The pool must have been configured with a release function.
+ * @param keep_bytes Amount of free memory that may remain backed.
+ * @return The number of bytes released. Zero is returned when NULL was passed or the pool has no release function.
+ */
+size mempool_trim(mempool_instance* pool, size keep_bytes);
+
+/**
+ * Set automatic trim threshold.
+ *
+ * When a partition at least 'threshold' bytes large becomes free (including merging with its buddies) its memory is
+ * released right away. The pool must have been configured with a release function for this to take effect.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param threshold Size of the smallest partition released on free. Zero disables automatic trimming.
+ */
+void mempool_set_trim_threshold(mempool_instance* pool, size threshold);
+
+/**
+ * Set low watermark of free partitions serving claims of a given size.
+ *
+ * mempool_replenish() splits larger free partitions in advance until at least 'count' free partitions able to serve
+ * claims of 'len' bytes exist, so such claims do not have to split the tree themselves. Partitions split this way
+ * are not merged back on free as long as the stock is needed - they are coalesced only when a claim cannot be served
+ * otherwise. A claim that takes the stock below the watermark kicks the maintenance thread (see mempool_maint.h).
+ *
+ * @param pool Pointer to a pool instance.
+ * @param len Claim size served by the stocked partitions.
+ * @param count Number of free partitions to keep. Zero removes the watermark.
+ * @return Status code:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case the size is zero or too large
+ *         - mempool_status_not_supported in case the pool has no extended state
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_set_low_watermark(mempool_instance* pool, size len, u32 count);
+
+/**
+ * Split free partitions to fill stocks below their low watermarks.
+ *
+ * The function may run concurrently with claims and frees of thread-safe pools.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param max_splits Maximum number of partitions to split.
+ * @return The number of partitions split. Zero is returned when NULL was passed or all stocks are full.
+ */
+size mempool_replenish(mempool_instance* pool, size max_splits);
+
+/**
+ * Do a bounded slice of deferred maintenance work.
+ *
+ * The function is meant to be called from idle hooks of event loops that cannot host a maintenance thread. Work is
+ * done in the following order, at most 'max_ops' steps per call:
+ *  1. Blocks held in lock-free caches are merged back into the buddy tree, one block per step
+ *  2. Magazines returned by thread caches are merged back, one magazine per step
+ *  3. Stocks below their low watermarks are split in advance, one split per step (see mempool_set_low_watermark())
+ *  4. Free partitions at least as large as the trim threshold are released, one partition per step (see
+ *     mempool_set_trim_threshold())
+ * Claims and frees stay as cheap as without maintenance - they only defer the work. A zero budget only checks whether
+ * any work is pending.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param max_ops Maximum number of steps.
+ * @return True if work remains, false if the pool is fully maintained or NULL was passed.
+ */
+bool mempool_maintain(mempool_instance* pool, size max_ops);
+
+/**
+ * Initialize a thread cache.
+ *
+ * A thread cache keeps blocks freed by its owner, so they can be claimed again without touching shared pool state.
+ * Blocks are grouped per order for the MEMPOOL_TCACHE_ORDERS smallest orders. An empty cache is refilled with a whole
+ * magazine of MEMPOOL_TCACHE_MAGAZINE blocks - either one returned by another cache or carved out of a single free
+ * partition. When a cache holds two magazines of an order, one of them is handed over to the pool. Claims of other
+ * sizes are passed to the pool directly. Each thread should use its own cache; the pool has to be thread-safe when
+ * caches of different threads share it.
+ *
+ * Pools with mempool_hdr_ptr headers give up to MEMPOOL_TCACHE_OWNERS_MAX caches an owner id. It is stored in headers
+ * of blocks claimed through the cache, so a block freed through a cache of another thread is queued back to its
+ * owner instead of being kept by the foreign cache. Caches without an id treat all blocks as their own.
+ *
+ * @param cache Pointer to a cache instance.
+ * @param pool Pointer to an initialized pool instance.
+ * @return Status code:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_not_supported in case the pool is shared between processes or has no extended state
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_tcache_init(mempool_tcache* cache, mempool_instance* pool);
+
+/**
+ * Claim memory through a thread cache.
+ *
+ * The function works as mempool_claim_memory(), but small claims are served from the cache whenever possible.
+ *
+ * @param cache Pointer to a cache instance.
+ * @param len Requested length in bytes.
+ * @param dst Pointer to a variable where the address of claimed memory is stored.
+ * @return Status code:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case zero was passed as a requested length
+ *         - mempool_status_out_of_memory when there is not enough memory
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_tcache_claim(mempool_tcache* cache, size len, void** dst);
+
+/**
+ * Free memory through a thread cache.
+ *
+ * Small blocks are kept in the cache. They stay occupied from the point of view of the pool until the cache hands
+ * them over. Any block claimed from the pool may be passed, not only ones claimed through this cache. Blocks owned by
+ * another cache are pushed onto its lock-free remote queue, which the owner drains in a batch on its next claim.
+ *
+ * @param cache Pointer to a cache instance.
+ * @param memory Pointer to claimed memory.
+ * @return Status code:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_inv_memory when memory pointer seems not to be valid
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_tcache_free(mempool_tcache* cache, void* memory);
+
+/**
+ * Return all blocks held by a thread cache to the buddy tree.
+ *
+ * Blocks queued by other threads are returned as well. The cache stays usable afterwards.
+ *
+ * @param cache Pointer to a cache instance.
+ * @return The number of blocks returned. Zero is returned when NULL was passed.
+ */
+size mempool_tcache_flush(mempool_tcache* cache);
+
+/**
+ * Flush a thread cache and give its owner id back to the pool.
+ *
+ * It has to be called before the cache is discarded, e.g. when its thread exits, otherwise the blocks are lost. No
+ * other thread may free blocks claimed through the cache concurrently with the call.
+ *
+ * @param cache Pointer to a cache instance.
+ * @return The number of blocks returned. Zero is returned when NULL was passed.
+ */
+size mempool_tcache_release(mempool_tcache* cache);
 
 #ifdef __cplusplus
 }
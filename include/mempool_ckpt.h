@@ -0,0 +1,143 @@
+#ifndef MEMPOOL_MEMPOOL_CKPT_H
+#define MEMPOOL_MEMPOOL_CKPT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mempool.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define MEMPOOL_CKPT_API_VERSION_MAJOR 0
+/** Minor version */
+#define MEMPOOL_CKPT_API_VERSION_MINOR 2
+/** Revision version */
+#define MEMPOOL_CKPT_API_VERSION_REVISION 0
+
+/** Maximum number of pools tracked at once in a process */
+#define MEMPOOL_CKPT_TRACKERS_MAX 16
+
+/** Magic number of a checkpoint manifest */
+#define MEMPOOL_CKPT_MAGIC 0x4B43504Du
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Data types ---------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Manifest stored at the beginning of a checkpoint file. It is followed by a copy of the pool instance and of its
+ * extended state, if the pool has one. The image of the pool buffer starts at offset 'data_off', page N of the buffer
+ * is stored at 'data_off + N * page_size'.
+ */
+typedef struct mempool_ckpt_manifest_
+{
+    u32 magic; /**< MEMPOOL_CKPT_MAGIC */
+    u32 instance_len; /**< Size of the pool instance copy following the manifest */
+    u32 ext_len; /**< Size of the extended state copy following the instance. Zero if the pool has none */
+    u32 _reserved;
+    u64 seq; /**< Number of the checkpoint, starting from one */
+    u64 pool_size; /**< Size of the pool buffer */
+    u64 page_size; /**< Size of a tracked page */
+    u64 data_off; /**< Offset of the buffer image in the file */
+    u64 base_addr; /**< Address of the buffer at the time of the checkpoint */
+} mempool_ckpt_manifest;
+
+/** Dirty page tracker of a pool */
+typedef struct mempool_ckpt_
+{
+    mempool_instance* pool; /**< Tracked pool */
+    char* base_addr; /**< Address of the pool buffer in the tracking process */
+    size page_size; /**< Size of a tracked page */
+    size page_cnt; /**< Number of pages of the pool buffer */
+    u64* dirty_map; /**< Bit set for each page modified since the last checkpoint */
+    size map_len; /**< Length of the mapping holding the dirty map */
+    u64 seq; /**< Number of checkpoints written so far */
+    size pages_written; /**< Number of pages written by the last checkpoint */
+} mempool_ckpt;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Start tracking pages of a pool modified between checkpoints.
+ *
+ * Pages written by the last checkpoint are made read-only. The first write to such a page raises a fault, which the
+ * tracker handles by marking the page dirty and making it writable again, so each page costs at most one fault per
+ * checkpoint interval. The first checkpoint writes all pages. The tracker installs a SIGSEGV handler that passes
+ * faults outside tracked pools on to the handler installed before.
+ *
+ * Pools with commit or release functions, extra regions or direct mappings are not supported, since they change
+ * memory without writing to it. For the same reason a shared pool may only be tracked when no other process writes
+ * to it, as it is the case for pools kept in files (see mempool_persist.h). The pool buffer has to be page-aligned.
+ *
+ * The kernel does not raise faults for its own writes, so system calls that store data into a read-only page, such
+ * as read(2) or recv(2) into a pool block, fail with EFAULT instead. Call mempool_ckpt_touch() for the destination
+ * range before such calls.
+ *
+ * @param ckpt Pointer to a tracker.
+ * @param pool Pointer to a pool instance.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_not_supported in case the pool configuration is not supported
+ *         - mempool_status_size_err in case the buffer is not page-aligned or smaller than a page
+ *         - mempool_status_out_of_memory when the dirty map could not be allocated
+ *         - mempool_status_nok in case MEMPOOL_CKPT_TRACKERS_MAX pools are tracked already
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_ckpt_start(mempool_ckpt* ckpt, mempool_instance* pool);
+
+/**
+ * Stop tracking a pool. All its pages are made writable.
+ *
+ * @param ckpt Pointer to a tracker.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_ckpt_stop(mempool_ckpt* ckpt);
+
+/**
+ * Mark pages of a tracked pool dirty and make them writable in advance.
+ *
+ * Use the function before system calls that write into pool memory (see mempool_ckpt_start()). It must not run
+ * concurrently with mempool_checkpoint(), which makes written pages read-only again.
+ *
+ * @param ckpt Pointer to a tracker.
+ * @param addr Start of the range that is about to be written.
+ * @param len Length of the range.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_inv_memory in case the range does not lie within the pool buffer
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_ckpt_touch(mempool_ckpt* ckpt, const void* addr, size len);
+
+/**
+ * Write pages modified since the last checkpoint and a manifest with the pool metadata to a file.
+ *
+ * Pages are written at fixed offsets, so the file always holds the image of the latest checkpoint. The manifest is
+ * written last. The pool must not be used while a checkpoint is written if the image has to be consistent.
+ *
+ * The file is updated in place, thus a checkpoint is not crash-safe: a crash while pages are written leaves pages
+ * newer than the manifest describes. Write each checkpoint into a copy of the file and rename it over the original
+ * one when the previous checkpoint has to survive a crash.
+ *
+ * @param ckpt Pointer to a tracker.
+ * @param fd Descriptor of the checkpoint file opened for writing. The same file has to be passed each time.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_nok in case the file could not be written. All pages are written again next time
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_checkpoint(mempool_ckpt* ckpt, int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_MEMPOOL_CKPT_H
@@ -0,0 +1,147 @@
+#ifndef MEMPOOL_MEMPOOL_EBR_H
+#define MEMPOOL_MEMPOOL_EBR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mempool.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define MEMPOOL_EBR_API_VERSION_MAJOR 0
+/** Minor version */
+#define MEMPOOL_EBR_API_VERSION_MINOR 1
+/** Revision version */
+#define MEMPOOL_EBR_API_VERSION_REVISION 0
+
+/** Maximum number of threads registered in a reclamation domain */
+#define MEMPOOL_EBR_THREADS_MAX 64
+/** Number of retired blocks a thread may hold per epoch */
+#define MEMPOOL_EBR_BATCH 256
+/** Number of epochs a thread keeps retired blocks of. Blocks are freed two epochs after being retired */
+#define MEMPOOL_EBR_EPOCHS 3
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Data types ---------------------- */
+/* ------------------------------------------------------------ */
+
+/** Epoch-based reclamation domain of a pool */
+typedef struct mempool_ebr_
+{
+    mempool_instance* pool; /**< Pool retired blocks are returned to */
+    u64 epoch; /**< Global epoch */
+    u64 slot_map; /**< Bitmap of registered thread slots */
+    u64 locals[MEMPOOL_EBR_THREADS_MAX]; /**< Thread epochs shifted left by one, bit 0 set inside critical sections */
+} mempool_ebr;
+
+/** Per-thread state of a reclamation domain */
+typedef struct mempool_ebr_thread_
+{
+    mempool_ebr* ebr; /**< Domain the thread is registered in */
+    u32 slot; /**< Slot of the thread in the domain */
+    u32 nesting; /**< Depth of nested critical sections */
+    u64 bucket_epochs[MEMPOOL_EBR_EPOCHS]; /**< Epoch blocks of each bucket were retired in */
+    u32 bucket_counts[MEMPOOL_EBR_EPOCHS]; /**< Number of blocks in each bucket */
+    void* buckets[MEMPOOL_EBR_EPOCHS][MEMPOOL_EBR_BATCH]; /**< Retired blocks waiting for a grace period */
+} mempool_ebr_thread;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Initialize a reclamation domain.
+ *
+ * Lock-free containers allocating nodes from a pool cannot free a node as soon as it is unlinked, because readers
+ * may still traverse it. Such nodes are retired with mempool_retire() instead. Threads read shared nodes only inside
+ * critical sections (see mempool_ebr_enter()) and each critical section pins the global epoch it started in. The
+ * global epoch advances once every thread inside a critical section has seen it, so two epochs after a block was
+ * retired no reader can hold a reference to it and it is returned to the pool with mempool_free_batch(), together
+ * with the other blocks retired in the same epoch. Readers pay a single store and fence per critical section and
+ * never touch the pool.
+ *
+ * @param ebr Pointer to a domain.
+ * @param pool Pointer to a thread-safe pool instance.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_not_supported in case the pool is not thread-safe
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_ebr_init(mempool_ebr* ebr, mempool_instance* pool);
+
+/**
+ * Register the calling thread in a reclamation domain.
+ *
+ * @param ebr Pointer to a domain.
+ * @param thread Pointer to the thread state. It must be used by a single thread only.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_nok in case MEMPOOL_EBR_THREADS_MAX threads are already registered
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_ebr_register(mempool_ebr* ebr, mempool_ebr_thread* thread);
+
+/**
+ * Unregister a thread from its reclamation domain.
+ *
+ * The function waits until all blocks retired by the thread can be freed, so other threads have to leave their
+ * critical sections eventually.
+ *
+ * @param thread Pointer to the thread state.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_nok in case the thread is inside a critical section
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_ebr_unregister(mempool_ebr_thread* thread);
+
+/**
+ * Enter a critical section. Shared nodes may be read until the matching mempool_ebr_exit() call.
+ *
+ * Critical sections may be nested.
+ *
+ * @param thread Pointer to the thread state.
+ */
+void mempool_ebr_enter(mempool_ebr_thread* thread);
+
+/**
+ * Leave a critical section.
+ *
+ * @param thread Pointer to the thread state.
+ */
+void mempool_ebr_exit(mempool_ebr_thread* thread);
+
+/**
+ * Retire memory unlinked from a shared structure. It is freed once no thread can hold a reference to it.
+ *
+ * The block must not be reachable for threads entering a critical section after the call. A thread that fills its
+ * bucket of the current epoch waits for a grace period, which is not possible from inside its own critical section.
+ *
+ * @param thread Pointer to the thread state.
+ * @param memory Pointer to memory claimed from the domain pool.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_out_of_memory in case the bucket is full and the thread is inside a critical section
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_retire(mempool_ebr_thread* thread, void* memory);
+
+/**
+ * Try to advance the global epoch and free blocks whose grace period has passed.
+ *
+ * Threads call it implicitly while retiring. An explicit call is useful in threads that stopped retiring.
+ *
+ * @param thread Pointer to the thread state.
+ * @return Number of blocks returned to the pool. Zero is returned in case NULL was passed.
+ */
+size mempool_ebr_collect(mempool_ebr_thread* thread);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_MEMPOOL_EBR_H
@@ -0,0 +1,75 @@
+#ifndef MEMPOOL_MEMPOOL_MAINT_H
+#define MEMPOOL_MEMPOOL_MAINT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+
+#include "mempool.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define MEMPOOL_MAINT_API_VERSION_MAJOR 0
+/** Minor version */
+#define MEMPOOL_MAINT_API_VERSION_MINOR 1
+/** Revision version */
+#define MEMPOOL_MAINT_API_VERSION_REVISION 0
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Data types ---------------------- */
+/* ------------------------------------------------------------ */
+
+/** Background maintenance thread of a pool */
+typedef struct mempool_maint_
+{
+    mempool_instance* pool; /**< Maintained pool */
+    u64 interval_ns; /**< Maximum time between two maintenance passes */
+    pthread_t thread; /**< Maintenance thread */
+    u32 stop; /**< Set to non-zero to make the thread exit */
+    u64 passes; /**< Number of maintenance passes done so far */
+} mempool_maint;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Start a maintenance thread.
+ *
+ * The thread takes merge and split work off the threads serving requests. Each pass calls mempool_maintain() until
+ * no work remains, so blocks held in lock-free caches and magazine depots are coalesced, stocks of sizes with a low
+ * watermark (see mempool_set_low_watermark()) are split in advance and large free partitions are trimmed. Between
+ * passes the thread sleeps until a claim takes a stock below its watermark or the interval expires. Only one
+ * maintenance thread may run per pool.
+ *
+ * @param maint Pointer to a maintenance thread instance.
+ * @param pool Pointer to a thread-safe pool instance.
+ * @param interval_ns Maximum time between two passes. FUTEX_WAIT_FOREVER makes the thread run only when kicked.
+ * @return Status code:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_not_supported in case the pool is not thread-safe
+ *         - mempool_status_nok when the thread could not be created
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_maint_start(mempool_maint* maint, mempool_instance* pool, u64 interval_ns);
+
+/**
+ * Stop a maintenance thread and wait until it exits.
+ *
+ * @param maint Pointer to a running maintenance thread instance.
+ * @return Status code:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_maint_stop(mempool_maint* maint);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_MEMPOOL_MAINT_H
@@ -0,0 +1,114 @@
+#ifndef MEMPOOL_MEMPOOL_NUMA_H
+#define MEMPOOL_MEMPOOL_NUMA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mempool.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define MEMPOOL_NUMA_API_VERSION_MAJOR 0
+/** Minor version */
+#define MEMPOOL_NUMA_API_VERSION_MINOR 1
+/** Revision version */
+#define MEMPOOL_NUMA_API_VERSION_REVISION 0
+
+/** Maximum number of NUMA nodes handled by a pool set. Nodes above the limit are not used */
+#define MEMPOOL_NUMA_NODES_MAX 16
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Data types ---------------------- */
+/* ------------------------------------------------------------ */
+
+/** Set of pools, one per NUMA node */
+typedef struct mempool_numa_set_
+{
+    u32 node_cnt; /**< Number of nodes (and pools) in the set */
+    bool bound; /**< True if pool memory was successfully bound to the nodes */
+    u32 node_ids[MEMPOOL_NUMA_NODES_MAX]; /**< Node identifiers as reported by the OS */
+    mempool_instance pools[MEMPOOL_NUMA_NODES_MAX]; /**< Pool of each node */
+} mempool_numa_set;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Create a set of pools, one per online NUMA node.
+ *
+ * Pools are created with mempool_create_mapped_array() and memory of each one is bound to its node with mbind() using
+ * the preferred policy before any page is faulted in, so pages are placed on the node as long as it has free memory
+ * and the allocation does not fail otherwise. When the system does not expose NUMA topology a single pool is created.
+ * When binding is not permitted the pools are still created and 'bound' is cleared. The set is not synchronized - each
+ * pool has to be used the same way as a standalone one.
+ *
+ * @param set Pointer to a pool set.
+ * @param pool_size Size of each pool. It must be a power of two not smaller than page size.
+ * @param flags MEMPOOL_MAP_* flags passed to mempool_create_mapped_array(). Pre-faulting is done after binding.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case pool size is invalid
+ *         - mempool_status_out_of_memory when memory could not be mapped
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_numa_create(mempool_numa_set* set, size pool_size, u32 flags);
+
+/**
+ * Destroy a pool set and return its memory to the OS.
+ *
+ * @param set Pointer to a pool set.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_numa_destroy(mempool_numa_set* set);
+
+/**
+ * Claim memory from the pool of the node the calling thread runs on.
+ *
+ * The node is obtained with getcpu(). When the local pool cannot serve the request the remaining pools are tried
+ * in node order.
+ *
+ * @param set Pointer to a pool set.
+ * @param len Requested size in bytes.
+ * @param dst Destination buffer where memory address will be stored.
+ * @return Status code - the same as for mempool_claim_memory().
+ */
+mempool_status mempool_numa_claim(mempool_numa_set* set, size len, void** dst);
+
+/**
+ * Free memory claimed from a pool set. The memory is returned to the pool that owns it, regardless of the node the
+ * calling thread runs on.
+ *
+ * @param set Pointer to a pool set.
+ * @param memory Pointer to claimed memory.
+ * @return Status code:
+ *         - mempool_status_nullptr when NULL was passed instead of a valid pointer
+ *         - mempool_status_inv_memory when memory does not belong to any pool of the set
+ *         - other codes returned by mempool_free_memory()
+ */
+mempool_status mempool_numa_free(mempool_numa_set* set, void* memory);
+
+/**
+ * Get index of the pool that owns memory.
+ *
+ * Pool buffers lie back to back, so the owner of memory claimed from them is computed from the address. Extra regions
+ * and direct mappings of the pools are searched otherwise, the latter with their tables locked.
+ *
+ * @param set Pointer to a pool set.
+ * @param memory Pointer to claimed memory.
+ * @return Index into 'pools' and 'node_ids' arrays. MEMPOOL_NUMA_NODES_MAX is returned when memory does not belong
+ *         to the set or NULL was passed.
+ */
+u32 mempool_numa_owner(const mempool_numa_set* set, const void* memory);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_MEMPOOL_NUMA_H
@@ -0,0 +1,121 @@
+#ifndef MEMPOOL_MEMPOOL_PERCPU_H
+#define MEMPOOL_MEMPOOL_PERCPU_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mempool.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define MEMPOOL_PERCPU_API_VERSION_MAJOR 0
+/** Minor version */
+#define MEMPOOL_PERCPU_API_VERSION_MINOR 1
+/** Revision version */
+#define MEMPOOL_PERCPU_API_VERSION_REVISION 0
+
+/** Maximum number of pools in a per-CPU set. CPUs above the limit share pools with the lower ones */
+#define MEMPOOL_PERCPU_MAX 64
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Data types ---------------------- */
+/* ------------------------------------------------------------ */
+
+/** Set of pools, one per CPU */
+typedef struct mempool_percpu_set_
+{
+    u32 pool_cnt; /**< Number of pools in the set */
+    bool rseq; /**< True if CPU numbers are read from the rseq area registered by the C library */
+    mempool_instance pools[MEMPOOL_PERCPU_MAX]; /**< Pool of each CPU */
+} mempool_percpu_set;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Create a set of pools, one per configured CPU.
+ *
+ * Pools are created with mempool_create_mapped_array() as thread-safe pools. Threads running on a CPU claim from its
+ * pool, so the pool locks are shared only by threads that were preempted or migrated in the middle of an operation.
+ * The number of CPUs does not depend on the number of threads, which keeps the memory overhead bounded when there
+ * are far more threads than cores. The current CPU is read from the rseq area registered by the C library, which
+ * costs a single load. When rseq is not available sched_getcpu() is used instead.
+ *
+ * @param set Pointer to a pool set.
+ * @param pool_size Size of each pool. It must be a power of two not smaller than page size.
+ * @param flags MEMPOOL_MAP_* flags passed to mempool_create_mapped_array(). MEMPOOL_MAP_THREAD_SAFE is always added.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case pool size is invalid
+ *         - mempool_status_out_of_memory when memory could not be mapped
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_percpu_create(mempool_percpu_set* set, size pool_size, u32 flags);
+
+/**
+ * Destroy a pool set and return its memory to the OS.
+ *
+ * @param set Pointer to a pool set.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_percpu_destroy(mempool_percpu_set* set);
+
+/**
+ * Get index of the pool serving the CPU the calling thread runs on.
+ *
+ * @param set Pointer to a pool set.
+ * @return Index into 'pools' array. Zero is returned when NULL was passed or the CPU cannot be determined.
+ */
+u32 mempool_percpu_current(const mempool_percpu_set* set);
+
+/**
+ * Claim memory from the pool of the current CPU.
+ *
+ * When the local pool cannot serve the request the remaining pools are tried in order.
+ *
+ * @param set Pointer to a pool set.
+ * @param len Requested size in bytes.
+ * @param dst Destination buffer where memory address will be stored.
+ * @return Status code - the same as for mempool_claim_memory().
+ */
+mempool_status mempool_percpu_claim(mempool_percpu_set* set, size len, void** dst);
+
+/**
+ * Free memory claimed from a pool set. The memory is returned to the pool that owns it, regardless of the CPU the
+ * calling thread runs on.
+ *
+ * @param set Pointer to a pool set.
+ * @param memory Pointer to claimed memory.
+ * @return Status code:
+ *         - mempool_status_nullptr when NULL was passed instead of a valid pointer
+ *         - mempool_status_inv_memory when memory does not belong to any pool of the set
+ *         - other codes returned by mempool_free_memory()
+ */
+mempool_status mempool_percpu_free(mempool_percpu_set* set, void* memory);
+
+/**
+ * Get index of the pool that owns memory.
+ *
+ * Pool buffers lie back to back, so the owner of memory claimed from them is computed from the address without
+ * touching any pool. Extra regions and direct mappings of the pools are searched otherwise, the latter with their
+ * tables locked.
+ *
+ * @param set Pointer to a pool set.
+ * @param memory Pointer to claimed memory.
+ * @return Index into 'pools' array. MEMPOOL_PERCPU_MAX is returned when memory does not belong to the set or NULL
+ *         was passed.
+ */
+u32 mempool_percpu_owner(const mempool_percpu_set* set, const void* memory);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_MEMPOOL_PERCPU_H
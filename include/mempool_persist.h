@@ -0,0 +1,67 @@
+#ifndef MEMPOOL_MEMPOOL_PERSIST_H
+#define MEMPOOL_MEMPOOL_PERSIST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mempool_shm.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define MEMPOOL_PERSIST_API_VERSION_MAJOR 0
+/** Minor version */
+#define MEMPOOL_PERSIST_API_VERSION_MINOR 1
+/** Revision version */
+#define MEMPOOL_PERSIST_API_VERSION_REVISION 0
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Open a crash-consistent pool kept in a file.
+ *
+ * An empty file is laid out as the pool instance, an undo log and the page-aligned pool buffer, and a new pool is
+ * created in it. A file holding a pool is mapped and validated, and the operation interrupted by a crash, if any,
+ * is rolled back with mempool_recover(). Reopening takes time proportional to the undo log instead of the size of
+ * the pool, so data kept in the pool is available right after a restart. Links are stored as offsets, so the file
+ * may be mapped at any address - refer to blocks with offsets from mempool_shm_offset().
+ *
+ * The pool is not thread-safe and the file must be opened by one process at a time. The mapping is shared with the
+ * page cache, so a crashed process loses no completed operation. Use mempool_persist_sync() to make the content
+ * durable across system crashes. Close the pool with mempool_shm_detach().
+ *
+ * @param shm Pointer to a mapping descriptor.
+ * @param fd Descriptor of the file opened for reading and writing.
+ * @param pool_size Size of the pool buffer when a new pool is created. It must be a power of two not larger than
+ *                  4 GiB. The value is ignored when the file holds a pool already.
+ * @param undone Optional pointer where the number of rolled back metadata changes is stored.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case pool size is invalid
+ *         - mempool_status_out_of_memory when the file could not be resized or mapped
+ *         - mempool_status_inv_memory in case the file holds something else than a complete pool
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_persist_open(mempool_shm* shm, int fd, size pool_size, size* undone);
+
+/**
+ * Write the pool content back to its file and wait until it is stored.
+ *
+ * @param shm Pointer to a mapping descriptor obtained with mempool_persist_open().
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_nok in case the content could not be written
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_persist_sync(const mempool_shm* shm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_MEMPOOL_PERSIST_H
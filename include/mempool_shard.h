@@ -0,0 +1,109 @@
+#ifndef MEMPOOL_MEMPOOL_SHARD_H
+#define MEMPOOL_MEMPOOL_SHARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mempool.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define MEMPOOL_SHARD_API_VERSION_MAJOR 0
+/** Minor version */
+#define MEMPOOL_SHARD_API_VERSION_MINOR 1
+/** Revision version */
+#define MEMPOOL_SHARD_API_VERSION_REVISION 0
+
+/** Maximum number of shards of a sharded pool */
+#define MEMPOOL_SHARDS_MAX 16
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Data types ---------------------- */
+/* ------------------------------------------------------------ */
+
+/** Pool buffer split into equal shards, each managed by its own thread-safe instance */
+typedef struct mempool_sharded_
+{
+    char* base_addr; /**< Base address of the whole buffer */
+    size size; /**< Size of the whole buffer */
+    /* Fields below are set by mempool_shard_init() and must not be modified by the user */
+    u32 shard_cnt; /**< Number of shards */
+    u32 shard_shift; /**< Log2 of shard size, used to find the shard of an address */
+    mempool_instance shards[MEMPOOL_SHARDS_MAX]; /**< Instance of each shard */
+} mempool_sharded;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Initialize a sharded pool.
+ *
+ * The buffer described by 'base_addr' and 'size' fields is split into 'shard_cnt' power-of-two shards. Each shard
+ * has its own free lists and locks, so threads assigned to different shards never contend. Threads are assigned
+ * shards by hashing their identifiers. The shard of a block is computed from its address, thus frees take constant
+ * time. The same rules as for mempool_init() apply to the buffer and to each shard.
+ *
+ * @param pool Pointer to a sharded pool. Its 'base_addr' and 'size' fields must be set.
+ * @param shard_cnt Number of shards. It must be a power of two not larger than MEMPOOL_SHARDS_MAX.
+ * @param config Configuration of each shard. Shards are always thread-safe, so its 'ext' field must point to an
+ *               array of 'shard_cnt' extended states - shard i uses the i-th one.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case buffer size or number of shards is invalid
+ *         - mempool_status_not_supported in case no extended states were passed
+ *         - other codes returned by mempool_init_ex()
+ */
+mempool_status mempool_shard_init(mempool_sharded* pool, u32 shard_cnt, const mempool_config* config);
+
+/**
+ * Claim memory from the shard of the calling thread.
+ *
+ * When the shard cannot serve the request the remaining shards are tried in turn.
+ *
+ * @param pool Pointer to a sharded pool.
+ * @param len Requested size in bytes.
+ * @param dst Destination buffer where memory address will be stored.
+ * @return Status code - the same as for mempool_claim_memory().
+ */
+mempool_status mempool_shard_claim(mempool_sharded* pool, size len, void** dst);
+
+/**
+ * Free memory claimed from a sharded pool.
+ *
+ * @param pool Pointer to a sharded pool.
+ * @param memory Pointer to claimed memory.
+ * @return Status code:
+ *         - mempool_status_nullptr when NULL was passed instead of a valid pointer
+ *         - mempool_status_inv_memory when memory does not belong to the pool
+ *         - other codes returned by mempool_free_memory()
+ */
+mempool_status mempool_shard_free(mempool_sharded* pool, void* memory);
+
+/**
+ * Get index of the shard that owns memory.
+ *
+ * @param pool Pointer to a sharded pool.
+ * @param memory Pointer to claimed memory.
+ * @return Index into 'shards' array. MEMPOOL_SHARDS_MAX is returned when memory does not belong to the pool or NULL
+ *         was passed.
+ */
+u32 mempool_shard_of(const mempool_sharded* pool, const void* memory);
+
+/**
+ * Get index of the shard assigned to the calling thread.
+ *
+ * @param pool Pointer to a sharded pool.
+ * @return Index into 'shards' array. Zero is returned when NULL was passed.
+ */
+u32 mempool_shard_current(const mempool_sharded* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_MEMPOOL_SHARD_H
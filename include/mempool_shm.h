@@ -0,0 +1,107 @@
+#ifndef MEMPOOL_MEMPOOL_SHM_H
+#define MEMPOOL_MEMPOOL_SHM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mempool.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define MEMPOOL_SHM_API_VERSION_MAJOR 0
+/** Minor version */
+#define MEMPOOL_SHM_API_VERSION_MINOR 1
+/** Revision version */
+#define MEMPOOL_SHM_API_VERSION_REVISION 0
+
+/** Offset value representing NULL */
+#define MEMPOOL_SHM_OFFSET_NULL UINT64_MAX
+
+/* ------------------------------------------------------------ */
+/* -------------------------- Data types ---------------------- */
+/* ------------------------------------------------------------ */
+
+/** Mapping of a shared pool segment in the calling process */
+typedef struct mempool_shm_
+{
+    char* map_addr; /**< Address the segment is mapped at. Differs between processes */
+    size map_len; /**< Length of the mapping */
+    mempool_instance* pool; /**< Pool instance placed at the beginning of the segment */
+} mempool_shm;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Create a pool in a shared memory segment.
+ *
+ * The segment starts with the pool instance and its extended state, followed by the page-aligned pool buffer, so the
+ * whole control state is shared. The pool is thread-safe and uses the smallest compact header format covering its
+ * size, so all links are offsets and other processes may map the segment at any address with mempool_shm_attach().
+ * Memory is passed between processes without copying by handing over offsets (see mempool_shm_offset()). A block may
+ * be freed by any process.
+ *
+ * @param shm Pointer to a mapping descriptor.
+ * @param fd Descriptor of an empty segment, e.g. obtained with memfd_create() or shm_open(). It is resized to fit.
+ * @param pool_size Size of the pool buffer. It must be a power of two not larger than 4 GiB.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case pool size is invalid
+ *         - mempool_status_out_of_memory when the segment could not be resized or mapped
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_shm_create(mempool_shm* shm, int fd, size pool_size);
+
+/**
+ * Map a shared pool segment created with mempool_shm_create() into the calling process.
+ *
+ * @param shm Pointer to a mapping descriptor.
+ * @param fd Descriptor of the segment.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_out_of_memory when the segment could not be mapped
+ *         - mempool_status_inv_memory in case the segment does not hold a shared pool
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_shm_attach(mempool_shm* shm, int fd);
+
+/**
+ * Unmap a shared pool segment from the calling process. The segment itself lives until its last descriptor and
+ * mapping are gone.
+ *
+ * @param shm Pointer to a mapping descriptor.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_shm_detach(mempool_shm* shm);
+
+/**
+ * Convert memory inside a shared segment into an offset valid in all processes.
+ *
+ * @param shm Pointer to a mapping descriptor.
+ * @param memory Pointer to memory inside the segment.
+ * @return Offset from the beginning of the segment. MEMPOOL_SHM_OFFSET_NULL is returned in case NULL was passed or
+ *         the memory lies outside the segment.
+ */
+u64 mempool_shm_offset(const mempool_shm* shm, const void* memory);
+
+/**
+ * Convert an offset obtained with mempool_shm_offset() into memory address in the calling process.
+ *
+ * @param shm Pointer to a mapping descriptor.
+ * @param offset Offset from the beginning of the segment.
+ * @return Pointer to the memory. NULL is returned in case NULL was passed or the offset lies outside the segment.
+ */
+void* mempool_shm_pointer(const mempool_shm* shm, u64 offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_MEMPOOL_SHM_H
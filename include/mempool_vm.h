@@ -0,0 +1,237 @@
+#ifndef MEMPOOL_MEMPOOL_VM_H
+#define MEMPOOL_MEMPOOL_VM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "mempool.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------------- Macros ------------------------ */
+/* ------------------------------------------------------------ */
+
+/** Major version */
+#define MEMPOOL_VM_API_VERSION_MAJOR 0
+/** Minor version */
+#define MEMPOOL_VM_API_VERSION_MINOR 7
+/** Revision version */
+#define MEMPOOL_VM_API_VERSION_REVISION 0
+
+/** Alignment of pools created with mempool_create_mapped(). It matches the size of a huge page on x86-64 */
+#define MEMPOOL_MAP_ALIGNMENT ((size)2 * 1024 * 1024)
+
+/** Try to back the pool with explicitly reserved huge pages (MAP_HUGETLB) */
+#define MEMPOOL_MAP_HUGETLB (1u << 0)
+/** Ask for transparent huge pages. Used as a fallback when MAP_HUGETLB is requested but not available */
+#define MEMPOOL_MAP_THP (1u << 1)
+/** Fault in the whole pool memory while creating the pool, so no page fault is taken later by claims */
+#define MEMPOOL_MAP_POPULATE (1u << 2)
+/** Initialize the pool as thread-safe (see mempool_config) */
+#define MEMPOOL_MAP_THREAD_SAFE (1u << 3)
+
+/** Maximum number of live claims served by direct mappings of a single pool (see mempool_set_direct_threshold()) */
+#define MEMPOOL_DIRECT_MAPS_MAX 16
+
+/* ------------------------------------------------------------ */
+/* ---------------------- Public data types ------------------- */
+/* ------------------------------------------------------------ */
+
+/** Kind of memory backing a mapped pool */
+typedef enum mempool_map_backing_
+{
+    mempool_map_backing_none, /**< The pool was not created with mempool_create_mapped() */
+    mempool_map_backing_pages, /**< Regular pages */
+    mempool_map_backing_thp, /**< Regular mapping advised to use transparent huge pages */
+    mempool_map_backing_hugetlb /**< Explicitly reserved huge pages */
+} mempool_map_backing;
+
+/**
+ * Function preparing memory of a pool created with mempool_create_mapped_array() before any of its pages is touched,
+ * e.g. by setting a memory policy. It gets the user argument, index of the pool and its memory range.
+ */
+typedef void (*mempool_prepare_fn)(void* arg, u32 index, void* addr, size len);
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+/**
+ * Create a pool backed by reserved virtual memory.
+ *
+ * The function reserves 'reserve_size' bytes of address space without making them accessible. Pages are committed
+ * (made readable and writable) only when the pool touches them for the first time - either by writing a partition
+ * header or by handing out a partition. Resident memory thus follows real usage, while the whole reservation looks
+ * like a single power-of-two buffer to the pool and partition addresses never change. The pool uses the default
+ * header format and has to be destroyed with mempool_destroy(). Memory released by mempool_trim() is decommitted
+ * again. Claims above the direct threshold get their own anonymous mappings, see mempool_direct_maps().
+ *
+ * @param pool Pointer to a pool instance. Its fields are overwritten.
+ * @param reserve_size Size of the reservation. It must be a power of two not smaller than page size.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case reservation size is not a power of two or it is smaller than a page
+ *         - mempool_status_out_of_memory when address space could not be reserved
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_create_reserved(mempool_instance* pool, size reserve_size);
+
+/**
+ * Create a pool backed by a private anonymous mapping.
+ *
+ * The base address of the pool is aligned to MEMPOOL_MAP_ALIGNMENT, so large partitions start on huge page
+ * boundaries. With MEMPOOL_MAP_HUGETLB the mapping is first requested from the huge page pool. When it fails
+ * (no huge pages reserved or the pool is smaller than a huge page) and MEMPOOL_MAP_THP is set as well, a regular
+ * mapping advised with MADV_HUGEPAGE is used. The backing actually obtained is reported by mempool_map_backing_get().
+ * Pools backed by regular pages release free memory with mempool_release_pages(). With MEMPOOL_MAP_POPULATE all
+ * pages are faulted in before the function returns, whatever the backing: the range is advised with
+ * MADV_POPULATE_WRITE, and when the kernel does not support it each page is touched instead. The pool uses the
+ * default header format and has to be destroyed with mempool_destroy(). With MEMPOOL_MAP_THREAD_SAFE the pool may be
+ * shared between threads. Claims above the direct threshold get their own anonymous mappings, see
+ * mempool_direct_maps().
+ *
+ * @param pool Pointer to a pool instance. Its fields are overwritten.
+ * @param len Size of the pool. It must be a power of two not smaller than page size.
+ * @param flags Combination of MEMPOOL_MAP_* flags. Zero requests regular pages.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case pool size is not a power of two or it is smaller than a page
+ *         - mempool_status_out_of_memory when memory could not be mapped
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_create_mapped(mempool_instance* pool, size len, u32 flags);
+
+/**
+ * Create pools of equal size placed back to back in a single private anonymous mapping.
+ *
+ * Pool 'i' starts 'i * len' bytes after the base address of the first pool, so the pool owning an address can be
+ * found with address arithmetic. Each pool works as one created with mempool_create_mapped() and has to be
+ * destroyed with mempool_destroy(). With MEMPOOL_MAP_HUGETLB the pool size has to be a multiple of the huge page
+ * size. When 'prepare' is given it is called for each pool after the memory is mapped but before any page of it is
+ * faulted in or written by the pool, so a memory policy set there applies to all pages. Pre-faulting requested with
+ * MEMPOOL_MAP_POPULATE is done afterwards.
+ *
+ * @param pools Array of 'cnt' pool instances. Their fields are overwritten.
+ * @param cnt Number of pools.
+ * @param len Size of each pool. It must be a power of two not smaller than page size.
+ * @param flags Combination of MEMPOOL_MAP_* flags applied to all pools.
+ * @param prepare Optional function preparing memory of each pool.
+ * @param arg Argument passed to 'prepare'.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_size_err in case the number of pools is zero, pool size is not a power of two, it is
+ *           smaller than a page or the whole mapping would be too large
+ *         - mempool_status_out_of_memory when memory could not be mapped
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_create_mapped_array(mempool_instance* pools, u32 cnt, size len, u32 flags,
+                                           mempool_prepare_fn prepare, void* arg);
+
+/**
+ * Check what kind of memory backs a pool created with mempool_create_mapped().
+ *
+ * @param pool Pointer to a pool instance.
+ * @return Backing type. mempool_map_backing_none is returned when NULL was passed or the pool was not created with
+ *         mempool_create_mapped().
+ */
+mempool_map_backing mempool_map_backing_get(const mempool_instance* pool);
+
+/**
+ * Fault in all memory of a pool using multiple threads.
+ *
+ * Page faults on a fresh pool otherwise land on the claim path. The function splits the pool buffer and all its
+ * regions into equal chunks and touches every page of a chunk in a separate thread. Page content is preserved, so
+ * the function may be called on a pool that is already in use, as long as no other thread claims or frees memory
+ * in the meantime. Memory of reserved pools is committed first.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param threads Number of threads touching the memory. Zero selects the number of online CPUs. When a thread
+ *                cannot be started its chunk is touched by the calling thread.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_out_of_memory when memory of a reserved pool could not be committed
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_prefault(mempool_instance* pool, u32 threads);
+
+/**
+ * Check how many bytes of backing memory are committed.
+ *
+ * @param pool Pointer to a pool instance.
+ * @return The number of committed bytes. Zero is returned when NULL was passed or the pool was not created with
+ *         mempool_create_reserved().
+ */
+size mempool_committed_bytes(const mempool_instance* pool);
+
+/**
+ * Get the number of live direct mappings of a pool.
+ *
+ * Pools created by this module serve claims above the threshold set with mempool_set_direct_threshold() with
+ * private anonymous mappings. Up to MEMPOOL_DIRECT_MAPS_MAX of them may be live at once - further claims are served
+ * from the pool buffer. Direct mappings are resized with mremap(), so their content is never copied.
+ *
+ * @param pool Pointer to a pool instance.
+ * @return The number of live mappings. Zero is returned when NULL was passed or the pool was not created by this
+ *         module.
+ */
+u32 mempool_direct_maps(const mempool_instance* pool);
+
+/**
+ * Check if memory lies inside one of the live direct mappings of a pool.
+ *
+ * The table of mappings is locked for the lookup, so the function may be called while other threads claim and free
+ * memory of a thread-safe pool.
+ *
+ * @param pool Pointer to a pool instance.
+ * @param memory Pointer to claimed memory.
+ * @return True if memory belongs to a direct mapping of the pool. False is returned when NULL was passed or the pool
+ *         was not created by this module.
+ */
+bool mempool_direct_owns(const mempool_instance* pool, const void* memory);
+
+/**
+ * Find the pool of an array created with mempool_create_mapped_array() that owns memory.
+ *
+ * Memory of the pool buffers is found with address arithmetic. Regions attached later and direct mappings of all
+ * pools are searched only for addresses outside of the shared mapping.
+ *
+ * @param pools Array of 'cnt' pool instances.
+ * @param cnt Number of pools.
+ * @param memory Pointer to claimed memory.
+ * @return Index of the owning pool. 'cnt' is returned when memory belongs to none of the pools or NULL was passed.
+ */
+u32 mempool_mapped_array_owner(const mempool_instance* pools, u32 cnt, const void* memory);
+
+/**
+ * Destroy a pool created by one of the functions from this module and return its memory to the OS.
+ *
+ * Any memory claimed from the pool becomes invalid. Live direct mappings of the pool are unmapped as well.
+ *
+ * @param pool Pointer to a pool instance.
+ * @return Status of the operation:
+ *         - mempool_status_nullptr in case NULL was passed instead of a valid pointer
+ *         - mempool_status_not_supported in case the pool memory is not managed by this module
+ *         - mempool_status_ok on success
+ */
+mempool_status mempool_destroy(mempool_instance* pool);
+
+/**
+ * Release pages of private anonymous memory. Implementation of mempool_release_fn.
+ *
+ * The function may be set as a release function of pools working on buffers obtained with private anonymous mmap()
+ * (or malloc() blocks served from such mappings). Pages fully covered by the range are dropped with
+ * madvise(MADV_DONTNEED), the remaining edges are cleared, so the whole range reads as zeros afterwards.
+ * It must not be used for shared or file-backed memory.
+ *
+ * @param backing Backing provider data. Not used, may be NULL.
+ * @param addr Start of the range.
+ * @param len Length of the range.
+ * @return True on success, false when the range does not cover any whole page or pages could not be released.
+ */
+bool mempool_release_pages(void* backing, void* addr, size len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMPOOL_MEMPOOL_VM_H
@@ -0,0 +1,128 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "futex_lock.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------- Private data types ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Lock states */
+#define STATE_UNLOCKED 0u
+#define STATE_LOCKED 1u
+#define STATE_CONTENDED 2u
+
+/* Number of attempts to take the lock before sleeping */
+#define SPIN_LIMIT 100
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Private functions ------------------ */
+/* ------------------------------------------------------------ */
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/* Acquire a lock sleeping with futex operations of the given kind */
+static void lock_acquire(futex_lock* lock, int wait_op)
+{
+    if (LIKELY(futex_lock_try_acquire(lock))) {
+        return;
+    }
+
+    /* Short critical sections are usually over before sleeping would pay off */
+    for (u32 spin = 0; spin < SPIN_LIMIT; ++spin) {
+        cpu_relax();
+        if (STATE_UNLOCKED == __atomic_load_n(&lock->state, __ATOMIC_RELAXED) && futex_lock_try_acquire(lock)) {
+            return;
+        }
+    }
+
+    /* Mark the lock as contended, so the owner knows it has to wake somebody up */
+    while (STATE_UNLOCKED != __atomic_exchange_n(&lock->state, STATE_CONTENDED, __ATOMIC_ACQUIRE)) {
+        syscall(SYS_futex, &lock->state, wait_op, STATE_CONTENDED, NULL, NULL, 0);
+    }
+}
+
+/* Release a lock waking a waiter with futex operations of the given kind */
+static void lock_release(futex_lock* lock, int wake_op)
+{
+    if (UNLIKELY(STATE_CONTENDED == __atomic_exchange_n(&lock->state, STATE_UNLOCKED, __ATOMIC_RELEASE))) {
+        syscall(SYS_futex, &lock->state, wake_op, 1, NULL, NULL, 0);
+    }
+}
+
+/* Sleep on a word with futex operations of the given kind */
+static bool word_wait(u32* word, u32 expected, u64 timeout_ns, int wait_op)
+{
+    struct timespec timeout;
+    timeout.tv_sec = (time_t)(timeout_ns / 1000000000u);
+    timeout.tv_nsec = (long)(timeout_ns % 1000000000u);
+    long ret = syscall(SYS_futex, word, wait_op, expected, (FUTEX_WAIT_FOREVER == timeout_ns) ? NULL : &timeout,
+                       NULL, 0);
+    return !(0 != ret && ETIMEDOUT == errno);
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Api functions ---------------------- */
+/* ------------------------------------------------------------ */
+
+void futex_lock_init(futex_lock* lock)
+{
+    __atomic_store_n(&lock->state, STATE_UNLOCKED, __ATOMIC_RELAXED);
+}
+
+bool futex_lock_try_acquire(futex_lock* lock)
+{
+    u32 expected = STATE_UNLOCKED;
+    return __atomic_compare_exchange_n(&lock->state, &expected, STATE_LOCKED, false, __ATOMIC_ACQUIRE,
+                                       __ATOMIC_RELAXED);
+}
+
+void futex_lock_acquire(futex_lock* lock)
+{
+    lock_acquire(lock, FUTEX_WAIT_PRIVATE);
+}
+
+void futex_lock_release(futex_lock* lock)
+{
+    lock_release(lock, FUTEX_WAKE_PRIVATE);
+}
+
+void futex_lock_acquire_pshared(futex_lock* lock)
+{
+    lock_acquire(lock, FUTEX_WAIT);
+}
+
+void futex_lock_release_pshared(futex_lock* lock)
+{
+    lock_release(lock, FUTEX_WAKE);
+}
+
+bool futex_wait(u32* word, u32 expected, u64 timeout_ns)
+{
+    return word_wait(word, expected, timeout_ns, FUTEX_WAIT_PRIVATE);
+}
+
+void futex_wake(u32* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+bool futex_wait_pshared(u32* word, u32 expected, u64 timeout_ns)
+{
+    return word_wait(word, expected, timeout_ns, FUTEX_WAIT);
+}
+
+void futex_wake_pshared(u32* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
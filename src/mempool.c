@@ -1,3 +1,9 @@
+#if !defined(MEMPOOL_THREAD_SAFE) || MEMPOOL_THREAD_SAFE
+#define _POSIX_C_SOURCE 199309L
+#include <time.h>
+#endif
+#include <string.h>
+
 #include "mempool.h"
 #include "bit.h"
 #include "dll.h"
@@ -23,33 +29,149 @@
 #define MAGIC_NUMBER 0xFEED
 #endif
 
+/* Offsets marking missing predecessor/successor in compact headers */
+#define OFF16_NULL ((u16)0xFFFF)
+#define OFF32_NULL ((u32)0xFFFFFFFF)
+
+/* Bits of partition flags */
+#define PART_FLAG_ACTIVE 0 /* Partition is occupied */
+#define PART_FLAG_RELEASED 1 /* Partition memory was released to the backing provider and it reads as zeros */
+#define PART_FLAG_DIRECT 2 /* Memory is a direct mapping and not a part of any region */
+#define PART_FLAG_LISTED 3 /* Partition is linked into the free list of its order */
+#define PART_FLAG_CACHED 4 /* Partition is kept in a lock-free or thread cache. It still counts as active for the tree */
+
+/* Number of bits of a tagged cache head holding the block address. The remaining bits hold a tag that is bumped by
+ * every change of the head, so a stale head never compares equal. User space addresses fit into 48 bits unless the
+ * address space is 57 bits wide or pointers carry tags in the top byte - such buffers are rejected at init */
+#define TAGGED_PTR_BITS 48
+#define TAGGED_PTR_MASK (((u64)1 << TAGGED_PTR_BITS) - 1)
+
+/* Log2 of MEMPOOL_TCACHE_MAGAZINE - a magazine is carved out of a single partition this many orders larger */
+#define TCACHE_BATCH_SHIFT 4
+
+/* Pointer headers have room for the owner id of thread caches unless they are only 8 bytes long and keep a magic */
+#define PTR_HDR_OWNER ((MEMPOOL_CPU_ARCH == 64) || (MEMPOOL_CPU_ARCH == 32 && !MEMPOOL_SANITY_CHECK))
+
+/* Region index stored in headers of direct mappings */
+#define DIRECT_REGION 0xFF
+
+/* Offset stored in free list heads when the list is empty */
+#define HEAD_NULL UINTPTR_MAX
+
 /* ------------------------------------------------------------ */
 /* ---------------------- Private data types ------------------ */
 /* ------------------------------------------------------------ */
 
+/* Header stored after dll node in mempool_hdr_ptr format. Fields following the size fit into a single word, so the
+ * owner id of thread caches is left out where there is no room for it */
 typedef struct room_header_
 {
     size size;
+    u8 region;
 #if MEMPOOL_CPU_ARCH == 16
-    u8 _reserved[1];
+    u8 flags;
 #elif MEMPOOL_CPU_ARCH == 32
 #if MEMPOOL_SANITY_CHECK
+    u8 flags;
     u16 magic;
-    u8 _reserved[1];
 #else
-    u8 _reserved[3];
+    u8 owner;
+    u8 flags;
+    u8 _reserved[1];
 #endif
 #elif MEMPOOL_CPU_ARCH == 64
+    u8 owner;
+    u8 flags;
 #if MEMPOOL_SANITY_CHECK
+    u8 _reserved[3];
     u16 magic;
-    u8 _reserved[5];
 #else
-    u8 _reserved[7];
+    u8 _reserved[5];
 #endif
 #endif
-    u8 active;
 } room_header;
 
+/* Whole partition header in mempool_hdr_off16 format. Links are byte offsets from the pool base address */
+typedef struct room_header_off16_
+{
+    u16 prev;
+    u16 next;
+    u8 order;
+    u8 flags;
+#if MEMPOOL_SANITY_CHECK
+    u16 magic;
+#else
+    u8 _reserved[2];
+#endif
+} room_header_off16;
+
+/* Whole partition header in mempool_hdr_off32 format. Links are byte offsets from the pool base address */
+typedef struct room_header_off32_
+{
+    u32 prev;
+    u32 next;
+    u8 order;
+    u8 flags;
+#if MEMPOOL_SANITY_CHECK
+    u16 magic;
+#else
+    u8 _reserved[2];
+#endif
+#if MEMPOOL_CPU_ARCH == 64
+    u8 _reserved_align[4];
+#endif
+} room_header_off32;
+
+/* Magic number marking an undo log of a fully initialized pool */
+#define UNDO_LOG_MAGIC 0x554E444Fu
+
+/* Number of undo entries one operation may need. A split or a merge step records a handful of headers and fields
+ * per order, an operation does at most one step per order */
+#define UNDO_LOG_ENTRIES (MEMPOOL_ORDER_NUM * 16)
+
+/* Old content of a metadata range. Headers of compact formats fit into a single entry */
+typedef struct undo_entry_
+{
+    u64 off; /* Offset of the range from the pool instance */
+    u32 len;
+    u8 old[16];
+} undo_entry;
+
+/* Undo log of the operation in progress. It is empty between operations */
+typedef struct undo_log_
+{
+    u32 magic;
+    u32 count;
+    u32 capacity;
+    undo_entry entries[];
+} undo_log;
+
+/* Magic number at the beginning of a snapshot buffer */
+#define SNAPSHOT_MAGIC 0x534E4150u
+
+/* Free space shorter than this is copied together with its neighbours, since a separate range costs a record too */
+#define SNAPSHOT_GAP_MIN 64
+
+/* Header of a snapshot buffer. It is followed by a copy of the instance and by 'range_cnt' ranges */
+typedef struct snapshot_hdr_
+{
+    u32 magic;
+    u32 _reserved;
+    size len; /* Length of the whole snapshot */
+    size range_cnt;
+} snapshot_hdr;
+
+/* Range of the buffer kept in a snapshot. It is followed by 'len' bytes of data padded to the record alignment */
+typedef struct snapshot_range_
+{
+    size off; /* Offset of the range from the beginning of the buffer */
+    size len;
+} snapshot_range;
+
+/* Function called for each partition by traverse_partitions() */
+typedef void (*part_traverse_fn)(const mempool_instance* pool, const char* part, bool is_first, bool is_last,
+                                 void* user_data);
+
 /* Struct used in debug_traverse_imp() function */
 typedef struct dbg_traverse_user_data_
 {
@@ -57,20 +179,16 @@ typedef struct dbg_traverse_user_data_
     mempool_debug_info* dbg_info;
 } dbg_traverse_user_data;
 
-/* For searching buddy partitions */
-typedef enum buddy_pos_
-{
-    buddy_pos_left,
-    buddy_pos_right
-} buddy_pos;
-
-/* Status codes for merge function */
-typedef enum merge_status_
+/* Struct used in snapshot_traverse_impl() function. Ranges are only written when 'out' is not NULL */
+typedef struct snapshot_user_data_
 {
-    merge_status_internal_err,
-    merge_status_merged,
-    merge_status_not_merged
-} merge_status;
+    char* out;
+    size out_len;
+    size len;
+    size range_cnt;
+    size start; /* Range being collected, empty when both offsets are equal */
+    size end;
+} snapshot_user_data;
 
 /* ------------------------------------------------------------ */
 /* ----------------------- Private functions ------------------ */
@@ -82,262 +200,2434 @@ static inline bool is_power_of_two(size number)
     return (0 != number) && (!(number & (number - 1)));
 }
 
-/* Round up a number to the next power of two */
-static size round_pow_two(size v)
+/* Round up a number to the next power of two. Zero is returned when the result does not fit into size type */
+static inline size round_pow_two(size v)
 {
-    v--;
-    v |= v >> 1;
-    v |= v >> 2;
-    v |= v >> 4;
-    v |= v >> 8;
-    v |= v >> 16;
-    v++;
-    return v;
+    u32 order = BIT_64_LOG2_CEIL(v);
+    if (UNLIKELY(order >= sizeof(size) * 8)) {
+        return 0;
+    }
+    return (size)BIT_64_GET_AT_POS(order);
 }
 
-/* Function used in mempool_decode_debug_info() to decode debug data */
-static void debug_traverse_imp(const dll_node* node, void* user_data)
+/* Get base address of the pool buffer. Processes map shared pools at different addresses, so the buffer is located
+ * relatively to the instance which lies in the same mapping */
+static inline char* pool_base(const mempool_instance* pool)
 {
-    /* Calculate descriptor address */
-    room_header* header = (room_header*)dll_get_user_data(node);
-    dbg_traverse_user_data* dbg_data = user_data;
-    mempool_debug_info* dbg_tbl_row = &dbg_data->dbg_info[dbg_data->next_idx++];
-    dbg_tbl_row->is_first = (NULL == dll_get_prev_node(node));
-    dbg_tbl_row->is_last = (NULL == dll_get_next_node(node));
-    dbg_tbl_row->room_size = header->size;
-    dbg_tbl_row->room_occupied = header->active;
-    dbg_tbl_row->usable_size = header->size - mempool_calc_hdr_size();
-    dbg_tbl_row->base_addr = node;
-    dbg_tbl_row->usable_space_addr = (const char*)(node) + mempool_calc_hdr_size();
+    return UNLIKELY(pool->shared) ? (char*)pool + pool->base_off : pool->base_addr;
 }
 
-/* Implementation of dll find function */
-static bool find_partition_impl(const dll_node* node, void* user_data)
+/* Get undo log of a pool. The log lies in the same mapping as the instance */
+static inline undo_log* pool_log(const mempool_instance* pool)
 {
-    const room_header* hdr = dll_get_user_data(node);
-    size* total_len = user_data;
-    return hdr->size >= *total_len && !hdr->active;
+    return (undo_log*)((uintptr_t)pool + pool->log_off);
 }
 
-/* Implementation of function for calculating memory used */
-static void calc_mem_used_impl(const dll_node* node, void* user_data)
+/* Get extended state of a pool. NULL is returned when the pool has none. Thread-safe pools always have one */
+static inline mempool_ext* pool_ext(const mempool_instance* pool)
 {
-    size* mem_used = user_data;
-    const room_header* hdr = dll_get_user_data(node);
-    *mem_used += hdr->active ? hdr->size : mempool_calc_hdr_size();
+    return (0 == pool->ext_off) ? NULL : (mempool_ext*)((uintptr_t)pool + pool->ext_off);
 }
 
-/* Split partition */
-static bool split_partition(dll_node* partition)
+/* Record old content of metadata before modifying it, so an operation interrupted by a crash can be rolled back */
+static void undo_record_slow(const mempool_instance* pool, const void* addr, u32 len)
 {
-    room_header* hdr = dll_get_user_data(partition);
-    size new_len = hdr->size / 2;
+    undo_log* log = pool_log(pool);
+    u64 off = (u64)((uintptr_t)addr - (uintptr_t)pool);
+    u32 count = log->count;
 
-    /* Create buddy partition */
-    dll_node* new_buddy = (dll_node*)((char*)partition + new_len);
-    room_header* new_buddy_hdr = (room_header*)((char*)new_buddy + sizeof(dll_node));
-    if (UNLIKELY(dll_status_ok != dll_node_create(new_buddy, new_buddy_hdr))) {
-        return false;
+    /* Setters of one header usually follow each other */
+    if (0 != count && off == log->entries[count - 1].off && len == log->entries[count - 1].len) {
+        return;
+    }
+    /* Operations stay below UNDO_LOG_ENTRIES, the check only keeps a corrupted pool from writing past the log */
+    if (UNLIKELY(count >= log->capacity)) {
+        return;
     }
+    undo_entry* entry = &log->entries[count];
+    entry->off = off;
+    entry->len = len;
+    memcpy(entry->old, addr, len);
 
-    /* Link partitions */
-    dll_status status = dll_status_nok;
-    dll_node_insert_after(partition, new_buddy, &status);
-    if (dll_status_ok != status) {
-        return false;
+    /* The entry has to be complete before it is counted and counted before the metadata changes */
+    __atomic_store_n(&log->count, count + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/* Record old content of metadata in pools with an undo log */
+static inline void undo_record(const mempool_instance* pool, const void* addr, u32 len)
+{
+    if (UNLIKELY(0 != pool->log_off)) {
+        undo_record_slow(pool, addr, len);
     }
+}
 
-    /* Update headers */
-    hdr->size = new_len;
-    new_buddy_hdr->size = new_len;
-    new_buddy_hdr->active = false;
-#if MEMPOOL_SANITY_CHECK
-    new_buddy_hdr->magic = MAGIC_NUMBER;
-#endif
+/* Mark the operation in progress as complete. Metadata is consistent again */
+static inline void undo_commit(const mempool_instance* pool)
+{
+    if (UNLIKELY(0 != pool->log_off)) {
+        __atomic_store_n(&pool_log(pool)->count, 0, __ATOMIC_RELEASE);
+    }
+}
 
-    return true;
+/* Get header of a partition stored in mempool_hdr_ptr format */
+static inline room_header* ptr_hdr(const char* part)
+{
+    return (room_header*)(part + sizeof(dll_node));
 }
 
-/* Search for buddy partition */
-static dll_node* get_buddy(dll_node* partition, size part_size, buddy_pos buddy_pos)
+/* Convert 16-bit offset into partition address */
+static inline char* off16_to_part(const mempool_instance* pool, u16 off)
 {
-    dll_node* buddy = (buddy_pos_left == buddy_pos) ? dll_get_prev_node(partition) : dll_get_next_node(partition);
-    if (NULL != buddy) {
-        room_header* buddy_hdr = dll_get_user_data(buddy);
-        if (part_size == buddy_hdr->size) {
-            return buddy;
-        }
+    return (OFF16_NULL == off) ? NULL : pool_base(pool) + off;
+}
+
+/* Convert 32-bit offset into partition address */
+static inline char* off32_to_part(const mempool_instance* pool, u32 off)
+{
+    return (OFF32_NULL == off) ? NULL : pool_base(pool) + off;
+}
+
+/* Convert partition address into 16-bit offset */
+static inline u16 part_to_off16(const mempool_instance* pool, const char* part)
+{
+    return (NULL == part) ? OFF16_NULL : (u16)(part - pool_base(pool));
+}
+
+/* Convert partition address into 32-bit offset */
+static inline u32 part_to_off32(const mempool_instance* pool, const char* part)
+{
+    return (NULL == part) ? OFF32_NULL : (u32)(part - pool_base(pool));
+}
+
+/* Get partition's successor. NULL is returned for the last partition */
+static inline char* part_get_next(const mempool_instance* pool, const char* part)
+{
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            return off16_to_part(pool, ((const room_header_off16*)part)->next);
+        case mempool_hdr_off32:
+            return off32_to_part(pool, ((const room_header_off32*)part)->next);
+        default:
+            return (char*)dll_get_next_node((const dll_node*)part);
     }
-    return NULL;
 }
 
-static merge_status merge_partitions(dll_node** partition)
+/* Get partition's predecessor. NULL is returned for the first partition */
+static inline char* part_get_prev(const mempool_instance* pool, const char* part)
 {
-    room_header* hdr = dll_get_user_data(*partition);
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            return off16_to_part(pool, ((const room_header_off16*)part)->prev);
+        case mempool_hdr_off32:
+            return off32_to_part(pool, ((const room_header_off32*)part)->prev);
+        default:
+            return (char*)dll_get_prev_node((const dll_node*)part);
+    }
+}
 
-    dll_node* left = get_buddy(*partition, hdr->size, buddy_pos_left);
-    room_header* left_hdr;
+/* Set partition's successor */
+static inline void part_set_next(const mempool_instance* pool, char* part, const char* next)
+{
+    undo_record(pool, part, pool->hdr_size);
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            ((room_header_off16*)part)->next = part_to_off16(pool, next);
+            break;
+        case mempool_hdr_off32:
+            ((room_header_off32*)part)->next = part_to_off32(pool, next);
+            break;
+        default:
+            dll_set_next_node((dll_node*)part, (dll_node*)next);
+            break;
+    }
+}
 
-    if (NULL != left) {
-        /* There is a buddy on the left */
-        left_hdr = dll_get_user_data(left);
-        if (left_hdr->active) {
-            return merge_status_not_merged; /* Occupied - do nothing */
-        }
-    } else {
-        dll_node* tmp = get_buddy(*partition, hdr->size, buddy_pos_right);
-        if (NULL != tmp) {
-            /* There is a buddy on the right */
-            room_header* tmp_hdr = dll_get_user_data(tmp);
-            if (tmp_hdr->active) {
-                return merge_status_not_merged; /* Occupied - do nothing */
-            }
-            left = *partition;
-            left_hdr = hdr;
-        } else {
-            /* The partition does not have a buddy - do nothing */
-            return merge_status_not_merged;
-        }
+/* Set partition's predecessor */
+static inline void part_set_prev(const mempool_instance* pool, char* part, const char* prev)
+{
+    undo_record(pool, part, pool->hdr_size);
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            ((room_header_off16*)part)->prev = part_to_off16(pool, prev);
+            break;
+        case mempool_hdr_off32:
+            ((room_header_off32*)part)->prev = part_to_off32(pool, prev);
+            break;
+        default:
+            dll_set_prev_node((dll_node*)part, (dll_node*)prev);
+            break;
     }
+}
 
-    /* Merge partitions */
-    left_hdr->size *= 2;
-    dll_status stat;
-    dll_node_delete_after(left, &stat, NULL);
-    if (UNLIKELY(dll_status_ok != stat)) {
-        return merge_status_internal_err;
+/* Get the number of bytes requested by the claim an occupied partition serves. Links are used by free lists only, so
+ * occupied partitions keep the length in place of the predecessor. Zero is returned for claims that are not counted */
+static inline size part_get_claimed(const mempool_instance* pool, const char* part)
+{
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            return ((const room_header_off16*)part)->prev;
+        case mempool_hdr_off32:
+            return ((const room_header_off32*)part)->prev;
+        default:
+            return (size)(uintptr_t)((const dll_node*)part)->prev;
     }
+}
 
-    *partition = left;
-    return merge_status_merged;
+/* Store the number of bytes requested by the claim an occupied partition serves. It always fits the link - a claim
+ * never exceeds the pool, which link offsets cover */
+static inline void part_set_claimed(const mempool_instance* pool, char* part, size len)
+{
+    undo_record(pool, part, pool->hdr_size);
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            ((room_header_off16*)part)->prev = (u16)len;
+            break;
+        case mempool_hdr_off32:
+            ((room_header_off32*)part)->prev = (u32)len;
+            break;
+        default:
+            ((dll_node*)part)->prev = (dll_node*)(uintptr_t)len;
+            break;
+    }
 }
 
-#if MEMPOOL_SANITY_CHECK
-static inline bool partition_sanity_check(const room_header* hdr)
+/* Get size of a partition (header included) */
+static inline size part_get_size(const mempool_instance* pool, const char* part)
 {
-    return (MAGIC_NUMBER == hdr->magic);
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            return (size)1 << __atomic_load_n(&((const room_header_off16*)part)->order, __ATOMIC_RELAXED);
+        case mempool_hdr_off32:
+            return (size)1 << __atomic_load_n(&((const room_header_off32*)part)->order, __ATOMIC_RELAXED);
+        default:
+            return __atomic_load_n(&ptr_hdr(part)->size, __ATOMIC_RELAXED);
+    }
 }
-#endif
 
-/* ------------------------------------------------------------ */
-/* ----------------------- Public functions ------------------- */
-/* ------------------------------------------------------------ */
+/* Set size of a partition. The size has to be a power of two.
+ * Size and flags are accessed atomically - in thread-safe pools they are read while checking buddies that may be
+ * modified by other threads at the same time */
+static inline void part_set_size(const mempool_instance* pool, char* part, size part_size)
+{
+    undo_record(pool, part, pool->hdr_size);
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            __atomic_store_n(&((room_header_off16*)part)->order, (u8)BIT_64_CTZ(part_size), __ATOMIC_RELAXED);
+            break;
+        case mempool_hdr_off32:
+            __atomic_store_n(&((room_header_off32*)part)->order, (u8)BIT_64_CTZ(part_size), __ATOMIC_RELAXED);
+            break;
+        default:
+            __atomic_store_n(&ptr_hdr(part)->size, part_size, __ATOMIC_RELAXED);
+            break;
+    }
+}
 
-mempool_status mempool_init(mempool_instance* pool)
+/* Get partition flags */
+static inline u8 part_get_flags(const mempool_instance* pool, const char* part)
 {
-    ERROR_IF(pool, NULL, mempool_status_nullptr);
-    ERROR_IF(pool->base_addr, NULL, mempool_status_nullptr);
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            return __atomic_load_n(&((const room_header_off16*)part)->flags, __ATOMIC_RELAXED);
+        case mempool_hdr_off32:
+            return __atomic_load_n(&((const room_header_off32*)part)->flags, __ATOMIC_RELAXED);
+        default:
+            return __atomic_load_n(&ptr_hdr(part)->flags, __ATOMIC_RELAXED);
+    }
+}
 
-    /* Return error code when wrong size was passed */
-    ERROR_IF(is_power_of_two(pool->size), false, mempool_status_size_err);
+/* Set partition flags */
+static inline void part_set_flags(const mempool_instance* pool, char* part, u8 flags)
+{
+    undo_record(pool, part, pool->hdr_size);
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            __atomic_store_n(&((room_header_off16*)part)->flags, flags, __ATOMIC_RELAXED);
+            break;
+        case mempool_hdr_off32:
+            __atomic_store_n(&((room_header_off32*)part)->flags, flags, __ATOMIC_RELAXED);
+            break;
+        default:
+            __atomic_store_n(&ptr_hdr(part)->flags, flags, __ATOMIC_RELAXED);
+            break;
+    }
+}
 
-    /* Check if there is enough space to create first room */
-    if (UNLIKELY(pool->size <= mempool_calc_hdr_size())) {
-        return mempool_status_out_of_memory;
+/* Get id of the thread cache owning a block. Only pointer headers have room for it, see PTR_HDR_OWNER */
+static inline u8 part_get_owner(const mempool_instance* pool, const char* part)
+{
+#if PTR_HDR_OWNER
+    if (mempool_hdr_ptr == pool->hdr_type) {
+        return ptr_hdr(part)->owner;
     }
+#else
+    (void)part;
+#endif
+    (void)pool;
+    return 0;
+}
 
-    /* Allocate first room that occupies all available space */
-    dll_node* node = (dll_node*)pool->base_addr;
-    room_header* header = (room_header*)(pool->base_addr + sizeof(dll_node));
-    if (UNLIKELY(dll_status_ok != dll_node_create(node, header))) {
-        return mempool_status_nok;
+/* Set id of the thread cache owning a block */
+static inline void part_set_owner(const mempool_instance* pool, char* part, u8 owner)
+{
+#if PTR_HDR_OWNER
+    if (mempool_hdr_ptr == pool->hdr_type) {
+        ptr_hdr(part)->owner = owner;
     }
-    header->size = pool->size;
-    header->active = false;
+#else
+    (void)pool;
+    (void)part;
+    (void)owner;
+#endif
+}
+
+/* Check if a partition is occupied */
+static inline bool part_is_active(const mempool_instance* pool, const char* part)
+{
+    return BIT_32_IS_SET(part_get_flags(pool, part), PART_FLAG_ACTIVE);
+}
+
+/* Check if a partition is linked into a free list */
+static inline bool part_is_listed(const mempool_instance* pool, const char* part)
+{
+    return BIT_32_IS_SET(part_get_flags(pool, part), PART_FLAG_LISTED);
+}
+
+/* Check if a partition is kept in a lock-free cache */
+static inline bool part_is_cached(const mempool_instance* pool, const char* part)
+{
+    return BIT_32_IS_SET(part_get_flags(pool, part), PART_FLAG_CACHED);
+}
+
+/* Check if memory of a free partition was released */
+static inline bool part_is_released(const mempool_instance* pool, const char* part)
+{
+    return BIT_32_IS_SET(part_get_flags(pool, part), PART_FLAG_RELEASED);
+}
+
 #if MEMPOOL_SANITY_CHECK
-    header->magic = MAGIC_NUMBER;
+/* Get magic number stored inside partition's header */
+static inline u16 part_get_magic(const mempool_instance* pool, const char* part)
+{
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            return ((const room_header_off16*)part)->magic;
+        case mempool_hdr_off32:
+            return ((const room_header_off32*)part)->magic;
+        default:
+            return ptr_hdr(part)->magic;
+    }
+}
+
+/* Store magic number inside partition's header */
+static inline void part_set_magic(const mempool_instance* pool, char* part)
+{
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            ((room_header_off16*)part)->magic = MAGIC_NUMBER;
+            break;
+        case mempool_hdr_off32:
+            ((room_header_off32*)part)->magic = MAGIC_NUMBER;
+            break;
+        default:
+            ptr_hdr(part)->magic = MAGIC_NUMBER;
+            break;
+    }
+}
+
+static inline bool partition_sanity_check(const mempool_instance* pool, const char* part)
+{
+    return (MAGIC_NUMBER == part_get_magic(pool, part));
+}
 #endif
 
-    return mempool_status_ok;
+/* Get index of the region a partition belongs to */
+static inline u8 part_get_region(const mempool_instance* pool, const char* part)
+{
+    return (mempool_hdr_ptr == pool->hdr_type) ? ptr_hdr(part)->region : 0;
 }
 
-size mempool_calc_hdr_size()
+/* Get order of a partition (base-2 logarithm of its size) */
+static inline u32 part_get_order(const mempool_instance* pool, const char* part)
 {
-    return sizeof(dll_node) + sizeof(room_header);
+    switch (pool->hdr_type) {
+        case mempool_hdr_off16:
+            return __atomic_load_n(&((const room_header_off16*)part)->order, __ATOMIC_RELAXED);
+        case mempool_hdr_off32:
+            return __atomic_load_n(&((const room_header_off32*)part)->order, __ATOMIC_RELAXED);
+        default:
+            return BIT_64_CTZ(__atomic_load_n(&ptr_hdr(part)->size, __ATOMIC_RELAXED));
+    }
 }
 
-size mempool_partitions_used(const mempool_instance* pool)
+/* Get base address of a region */
+static inline char* region_base(const mempool_instance* pool, u8 region)
 {
-    ERROR_IF(pool, NULL, 0);
-    return dll_node_count((const dll_node*)pool->base_addr);
+    return (0 == region) ? pool_base(pool) : pool->regions[region - 1].base_addr;
 }
 
-size mempool_memory_used(const mempool_instance* pool)
+/* Get size of a region */
+static inline size region_size(const mempool_instance* pool, u8 region)
 {
-    ERROR_IF(pool, NULL, 0);
-    size mem_used = 0;
-    dll_traverse((const dll_node*)pool->base_addr, calc_mem_used_impl, &mem_used);
-    return mem_used;
+    return (0 == region) ? pool->size : pool->regions[region - 1].size;
 }
 
-size mempool_decode_debug_info(const mempool_instance* pool, mempool_debug_info* dbg_info)
+/* Convert free list head into partition address */
+static inline char* head_to_part(const mempool_instance* pool, uintptr_t head)
 {
-    ERROR_IF(pool, NULL, 0);
-    ERROR_IF(dbg_info, NULL, 0);
+    return (HEAD_NULL == head) ? NULL : (char*)((uintptr_t)pool_base(pool) + head);
+}
 
-    /* Struct instance passed as user data */
-    dbg_traverse_user_data dbg_user_data;
-    dbg_user_data.dbg_info = dbg_info;
-    dbg_user_data.next_idx = 0;
+/* Convert partition address into free list head. Works for partitions of all regions thanks to modular arithmetic */
+static inline uintptr_t part_to_head(const mempool_instance* pool, const char* part)
+{
+    return (uintptr_t)part - (uintptr_t)pool_base(pool);
+}
 
-    const dll_node* head = (const dll_node*)pool->base_addr;
-    dll_traverse(head, debug_traverse_imp, &dbg_user_data);
-    return dbg_user_data.next_idx;
+/* Make memory range accessible if the pool is backed by a commit function */
+static inline bool commit_range(const mempool_instance* pool, char* addr, size len)
+{
+    return (NULL == pool->commit_fn) || pool->commit_fn(pool->backing, addr, len);
 }
 
-mempool_status mempool_claim_memory(const mempool_instance* pool, size len, void** dst)
+/* Commit all memory touched while claiming 'order' partition out of a free 'part_order' one */
+static bool commit_claim(const mempool_instance* pool, char* part, u32 order, u32 part_order)
 {
-    ERROR_IF(pool, NULL, mempool_status_nullptr);
-    ERROR_IF(len, 0, mempool_status_size_err);
-    ERROR_IF(dst, NULL, mempool_status_nullptr);
+    if (!commit_range(pool, part, (size)1 << order)) {
+        return false;
+    }
+    /* Headers of buddies created by splits */
+    for (u32 buddy_order = order; buddy_order < part_order; ++buddy_order) {
+        if (!commit_range(pool, part + ((size)1 << buddy_order), pool->hdr_size)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    /* Round up the size if needed */
-    size total_len = round_pow_two(len + mempool_calc_hdr_size());
-    dll_node* lst = (dll_node*)pool->base_addr;
+/* Create a free partition that is not linked to any other one */
+static void create_partition(const mempool_instance* pool, char* part, size part_size, u8 region)
+{
+    if (mempool_hdr_ptr == pool->hdr_type) {
+        /* Node pointer cannot be NULL here, so the status does not have to be checked */
+        (void)dll_node_create((dll_node*)part, ptr_hdr(part));
+        ptr_hdr(part)->region = region;
+    } else {
+        part_set_next(pool, part, NULL);
+        part_set_prev(pool, part, NULL);
+    }
+    part_set_size(pool, part, part_size);
+    part_set_flags(pool, part, 0);
+    part_set_owner(pool, part, 0);
+#if MEMPOOL_SANITY_CHECK
+    part_set_magic(pool, part);
+#endif
+}
 
-    dll_node* partition = dll_node_find(lst, find_partition_impl, &total_len);
-    if (NULL == partition) {
-        return mempool_status_out_of_memory;
+/* Lock free list of an order. Pools that are not thread-safe do not use locks */
+static inline void order_lock(mempool_instance* pool, u32 order)
+{
+#if MEMPOOL_THREAD_SAFE
+    if (pool->thread_safe) {
+        if (UNLIKELY(pool->shared)) {
+            futex_lock_acquire_pshared(&pool_ext(pool)->order_locks[order]);
+        } else {
+            futex_lock_acquire(&pool_ext(pool)->order_locks[order]);
+        }
     }
-    room_header* hdr = dll_get_user_data(partition);
+#else
+    (void)pool;
+    (void)order;
+#endif
+}
 
-    /* Split partitions if needed */
-    while (hdr->size > total_len) {
-        if (!split_partition(partition)) {
-            return mempool_status_nok;
+/* Unlock free list of an order */
+static inline void order_unlock(mempool_instance* pool, u32 order)
+{
+#if MEMPOOL_THREAD_SAFE
+    if (pool->thread_safe) {
+        if (UNLIKELY(pool->shared)) {
+            futex_lock_release_pshared(&pool_ext(pool)->order_locks[order]);
+        } else {
+            futex_lock_release(&pool_ext(pool)->order_locks[order]);
         }
     }
+#else
+    (void)pool;
+    (void)order;
+#endif
+}
+
+/* Initialize locks of all free lists */
+static void order_locks_init(mempool_ext* ext)
+{
+#if MEMPOOL_THREAD_SAFE
+    for (u32 order = 0; order < MEMPOOL_ORDER_NUM; ++order) {
+        futex_lock_init(&ext->order_locks[order]);
+    }
+#else
+    (void)ext;
+#endif
+}
 
-    hdr->active = true;
-    *dst = (char*)partition + mempool_calc_hdr_size();
+/* Mark list of an order as non-empty. Bits of different orders are modified under different locks */
+static inline void free_map_set(mempool_instance* pool, u32 order)
+{
+    undo_record(pool, &pool->free_map, sizeof(pool->free_map));
+    if (pool->thread_safe) {
+        __atomic_fetch_or(&pool->free_map, BIT_64_GET_AT_POS(order), __ATOMIC_RELAXED);
+    } else {
+        BIT_64_SET(pool->free_map, order);
+    }
+}
 
-    return mempool_status_ok;
+/* Mark list of an order as empty */
+static inline void free_map_clr(mempool_instance* pool, u32 order)
+{
+    undo_record(pool, &pool->free_map, sizeof(pool->free_map));
+    if (pool->thread_safe) {
+        __atomic_fetch_and(&pool->free_map, BIT_64_NOT(BIT_64_GET_AT_POS(order)), __ATOMIC_RELAXED);
+    } else {
+        BIT_64_CLR(pool->free_map, order);
+    }
 }
 
-mempool_status mempool_free_memory(const mempool_instance* pool, void* memory)
+/* Add to a statistics counter. Claims do not hold any lock while counting, so thread-safe pools update it
+ * atomically */
+static inline void stat_add(const mempool_instance* pool, u64* counter, u64 delta)
 {
-    ERROR_IF(pool, NULL, mempool_status_nullptr);
-    ERROR_IF(memory, NULL, mempool_status_nullptr);
+    undo_record(pool, counter, sizeof(*counter));
+    if (pool->thread_safe) {
+        __atomic_fetch_add(counter, delta, __ATOMIC_RELAXED);
+    } else {
+        *counter += delta;
+    }
+}
 
-    dll_node* partition = (dll_node*)((char*)memory - mempool_calc_hdr_size());
-    room_header* hdr = dll_get_user_data(partition);
+/* Subtract from a statistics counter */
+static inline void stat_sub(const mempool_instance* pool, u64* counter, u64 delta)
+{
+    undo_record(pool, counter, sizeof(*counter));
+    if (pool->thread_safe) {
+        __atomic_fetch_sub(counter, delta, __ATOMIC_RELAXED);
+    } else {
+        *counter -= delta;
+    }
+}
 
-#ifdef MEMPOOL_SANITY_CHECK
-    ERROR_IF(partition_sanity_check(hdr), false, mempool_status_inv_memory);
-#endif
+/* Count a claim of 'len' bytes served by an occupied partition and remember its length for the free */
+static inline void claim_count(mempool_instance* pool, char* part, size len)
+{
+    part_set_claimed(pool, part, len);
+    stat_add(pool, &pool->requested_bytes, len);
+    stat_add(pool, &pool->granted_bytes, part_get_size(pool, part));
+}
 
-    /* Throw an error in case partition is not active */
-    ERROR_IF(hdr->active, false, mempool_status_inv_memory);
+/* Uncount a claim of 'len' bytes served by a partition of 'granted' bytes. Uncounted claims store zero length */
+static inline void claim_sub(mempool_instance* pool, size len, size granted)
+{
+    if (0 != len) {
+        stat_sub(pool, &pool->requested_bytes, len);
+        stat_sub(pool, &pool->granted_bytes, granted);
+    }
+}
 
-    /* Clear active flag to reuse the partition in the future */
-    hdr->active = false;
+/* Uncount the claim an occupied partition serves once it is given back */
+static inline void claim_uncount(mempool_instance* pool, char* part)
+{
+    claim_sub(pool, part_get_claimed(pool, part), part_get_size(pool, part));
+}
 
-    /* Merge partitions as long as possible */
-    merge_status merge_stat;
-    do {
-        merge_stat = merge_partitions(&partition);
-    } while (merge_status_merged == merge_stat);
-    ERROR_IF(merge_stat, merge_status_internal_err, mempool_status_nok);
+/* Count occupied partitions of an order. Claims and frees do not hold any lock while counting */
+static inline void used_count_add(mempool_instance* pool, u32 order, u32 count)
+{
+    undo_record(pool, &pool->used_counts[order], sizeof(pool->used_counts[order]));
+    if (pool->thread_safe) {
+        __atomic_fetch_add(&pool->used_counts[order], count, __ATOMIC_RELAXED);
+    } else {
+        pool->used_counts[order] += count;
+    }
+}
 
-    return mempool_status_ok;
+/* Uncount an occupied partition of an order */
+static inline void used_count_sub(mempool_instance* pool, u32 order)
+{
+    undo_record(pool, &pool->used_counts[order], sizeof(pool->used_counts[order]));
+    if (pool->thread_safe) {
+        __atomic_fetch_sub(&pool->used_counts[order], 1, __ATOMIC_RELAXED);
+    } else {
+        pool->used_counts[order]--;
+    }
+}
+
+/* Count a free partition of an order. The list of the order has to be locked */
+static inline void free_count_inc(mempool_instance* pool, u32 order)
+{
+    undo_record(pool, &pool->free_counts[order], sizeof(pool->free_counts[order]));
+    __atomic_store_n(&pool->free_counts[order], pool->free_counts[order] + 1, __ATOMIC_RELAXED);
+}
+
+/* Uncount a free partition of an order. The list of the order has to be locked */
+static inline void free_count_dec(mempool_instance* pool, u32 order)
+{
+    undo_record(pool, &pool->free_counts[order], sizeof(pool->free_counts[order]));
+    __atomic_store_n(&pool->free_counts[order], pool->free_counts[order] - 1, __ATOMIC_RELAXED);
+}
+
+/* Insert free partition at the beginning of the list of its order. The list has to be locked */
+static void free_list_push(mempool_instance* pool, char* part, u32 order)
+{
+    char* head = head_to_part(pool, pool->free_heads[order]);
+    part_set_prev(pool, part, NULL);
+    part_set_next(pool, part, head);
+    if (NULL != head) {
+        part_set_prev(pool, head, part);
+    }
+    undo_record(pool, &pool->free_heads[order], sizeof(pool->free_heads[order]));
+    pool->free_heads[order] = part_to_head(pool, part);
+    part_set_flags(pool, part, (u8)(part_get_flags(pool, part) | BIT_32_GET_AT_POS(PART_FLAG_LISTED)));
+    free_count_inc(pool, order);
+    free_map_set(pool, order);
+}
+
+/* Remove free partition from the list of its order. The list has to be locked */
+static void free_list_remove(mempool_instance* pool, char* part, u32 order)
+{
+    char* prev = part_get_prev(pool, part);
+    char* next = part_get_next(pool, part);
+    if (NULL != next) {
+        part_set_prev(pool, next, prev);
+    }
+    if (NULL != prev) {
+        part_set_next(pool, prev, next);
+    } else {
+        undo_record(pool, &pool->free_heads[order], sizeof(pool->free_heads[order]));
+        pool->free_heads[order] = (NULL == next) ? HEAD_NULL : part_to_head(pool, next);
+        if (NULL == next) {
+            free_map_clr(pool, order);
+        }
+    }
+    part_set_flags(pool, part, (u8)(part_get_flags(pool, part) & ~BIT_32_GET_AT_POS(PART_FLAG_LISTED)));
+    free_count_dec(pool, order);
+}
+
+/* Wake all threads sleeping on a futex word of a pool */
+static inline void pool_wake(const mempool_instance* pool, u32* word)
+{
+#if MEMPOOL_THREAD_SAFE
+    if (UNLIKELY(pool->shared)) {
+        futex_wake_pshared(word);
+    } else {
+        futex_wake(word);
+    }
+#else
+    (void)pool;
+    (void)word;
+#endif
+}
+
+/* Sleep on a futex word of a pool as long as it holds 'expected'. Only thread-safe pools may sleep */
+static inline void pool_wait(const mempool_instance* pool, u32* word, u32 expected, u64 timeout_ns)
+{
+#if MEMPOOL_THREAD_SAFE
+    if (UNLIKELY(pool->shared)) {
+        (void)futex_wait_pshared(word, expected, timeout_ns);
+    } else {
+        (void)futex_wait(word, expected, timeout_ns);
+    }
+#else
+    (void)pool;
+    (void)word;
+    (void)expected;
+    (void)timeout_ns;
+#endif
+}
+
+/* Wake threads waiting in mempool_claim_wait() for partitions up to 'order'. Called after a partition of the order
+ * became available */
+static void wake_waiters(mempool_instance* pool, u32 order)
+{
+    if (!pool->thread_safe) {
+        return;
+    }
+
+    /* Pairs with setting a bit in mempool_claim_wait() - either the waiter sees the new partition or its bit is
+     * seen here */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    mempool_ext* ext = pool_ext(pool);
+    u64 mask = (order >= MEMPOOL_ORDER_NUM - 1) ? UINT64_MAX : BIT_64_GET_AT_POS(order + 1) - 1;
+    u64 waiting = __atomic_load_n(&ext->wait_map, __ATOMIC_RELAXED) & mask;
+    if (LIKELY(0 == waiting)) {
+        return;
+    }
+
+    /* Woken threads set their bits again before going back to sleep */
+    __atomic_fetch_and(&ext->wait_map, ~waiting, __ATOMIC_SEQ_CST);
+    while (0 != waiting) {
+        u32 wait_order = BIT_64_CTZ(waiting);
+        BIT_64_CLR(waiting, wait_order);
+        __atomic_fetch_add(&ext->wait_seqs[wait_order], 1, __ATOMIC_SEQ_CST);
+        pool_wake(pool, &ext->wait_seqs[wait_order]);
+    }
+}
+
+/* Wake the maintenance thread if it sleeps. Called when a stock drops below its low watermark */
+static void maint_kick(mempool_instance* pool)
+{
+    mempool_ext* ext = pool_ext(pool);
+    if (0 != __atomic_load_n(&ext->maint_waiting, __ATOMIC_RELAXED) &&
+        0 != __atomic_exchange_n(&ext->maint_waiting, 0, __ATOMIC_SEQ_CST)) {
+        __atomic_fetch_add(&ext->maint_seq, 1, __ATOMIC_SEQ_CST);
+        pool_wake(pool, &ext->maint_seq);
+    }
+}
+
+/* Note that free partitions are about to be taken off their lists. Called under the lock of the first list, so
+ * a thread that finds the list empty sees the counter raised */
+static inline void detach_begin(mempool_instance* pool)
+{
+    if (pool->thread_safe) {
+        __atomic_fetch_add(&pool_ext(pool)->detached, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+/* Note that detached partitions are listed again, split or merged. The sequence is bumped before the counter drops,
+ * so a thread that sees no detached partitions also sees the bump */
+static void detach_end(mempool_instance* pool)
+{
+    if (!pool->thread_safe) {
+        return;
+    }
+    mempool_ext* ext = pool_ext(pool);
+    __atomic_fetch_add(&ext->detach_seq, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_sub(&ext->detached, 1, __ATOMIC_SEQ_CST);
+    if (0 != __atomic_load_n(&ext->detach_waiters, __ATOMIC_SEQ_CST)) {
+        pool_wake(pool, &ext->detach_seq);
+    }
+}
+
+/* Sleep until detached partitions are put back. Returns at once if it happened since 'seq' was read */
+static void detach_wait(mempool_instance* pool, u32 seq)
+{
+    mempool_ext* ext = pool_ext(pool);
+    __atomic_fetch_add(&ext->detach_waiters, 1, __ATOMIC_SEQ_CST);
+    pool_wait(pool, &ext->detach_seq, seq, MEMPOOL_WAIT_FOREVER);
+    __atomic_fetch_sub(&ext->detach_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Release memory of a free partition to the backing provider. Header stays untouched */
+static bool release_partition(const mempool_instance* pool, char* part)
+{
+    size part_size = part_get_size(pool, part);
+    if (!pool->release_fn(pool->backing, part + pool->hdr_size, part_size - pool->hdr_size)) {
+        return false;
+    }
+    part_set_flags(pool, part, (u8)(part_get_flags(pool, part) | BIT_32_GET_AT_POS(PART_FLAG_RELEASED)));
+    return true;
+}
+
+/* Write header of a direct mapping. Its size field holds the length of the whole mapping */
+static void direct_set_header(const mempool_instance* pool, char* part, size map_len)
+{
+    create_partition(pool, part, map_len, DIRECT_REGION);
+    part_set_flags(pool, part, (u8)(BIT_32_GET_AT_POS(PART_FLAG_ACTIVE) | BIT_32_GET_AT_POS(PART_FLAG_DIRECT)));
+}
+
+/* Serve a claim with a dedicated mapping. NULL is returned when the mapping cannot be created */
+static char* direct_claim(mempool_instance* pool, size len)
+{
+    void* part = NULL;
+    size map_len = len + pool->hdr_size;
+    if (UNLIKELY(mempool_status_ok != pool->direct_fn(pool->backing, &part, &map_len))) {
+        return NULL;
+    }
+    direct_set_header(pool, part, map_len);
+    return part;
+}
+
+/* Check if a memory range can be referenced by tagged cache heads */
+static inline bool tagged_range_valid(const char* addr, size len)
+{
+    u64 start = (u64)(uintptr_t)addr;
+    return start <= TAGGED_PTR_MASK && (u64)len - 1 <= TAGGED_PTR_MASK - start;
+}
+
+/* Build tagged cache head */
+static inline u64 tagged_pack(const char* part, u64 tag)
+{
+    return ((u64)(uintptr_t)part & TAGGED_PTR_MASK) | (tag << TAGGED_PTR_BITS);
+}
+
+/* Get block address stored in tagged cache head */
+static inline char* tagged_ptr(u64 head)
+{
+    return (char*)(uintptr_t)(head & TAGGED_PTR_MASK);
+}
+
+/* Get tag stored in tagged cache head */
+static inline u64 tagged_tag(u64 head)
+{
+    return head >> TAGGED_PTR_BITS;
+}
+
+/* Link to the next cached block. It is stored in the usable space, since headers of active partitions are in use */
+static inline char** cache_link(const mempool_instance* pool, char* part)
+{
+    return (char**)(part + pool->hdr_size);
+}
+
+/* Push an active partition onto the lock-free cache of its order */
+static void cache_push(mempool_instance* pool, char* part)
+{
+    u32 order = part_get_order(pool, part);
+    part_set_flags(pool, part, (u8)(part_get_flags(pool, part) | BIT_32_GET_AT_POS(PART_FLAG_CACHED)));
+
+    u64* cache_head = &pool_ext(pool)->cache_heads[order];
+    u64 old_head = __atomic_load_n(cache_head, __ATOMIC_RELAXED);
+    u64 new_head;
+    do {
+        __atomic_store_n(cache_link(pool, part), tagged_ptr(old_head), __ATOMIC_RELAXED);
+        new_head = tagged_pack(part, tagged_tag(old_head) + 1);
+    } while (!__atomic_compare_exchange_n(cache_head, &old_head, new_head, true, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+/* Pop a partition from the lock-free cache of an order. NULL is returned when the cache is empty */
+static char* cache_pop(mempool_instance* pool, u32 order)
+{
+    u64* cache_head = &pool_ext(pool)->cache_heads[order];
+    u64 old_head = __atomic_load_n(cache_head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        char* part = tagged_ptr(old_head);
+        if (NULL == part) {
+            return NULL;
+        }
+        /* The block may be taken and reused by another thread in the meantime. Pool memory stays mapped, so reading
+         * a stale link is harmless - the tag has changed then and the exchange fails */
+        char* next = __atomic_load_n(cache_link(pool, part), __ATOMIC_RELAXED);
+        u64 new_head = tagged_pack(next, tagged_tag(old_head) + 1);
+        if (__atomic_compare_exchange_n(cache_head, &old_head, new_head, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            part_set_flags(pool, part, (u8)(part_get_flags(pool, part) & ~BIT_32_GET_AT_POS(PART_FLAG_CACHED)));
+            return part;
+        }
+    }
+}
+
+/* Get address of buddy partition. The partition must not be a root of its region */
+static inline char* get_buddy(const mempool_instance* pool, const char* part, u32 order, u8 region)
+{
+    char* base = region_base(pool, region);
+    return base + ((size)(part - base) ^ ((size)1 << order));
+}
+
+/* Call user function for each partition of each region in address order */
+static void traverse_partitions(const mempool_instance* pool, part_traverse_fn traverse_fn, void* user_data)
+{
+    for (u8 region = 0; region < pool->region_cnt; ++region) {
+        const char* part = region_base(pool, region);
+        const char* end = part + region_size(pool, region);
+        while (part < end) {
+            const char* next = part + part_get_size(pool, part);
+            traverse_fn(pool, part, part == region_base(pool, region), next == end, user_data);
+            part = next;
+        }
+    }
+}
+
+/* Function used in mempool_decode_debug_info() to decode debug data */
+static void debug_traverse_imp(const mempool_instance* pool, const char* part, bool is_first, bool is_last,
+                               void* user_data)
+{
+    dbg_traverse_user_data* dbg_data = user_data;
+    mempool_debug_info* dbg_tbl_row = &dbg_data->dbg_info[dbg_data->next_idx++];
+    dbg_tbl_row->is_first = is_first;
+    dbg_tbl_row->is_last = is_last;
+    dbg_tbl_row->room_size = part_get_size(pool, part);
+    dbg_tbl_row->room_occupied = part_is_active(pool, part);
+    dbg_tbl_row->released = part_is_released(pool, part);
+    dbg_tbl_row->cached = part_is_cached(pool, part);
+    dbg_tbl_row->usable_size = dbg_tbl_row->room_size - pool->hdr_size;
+    dbg_tbl_row->base_addr = part;
+    dbg_tbl_row->usable_space_addr = part + pool->hdr_size;
+}
+
+/* Check if two memory ranges overlap */
+static inline bool ranges_overlap(const char* a, size a_len, const char* b, size b_len)
+{
+    return (a < b + b_len) && (b < a + a_len);
+}
+
+/* Length of a snapshot record holding 'len' bytes of data */
+static inline size snapshot_record_len(size len)
+{
+    return sizeof(snapshot_range) + ((len + sizeof(size) - 1) & ~(sizeof(size) - 1));
+}
+
+/* Close the range being collected. Its record is written only if it fits into the output buffer */
+static void snapshot_flush(const mempool_instance* pool, snapshot_user_data* snap)
+{
+    if (snap->start == snap->end) {
+        return;
+    }
+    size data_len = snap->end - snap->start;
+    size record_len = snapshot_record_len(data_len);
+    if (NULL != snap->out && snap->len + record_len <= snap->out_len) {
+        snapshot_range range = {snap->start, data_len};
+        memcpy(snap->out + snap->len, &range, sizeof(range));
+        memcpy(snap->out + snap->len + sizeof(range), pool_base(pool) + snap->start, data_len);
+    }
+    snap->len += record_len;
+    snap->range_cnt++;
+    snap->start = snap->end;
+}
+
+/* Implementation of function for collecting ranges of a snapshot. Occupied partitions are kept whole, free ones
+ * contribute only their headers unless their usable space is too short to be worth a gap */
+static void snapshot_traverse_impl(const mempool_instance* pool, const char* part, bool is_first, bool is_last,
+                                   void* user_data)
+{
+    (void)is_first;
+    snapshot_user_data* snap = user_data;
+    size off = (size)(part - pool_base(pool));
+    size part_size = part_get_size(pool, part);
+    size keep = part_size;
+    if (!part_is_active(pool, part) && part_size - pool->hdr_size >= SNAPSHOT_GAP_MIN) {
+        keep = pool->hdr_size;
+    }
+    if (off != snap->end) {
+        snapshot_flush(pool, snap);
+        snap->start = off;
+    }
+    snap->end = off + keep;
+    if (is_last) {
+        snapshot_flush(pool, snap);
+    }
+}
+
+/* Reset extended state of a newly created pool */
+static void ext_init(mempool_ext* ext)
+{
+    order_locks_init(ext);
+    ext->detached = 0;
+    ext->detach_seq = 0;
+    ext->detach_waiters = 0;
+    ext->maint_waiting = 0;
+    ext->maint_seq = 0;
+    for (u32 order = 0; order < MEMPOOL_ORDER_NUM; ++order) {
+        ext->cache_heads[order] = tagged_pack(NULL, 0);
+        ext->wait_seqs[order] = 0;
+        ext->low_marks[order] = 0;
+    }
+    for (u32 order = 0; order < MEMPOOL_TCACHE_ORDERS; ++order) {
+        ext->depot_heads[order] = NULL;
+    }
+    for (u32 id = 0; id < MEMPOOL_TCACHE_OWNERS_MAX; ++id) {
+        ext->owners[id] = NULL;
+    }
+    ext->wait_map = 0;
+    ext->stock_map = 0;
+}
+
+/* Get length of the pool state copied into a snapshot. The extended state follows the instance */
+static inline size snapshot_state_len(const mempool_instance* pool)
+{
+    return sizeof(mempool_instance) + ((0 != pool->ext_off) ? sizeof(mempool_ext) : 0);
+}
+
+/* Check if a pool may be snapshotted. Memory outside of the base region and memory which may be given back to the
+ * system would not be restored correctly */
+static mempool_status snapshot_supported(const mempool_instance* pool)
+{
+    if (NULL != pool->commit_fn || NULL != pool->release_fn || NULL != pool->direct_fn || pool->region_cnt > 1 ||
+        0 != pool->log_off) {
+        return mempool_status_not_supported;
+    }
+    return mempool_status_ok;
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+void mempool_default_config(mempool_config* config)
+{
+    if (LIKELY(NULL != config)) {
+        config->hdr_type = mempool_hdr_ptr;
+        config->commit_fn = NULL;
+        config->release_fn = NULL;
+        config->direct_fn = NULL;
+        config->backing = NULL;
+        config->thread_safe = false;
+        config->lock_free = false;
+        config->shared = false;
+        config->undo_log = NULL;
+        config->undo_log_len = 0;
+        config->ext = NULL;
+    }
+}
+
+mempool_status mempool_init_ex(mempool_instance* pool, const mempool_config* config)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(config, NULL, mempool_status_nullptr);
+    ERROR_IF(pool->base_addr, NULL, mempool_status_nullptr);
+
+    /* Return error code when wrong size was passed */
+    ERROR_IF(is_power_of_two(pool->size), false, mempool_status_size_err);
+
+    /* Offsets stored in compact headers have to be able to address the whole buffer */
+    u64 max_size;
+    switch (config->hdr_type) {
+        case mempool_hdr_ptr:
+            max_size = UINT64_MAX;
+            break;
+        case mempool_hdr_off16:
+            max_size = (u64)1 << 16;
+            break;
+        case mempool_hdr_off32:
+            max_size = (u64)1 << 32;
+            break;
+        default:
+            return mempool_status_nok;
+    }
+    ERROR_IF((u64)pool->size > max_size, true, mempool_status_size_err);
+
+    /* Links, caches and callbacks of shared pools must not depend on the address space of a process */
+    if (config->shared && (mempool_hdr_ptr == config->hdr_type || config->lock_free || NULL != config->commit_fn ||
+                           NULL != config->release_fn || NULL != config->direct_fn)) {
+        return mempool_status_not_supported;
+    }
+
+    /* Locks and futex waits are left out of the build */
+#if !MEMPOOL_THREAD_SAFE
+    if (config->thread_safe || config->lock_free) {
+        return mempool_status_not_supported;
+    }
+#endif
+
+    /* Locks and caches of thread-safe pools live in the extended state */
+    if ((config->thread_safe || config->lock_free) && NULL == config->ext) {
+        return mempool_status_not_supported;
+    }
+
+    /* Tagged cache heads hold 48-bit addresses */
+    if (config->lock_free && !tagged_range_valid(pool->base_addr, pool->size)) {
+        return mempool_status_not_supported;
+    }
+
+    /* A single undo log covers one operation at a time */
+    if (NULL != config->undo_log) {
+        ERROR_IF(config->shared && !config->thread_safe && !config->lock_free, false, mempool_status_not_supported);
+        ERROR_IF(config->undo_log_len < mempool_calc_undo_log_size(), true, mempool_status_size_err);
+    }
+
+    pool->hdr_type = config->hdr_type;
+    pool->hdr_size = (u16)mempool_calc_hdr_size_ex(config->hdr_type);
+    pool->commit_fn = config->commit_fn;
+    pool->release_fn = config->release_fn;
+    pool->direct_fn = config->direct_fn;
+    pool->backing = config->backing;
+    pool->trim_threshold = 0;
+    pool->direct_threshold = 0;
+    pool->thread_safe = config->thread_safe || config->lock_free;
+    pool->lock_free = config->lock_free;
+    pool->shared = config->shared;
+    pool->base_off = config->shared ? (uintptr_t)pool->base_addr - (uintptr_t)pool : 0;
+    pool->log_off = 0;
+    for (u32 order = 0; order < MEMPOOL_ORDER_NUM; ++order) {
+        pool->free_counts[order] = 0;
+        pool->used_counts[order] = 0;
+    }
+    pool->ext_off = 0;
+    if (NULL != config->ext) {
+        ext_init(config->ext);
+        pool->ext_off = (uintptr_t)config->ext - (uintptr_t)pool;
+    }
+
+    /* Check if there is enough space to create first room */
+    if (UNLIKELY(pool->size <= pool->hdr_size)) {
+        return mempool_status_out_of_memory;
+    }
+    ERROR_IF(commit_range(pool, pool->base_addr, pool->hdr_size), false, mempool_status_out_of_memory);
+
+    pool->region_cnt = 1;
+    pool->free_map = 0;
+    for (u32 order = 0; order < MEMPOOL_ORDER_NUM; ++order) {
+        pool->free_heads[order] = HEAD_NULL;
+    }
+
+    pool->requested_bytes = 0;
+    pool->granted_bytes = 0;
+
+    /* Allocate first room that occupies all available space */
+    create_partition(pool, pool->base_addr, pool->size, 0);
+    free_list_push(pool, pool->base_addr, BIT_64_CTZ(pool->size));
+
+    /* Logging starts with a complete pool. The magic is written last, so a pool whose creation was interrupted is
+     * recognized as invalid */
+    if (NULL != config->undo_log) {
+        undo_log* log = config->undo_log;
+        log->count = 0;
+        log->capacity = (u32)((config->undo_log_len - sizeof(undo_log)) / sizeof(undo_entry));
+        pool->log_off = (uintptr_t)log - (uintptr_t)pool;
+        __atomic_store_n(&log->magic, UNDO_LOG_MAGIC, __ATOMIC_RELEASE);
+    }
+    return mempool_status_ok;
+}
+
+mempool_status mempool_init(mempool_instance* pool)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    return mempool_init_ex(pool, &config);
+}
+
+mempool_status mempool_add_region(mempool_instance* pool, void* buf, size len)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(buf, NULL, mempool_status_nullptr);
+    ERROR_IF(is_power_of_two(len), false, mempool_status_size_err);
+    if (UNLIKELY(len <= pool->hdr_size)) {
+        return mempool_status_out_of_memory;
+    }
+
+    /* Compact headers address partitions relatively to base_addr only */
+    ERROR_IF(pool->hdr_type, mempool_hdr_off16, mempool_status_not_supported);
+    ERROR_IF(pool->hdr_type, mempool_hdr_off32, mempool_status_not_supported);
+    ERROR_IF(pool->region_cnt, MEMPOOL_REGIONS_MAX, mempool_status_nok);
+    if (pool->lock_free && !tagged_range_valid(buf, len)) {
+        return mempool_status_not_supported;
+    }
+
+    for (u8 region = 0; region < pool->region_cnt; ++region) {
+        if (UNLIKELY(ranges_overlap(buf, len, region_base(pool, region), region_size(pool, region)))) {
+            return mempool_status_inv_memory;
+        }
+    }
+
+    ERROR_IF(commit_range(pool, buf, pool->hdr_size), false, mempool_status_out_of_memory);
+
+    u8 region = (u8)pool->region_cnt++;
+    pool->regions[region - 1].base_addr = buf;
+    pool->regions[region - 1].size = len;
+
+    create_partition(pool, buf, len, region);
+    free_list_push(pool, buf, BIT_64_CTZ(len));
+    return mempool_status_ok;
+}
+
+char* mempool_base_addr(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, NULL);
+    return pool_base(pool);
+}
+
+mempool_ext* mempool_ext_addr(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, NULL);
+    return pool_ext(pool);
+}
+
+size mempool_calc_hdr_size()
+{
+    return mempool_calc_hdr_size_ex(mempool_hdr_ptr);
+}
+
+size mempool_calc_hdr_size_ex(mempool_hdr_type hdr_type)
+{
+    switch (hdr_type) {
+        case mempool_hdr_ptr:
+            return sizeof(dll_node) + sizeof(room_header);
+        case mempool_hdr_off16:
+            return sizeof(room_header_off16);
+        case mempool_hdr_off32:
+            return sizeof(room_header_off32);
+        default:
+            return 0;
+    }
+}
+
+size mempool_calc_undo_log_size()
+{
+    return sizeof(undo_log) + UNDO_LOG_ENTRIES * sizeof(undo_entry);
+}
+
+mempool_status mempool_recover(mempool_instance* pool, size* undone)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+
+    /* Locks and waiters of processes that died while using the pool are gone */
+    mempool_ext* ext = pool_ext(pool);
+    if (NULL != ext) {
+        order_locks_init(ext);
+        ext->wait_map = 0;
+        ext->maint_waiting = 0;
+        ext->detached = 0;
+        ext->detach_waiters = 0;
+    }
+
+    size entries = 0;
+    if (0 != pool->log_off) {
+        undo_log* log = pool_log(pool);
+        entries = log->count;
+        if (UNLIKELY(UNDO_LOG_MAGIC != log->magic || entries > log->capacity)) {
+            return mempool_status_inv_memory;
+        }
+
+        /* Entries are applied newest first, so each range ends up with its content from before the operation */
+        for (size i = entries; i-- > 0;) {
+            const undo_entry* entry = &log->entries[i];
+            memcpy((char*)pool + entry->off, entry->old, entry->len);
+        }
+        log->count = 0;
+    }
+    if (NULL != undone) {
+        *undone = entries;
+    }
+    return mempool_status_ok;
+}
+
+size mempool_calc_snapshot_size(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, 0);
+    ERROR_IF(snapshot_supported(pool), mempool_status_not_supported, 0);
+    snapshot_user_data snap = {NULL, 0, sizeof(snapshot_hdr) + snapshot_state_len(pool), 0, 0, 0};
+    traverse_partitions(pool, snapshot_traverse_impl, &snap);
+    return snap.len;
+}
+
+mempool_status mempool_snapshot(const mempool_instance* pool, void* buf, size buf_len, size* snap_len)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(buf, NULL, mempool_status_nullptr);
+    mempool_status status = snapshot_supported(pool);
+    ERROR_IF(status, mempool_status_not_supported, status);
+
+    snapshot_user_data snap = {buf, buf_len, sizeof(snapshot_hdr) + snapshot_state_len(pool), 0, 0, 0};
+    if (snap.len <= buf_len) {
+        memcpy((char*)buf + sizeof(snapshot_hdr), pool, sizeof(mempool_instance));
+        if (0 != pool->ext_off) {
+            memcpy((char*)buf + sizeof(snapshot_hdr) + sizeof(mempool_instance), pool_ext(pool), sizeof(mempool_ext));
+        }
+    }
+    traverse_partitions(pool, snapshot_traverse_impl, &snap);
+    if (NULL != snap_len) {
+        *snap_len = snap.len;
+    }
+    ERROR_IF(snap.len > buf_len, true, mempool_status_size_err);
+
+    snapshot_hdr hdr = {SNAPSHOT_MAGIC, 0, snap.len, snap.range_cnt};
+    memcpy(buf, &hdr, sizeof(hdr));
+    return mempool_status_ok;
+}
+
+mempool_status mempool_restore(mempool_instance* pool, const void* buf)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(buf, NULL, mempool_status_nullptr);
+    mempool_status status = snapshot_supported(pool);
+    ERROR_IF(status, mempool_status_not_supported, status);
+
+    snapshot_hdr hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (UNLIKELY(SNAPSHOT_MAGIC != hdr.magic)) {
+        return mempool_status_inv_memory;
+    }
+    const mempool_instance* copy = (const mempool_instance*)((const char*)buf + sizeof(hdr));
+
+    /* The snapshot has to be taken of the same buffer. Shared pools are compared by layout, since each process maps
+     * the buffer at its own address */
+    bool same_buf = copy->size == pool->size && copy->shared == pool->shared &&
+                    (pool->shared ? copy->base_off == pool->base_off : copy->base_addr == pool->base_addr);
+    ERROR_IF(same_buf, false, mempool_status_inv_memory);
+    bool same_state = (0 == copy->ext_off) == (0 == pool->ext_off);
+    ERROR_IF(same_state, false, mempool_status_inv_memory);
+
+    const char* record = (const char*)copy + snapshot_state_len(copy);
+    char* base = pool_base(pool);
+    for (size i = 0; i < hdr.range_cnt; ++i) {
+        snapshot_range range;
+        memcpy(&range, record, sizeof(range));
+        memcpy(base + range.off, record + sizeof(range), range.len);
+        record += snapshot_record_len(range.len);
+    }
+
+    /* Locks, futex words of sleeping threads and thread cache registrations belong to the threads using the pool
+     * rather than to its state */
+    uintptr_t ext_off = pool->ext_off;
+    memcpy(pool, copy, sizeof(mempool_instance));
+    pool->ext_off = ext_off;
+    mempool_ext* ext = pool_ext(pool);
+    if (NULL != ext) {
+        mempool_ext live;
+        memcpy(&live, ext, sizeof(live));
+        memcpy(ext, (const char*)copy + sizeof(mempool_instance), sizeof(mempool_ext));
+#if MEMPOOL_THREAD_SAFE
+        memcpy(ext->order_locks, live.order_locks, sizeof(live.order_locks));
+#endif
+        ext->detached = live.detached;
+        ext->detach_seq = live.detach_seq;
+        ext->detach_waiters = live.detach_waiters;
+        memcpy(ext->owners, live.owners, sizeof(live.owners));
+        ext->wait_map = live.wait_map;
+        memcpy(ext->wait_seqs, live.wait_seqs, sizeof(live.wait_seqs));
+        ext->maint_waiting = live.maint_waiting;
+        ext->maint_seq = live.maint_seq;
+    }
+
+    /* Threads waiting for memory have to check the restored pool */
+    wake_waiters(pool, MEMPOOL_ORDER_NUM - 1);
+    return mempool_status_ok;
+}
+
+size mempool_partitions_used(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, 0);
+    size partitions = 0;
+    for (u32 order = 0; order < MEMPOOL_ORDER_NUM; ++order) {
+        partitions += __atomic_load_n(&pool->free_counts[order], __ATOMIC_RELAXED);
+        partitions += __atomic_load_n(&pool->used_counts[order], __ATOMIC_RELAXED);
+    }
+    return partitions;
+}
+
+size mempool_memory_used(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, 0);
+
+    /* Occupied partitions are used whole, free ones only by their headers. Free partitions are the listed ones */
+    size total = 0;
+    for (u8 region = 0; region < pool->region_cnt; ++region) {
+        total += region_size(pool, region);
+    }
+    size free_bytes = 0;
+    u64 orders = __atomic_load_n(&pool->free_map, __ATOMIC_RELAXED);
+    while (0 != orders) {
+        u32 order = BIT_64_CTZ(orders);
+        BIT_64_CLR(orders, order);
+        size count = __atomic_load_n(&pool->free_counts[order], __ATOMIC_RELAXED);
+        free_bytes += count * (((size)1 << order) - pool->hdr_size);
+    }
+    return total - free_bytes;
+}
+
+size mempool_memory_requested(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, 0);
+    return (size)__atomic_load_n(&pool->requested_bytes, __ATOMIC_RELAXED);
+}
+
+size mempool_memory_granted(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, 0);
+    return (size)__atomic_load_n(&pool->granted_bytes, __ATOMIC_RELAXED);
+}
+
+mempool_status mempool_get_stats(const mempool_instance* pool, mempool_stats* stats)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(stats, NULL, mempool_status_nullptr);
+
+    stats->free_bytes = 0;
+    for (u32 order = 0; order < MEMPOOL_ORDER_NUM; ++order) {
+        stats->free_counts[order] = __atomic_load_n(&pool->free_counts[order], __ATOMIC_RELAXED);
+        stats->used_counts[order] = __atomic_load_n(&pool->used_counts[order], __ATOMIC_RELAXED);
+        stats->free_bytes += (size)stats->free_counts[order] << order;
+    }
+    u64 free_map = __atomic_load_n(&pool->free_map, __ATOMIC_RELAXED);
+    stats->largest_free = (0 == free_map) ? 0 : (size)1 << BIT_64_LOG2_FLOOR(free_map);
+
+    /* Huge pools would overflow the multiplication, they lose precision below a per mille only. The map may be ahead
+     * of the counters while other threads free memory */
+    u64 outside = (stats->largest_free < stats->free_bytes) ? (u64)(stats->free_bytes - stats->largest_free) : 0;
+    u64 total = (u64)stats->free_bytes;
+    if (outside <= UINT64_MAX / 1000) {
+        stats->fragmentation = (0 == total) ? 0 : (u32)(outside * 1000 / total);
+    } else {
+        stats->fragmentation = (u32)(outside / (total / 1000));
+    }
+    stats->requested_bytes = mempool_memory_requested(pool);
+    stats->granted_bytes = mempool_memory_granted(pool);
+    return mempool_status_ok;
+}
+
+size mempool_decode_debug_info(const mempool_instance* pool, mempool_debug_info* dbg_info)
+{
+    ERROR_IF(pool, NULL, 0);
+    ERROR_IF(dbg_info, NULL, 0);
+
+    /* Struct instance passed as user data */
+    dbg_traverse_user_data dbg_user_data;
+    dbg_user_data.dbg_info = dbg_info;
+    dbg_user_data.next_idx = 0;
+
+    traverse_partitions(pool, debug_traverse_imp, &dbg_user_data);
+    return dbg_user_data.next_idx;
+}
+
+/* Get the map of orders with a low watermark. Pools without extended state keep no stocks */
+static inline u64 stock_map_get(const mempool_instance* pool)
+{
+    const mempool_ext* ext = pool_ext(pool);
+    return (NULL == ext) ? 0 : __atomic_load_n(&ext->stock_map, __ATOMIC_RELAXED);
+}
+
+/* Check if the stock of an order is below its low watermark */
+static inline bool stock_low(const mempool_instance* pool, u32 order)
+{
+    const mempool_ext* ext = pool_ext(pool);
+    return NULL != ext && __atomic_load_n(&pool->free_counts[order], __ATOMIC_RELAXED) <
+                              __atomic_load_n(&ext->low_marks[order], __ATOMIC_RELAXED);
+}
+
+/* Check if free partitions of an order should not be merged, since their stock is at or below its low watermark */
+static inline bool stock_needed(const mempool_instance* pool, u32 order)
+{
+    const mempool_ext* ext = pool_ext(pool);
+    if (NULL == ext) {
+        return false;
+    }
+    u32 low_mark = __atomic_load_n(&ext->low_marks[order], __ATOMIC_RELAXED);
+    return UNLIKELY(0 != low_mark) && __atomic_load_n(&pool->free_counts[order], __ATOMIC_RELAXED) <= low_mark;
+}
+
+/* Return a partition which is not listed to the buddy tree and merge it with free buddies */
+static void merge_partition(mempool_instance* pool, char* partition)
+{
+    /* Clear active flag to reuse the partition in the future */
+    part_set_flags(pool, partition, 0);
+
+    /* Merge with free buddies as long as possible. Root partition of a region does not have a buddy.
+     * Each step holds only the lock of the current order. The final check and push are done under the same lock, so
+     * when a buddy is freed concurrently one of the threads always sees the other partition listed */
+    u8 region = part_get_region(pool, partition);
+    u32 order = part_get_order(pool, partition);
+    u32 root_order = BIT_64_CTZ(region_size(pool, region));
+    bool detached = false;
+    for (;;) {
+        order_lock(pool, order);
+        if (order < root_order) {
+            char* buddy = get_buddy(pool, partition, order, region);
+            if (part_is_listed(pool, buddy) && part_get_order(pool, buddy) == order && !stock_needed(pool, order)) {
+                if (!detached) {
+                    detach_begin(pool);
+                    detached = true;
+                }
+                free_list_remove(pool, buddy, order);
+                order_unlock(pool, order);
+                partition = (buddy < partition) ? buddy : partition;
+                order++;
+                continue;
+            }
+        }
+
+        /* Merged partition always contains memory of the freed one, so it is never marked as released */
+        part_set_size(pool, partition, (size)1 << order);
+        part_set_flags(pool, partition, 0);
+        free_list_push(pool, partition, order);
+
+        /* Return large free partitions to the backing provider right away if requested */
+        if (0 != pool->trim_threshold && NULL != pool->release_fn && ((size)1 << order) >= pool->trim_threshold) {
+            (void)release_partition(pool, partition);
+        }
+        order_unlock(pool, order);
+        undo_commit(pool);
+        if (detached) {
+            detach_end(pool);
+        }
+        wake_waiters(pool, order);
+        return;
+    }
+}
+
+/* Merge partitions freed together with free buddies. Partitions waiting for an order are linked through the free list
+ * links of their headers, bit N of 'pending_map' is set when order N has any. Each order is locked once - partitions merged there wait
+ * for the next order, which is visited later. Partitions freed together merge with each other as well, since the
+ * first of two buddies is listed before the second one is checked */
+static void merge_batch(mempool_instance* pool, char** pending, u64 pending_map)
+{
+    detach_begin(pool);
+    u32 top_order = 0;
+    while (0 != pending_map) {
+        u32 order = BIT_64_CTZ(pending_map);
+        BIT_64_CLR(pending_map, order);
+        top_order = order;
+        order_lock(pool, order);
+        for (char* partition = pending[order]; NULL != partition;) {
+            char* next = part_get_next(pool, partition);
+            u8 region = part_get_region(pool, partition);
+            if (order < BIT_64_CTZ(region_size(pool, region))) {
+                char* buddy = get_buddy(pool, partition, order, region);
+                if (part_is_listed(pool, buddy) && part_get_order(pool, buddy) == order && !stock_needed(pool, order)) {
+                    free_list_remove(pool, buddy, order);
+                    char* merged = (buddy < partition) ? buddy : partition;
+                    part_set_next(pool, merged, pending[order + 1]);
+                    pending[order + 1] = merged;
+                    BIT_64_SET(pending_map, order + 1);
+                    partition = next;
+                    continue;
+                }
+            }
+
+            part_set_size(pool, partition, (size)1 << order);
+            part_set_flags(pool, partition, 0);
+            free_list_push(pool, partition, order);
+            if (0 != pool->trim_threshold && NULL != pool->release_fn && ((size)1 << order) >= pool->trim_threshold) {
+                (void)release_partition(pool, partition);
+            }
+            partition = next;
+        }
+        order_unlock(pool, order);
+    }
+    detach_end(pool);
+    wake_waiters(pool, top_order);
+}
+
+/* Return an active partition to the buddy tree and merge it with free buddies */
+static void free_partition(mempool_instance* pool, char* partition)
+{
+    used_count_sub(pool, part_get_order(pool, partition));
+    merge_partition(pool, partition);
+}
+
+/* Remove the smallest free partition of at least 'order' from its free list. NULL is returned when there is none.
+ * In thread-safe pools a partition found is detached - detach_end() has to be called once it is split or put back */
+static char* take_free_partition(mempool_instance* pool, u32 order, u32* part_order)
+{
+    mempool_ext* ext = pool_ext(pool);
+    for (;;) {
+        /* In thread-safe pools the map is only a hint - a list may become empty before its lock is taken, so the next
+         * candidate is tried then */
+        u32 seq = pool->thread_safe ? __atomic_load_n(&ext->detach_seq, __ATOMIC_SEQ_CST) : 0;
+        u64 candidates = __atomic_load_n(&pool->free_map, __ATOMIC_RELAXED) & BIT_64_NOT(BIT_64_GET_AT_POS(order) - 1);
+        char* partition = NULL;
+        while (NULL == partition && 0 != candidates) {
+            *part_order = BIT_64_CTZ(candidates);
+            BIT_64_CLR(candidates, *part_order);
+            order_lock(pool, *part_order);
+            partition = head_to_part(pool, pool->free_heads[*part_order]);
+            if (NULL != partition) {
+                detach_begin(pool);
+                free_list_remove(pool, partition, *part_order);
+            }
+            order_unlock(pool, *part_order);
+        }
+        if (NULL != partition || !pool->thread_safe) {
+            return partition;
+        }
+
+        /* Other threads may hold partitions taken off the lists which come back split or merged, possibly into lists
+         * already scanned. The pool is out of memory only if none was held and none came back during the scan */
+        if (0 == __atomic_load_n(&ext->detached, __ATOMIC_SEQ_CST) &&
+            seq == __atomic_load_n(&ext->detach_seq, __ATOMIC_SEQ_CST)) {
+            return NULL;
+        }
+        detach_wait(pool, seq);
+    }
+}
+
+/* Merge pairs of free buddies left behind by mempool_replenish(). The number of merged pairs is returned */
+static size coalesce_stocks(mempool_instance* pool)
+{
+    size merged = 0;
+    for (u32 order = 0; order < MEMPOOL_ORDER_NUM - 1; ++order) {
+        char* pair = NULL;
+        do {
+            pair = NULL;
+            order_lock(pool, order);
+            char* part = head_to_part(pool, pool->free_heads[order]);
+            for (; NULL != part && NULL == pair; part = part_get_next(pool, part)) {
+                u8 region = part_get_region(pool, part);
+                if (order >= BIT_64_CTZ(region_size(pool, region))) {
+                    continue;
+                }
+                char* buddy = get_buddy(pool, part, order, region);
+                if (part_is_listed(pool, buddy) && part_get_order(pool, buddy) == order) {
+                    detach_begin(pool);
+                    free_list_remove(pool, part, order);
+                    free_list_remove(pool, buddy, order);
+                    pair = (buddy < part) ? buddy : part;
+                }
+            }
+            order_unlock(pool, order);
+
+            /* The merged partition may have a free buddy as well */
+            if (NULL != pair) {
+                part_set_size(pool, pair, (size)1 << (order + 1));
+                merge_partition(pool, pair);
+                detach_end(pool);
+                merged++;
+            }
+        } while (NULL != pair);
+    }
+    return merged;
+}
+
+/* Split a partition taken off its free list down to 'order'. The left half is kept while the right one becomes free.
+ * Buddies carved out of a released partition are released as well. Only one lock is held at a time, so splits cannot
+ * deadlock. Flags of the original partition are returned */
+static u8 split_partition(mempool_instance* pool, char* partition, u32 part_order, u32 order)
+{
+    u8 flags = part_get_flags(pool, partition);
+    u8 region = part_get_region(pool, partition);
+    while (part_order > order) {
+        part_order--;
+        char* buddy = partition + ((size)1 << part_order);
+        create_partition(pool, buddy, (size)1 << part_order, region);
+        part_set_flags(pool, buddy, flags);
+        order_lock(pool, part_order);
+        free_list_push(pool, buddy, part_order);
+        order_unlock(pool, part_order);
+    }
+    part_set_size(pool, partition, (size)1 << order);
+    return flags;
+}
+
+/* Claim partition that fits 'len' bytes. The function stores whether partition memory reads as zeros in 'zeroed' */
+static mempool_status claim_partition(mempool_instance* pool, size len, char** part_out, bool* zeroed)
+{
+    /* Requests that cannot be represented are treated as too large */
+    if (UNLIKELY(len > (size)-1 - pool->hdr_size)) {
+        return mempool_status_out_of_memory;
+    }
+
+    /* Fresh anonymous mappings read as zeros */
+    if (0 != pool->direct_threshold && len >= pool->direct_threshold) {
+        char* part = direct_claim(pool, len);
+        if (NULL != part) {
+            claim_count(pool, part, len);
+            *zeroed = true;
+            *part_out = part;
+            return mempool_status_ok;
+        }
+    }
+
+    u32 order = BIT_64_LOG2_CEIL(len + pool->hdr_size);
+    if (UNLIKELY(order >= MEMPOOL_ORDER_NUM)) {
+        return mempool_status_out_of_memory;
+    }
+
+    /* Blocks of the exact order cached by lock-free frees are reused without taking any lock */
+    if (pool->lock_free) {
+        char* cached = cache_pop(pool, order);
+        if (NULL != cached) {
+            claim_count(pool, cached, len);
+            *zeroed = false;
+            *part_out = cached;
+            return mempool_status_ok;
+        }
+    }
+
+    u32 part_order;
+    char* partition = take_free_partition(pool, order, &part_order);
+
+    /* Cached blocks, magazines and stocks split in advance may merge into a large enough partition */
+    if (NULL == partition && 0 != mempool_drain_cache(pool) + (0 != stock_map_get(pool) ? coalesce_stocks(pool) : 0)) {
+        partition = take_free_partition(pool, order, &part_order);
+    }
+    if (NULL == partition) {
+        return mempool_status_out_of_memory;
+    }
+
+    /* Make sure the memory is accessible before the partition is split */
+    if (UNLIKELY(NULL != pool->commit_fn && !commit_claim(pool, partition, order, part_order))) {
+        order_lock(pool, part_order);
+        free_list_push(pool, partition, part_order);
+        order_unlock(pool, part_order);
+        detach_end(pool);
+        return mempool_status_out_of_memory;
+    }
+
+    u8 released_flags = split_partition(pool, partition, part_order, order);
+    detach_end(pool);
+    part_set_flags(pool, partition, (u8)BIT_32_GET_AT_POS(PART_FLAG_ACTIVE));
+    part_set_owner(pool, partition, 0);
+    used_count_add(pool, order, 1);
+    claim_count(pool, partition, len);
+    undo_commit(pool);
+
+    /* Let the maintenance thread refill the stock in the background */
+    if (UNLIKELY(stock_low(pool, order))) {
+        maint_kick(pool);
+    }
+    *zeroed = BIT_32_IS_SET(released_flags, PART_FLAG_RELEASED);
+    *part_out = partition;
+    return mempool_status_ok;
+}
+
+/* Link to the next full magazine in the depot. It is stored in the first block of a magazine, next to the link of
+ * blocks within the magazine */
+static inline char** depot_link(const mempool_instance* pool, char* part)
+{
+    return cache_link(pool, part) + 1;
+}
+
+/* Get order of thread cache blocks serving 'len' bytes. MEMPOOL_TCACHE_ORDERS is returned when the claim has to be
+ * passed to the pool */
+static u32 tcache_order(const mempool_instance* pool, size len)
+{
+    if (UNLIKELY(len > (size)-1 - pool->hdr_size) || (0 != pool->direct_threshold && len >= pool->direct_threshold)) {
+        return MEMPOOL_TCACHE_ORDERS;
+    }
+    u32 order = BIT_64_LOG2_CEIL(len + pool->hdr_size);
+    return (order < MEMPOOL_TCACHE_ORDERS) ? order : MEMPOOL_TCACHE_ORDERS;
+}
+
+/* Check if blocks of an order can be kept in thread caches. Magazine links need two pointers of usable space */
+static inline bool tcache_order_valid(const mempool_instance* pool, u32 order)
+{
+    return order < MEMPOOL_TCACHE_ORDERS && ((size)1 << order) >= pool->hdr_size + 2 * sizeof(char*);
+}
+
+/* Carve blocks of 'order' out of a single free partition. The blocks are marked as cached and linked through their
+ * usable space. A whole magazine is carved when possible, otherwise a single block. NULL is returned when there is
+ * no free partition large enough */
+static char* claim_batch(mempool_instance* pool, u32 order, u32* count)
+{
+    u32 batch_order = order + TCACHE_BATCH_SHIFT;
+    u32 part_order;
+    char* partition = take_free_partition(pool, batch_order, &part_order);
+    if (NULL == partition) {
+        batch_order = order;
+        partition = take_free_partition(pool, order, &part_order);
+    }
+    if (NULL == partition) {
+        return NULL;
+    }
+
+    /* Every block header is written, so the whole batch has to be accessible */
+    if (UNLIKELY(NULL != pool->commit_fn && !commit_claim(pool, partition, batch_order, part_order))) {
+        order_lock(pool, part_order);
+        free_list_push(pool, partition, part_order);
+        order_unlock(pool, part_order);
+        detach_end(pool);
+        return NULL;
+    }
+    (void)split_partition(pool, partition, part_order, batch_order);
+    detach_end(pool);
+
+    u8 region = part_get_region(pool, partition);
+    size block_size = (size)1 << order;
+    *count = (u32)1 << (batch_order - order);
+    used_count_add(pool, order, *count);
+    for (u32 i = 0; i < *count; ++i) {
+        char* block = partition + i * block_size;
+        create_partition(pool, block, block_size, region);
+        part_set_flags(pool, block, (u8)(BIT_32_GET_AT_POS(PART_FLAG_ACTIVE) | BIT_32_GET_AT_POS(PART_FLAG_CACHED)));
+        *cache_link(pool, block) = (i + 1 < *count) ? block + block_size : NULL;
+    }
+    return partition;
+}
+
+/* Fill an empty thread cache bin with a magazine from the depot or with newly carved blocks */
+static bool tcache_refill(mempool_tcache* cache, u32 order)
+{
+    mempool_instance* pool = cache->pool;
+    mempool_ext* ext = pool_ext(pool);
+    order_lock(pool, order);
+    char* magazine = ext->depot_heads[order];
+    if (NULL != magazine) {
+        ext->depot_heads[order] = *depot_link(pool, magazine);
+    }
+    order_unlock(pool, order);
+
+    u32 count = MEMPOOL_TCACHE_MAGAZINE;
+    if (NULL == magazine) {
+        magazine = claim_batch(pool, order, &count);
+    }
+    if (NULL == magazine) {
+        return false;
+    }
+    cache->heads[order] = magazine;
+    cache->counts[order] = count;
+    return true;
+}
+
+/* Hand over the older of two full magazines kept in a thread cache bin to the depot */
+static void tcache_spill(mempool_tcache* cache, u32 order)
+{
+    mempool_instance* pool = cache->pool;
+    char* last = cache->heads[order];
+    for (u32 i = 1; i < MEMPOOL_TCACHE_MAGAZINE; ++i) {
+        last = *cache_link(pool, last);
+    }
+    char* magazine = *cache_link(pool, last);
+    *cache_link(pool, last) = NULL;
+    cache->counts[order] -= MEMPOOL_TCACHE_MAGAZINE;
+
+    mempool_ext* ext = pool_ext(pool);
+    order_lock(pool, order);
+    *depot_link(pool, magazine) = ext->depot_heads[order];
+    ext->depot_heads[order] = magazine;
+    order_unlock(pool, order);
+    wake_waiters(pool, order);
+}
+
+/* Keep a block in a thread cache bin */
+static void tcache_put(mempool_tcache* cache, char* part, u32 order)
+{
+    mempool_instance* pool = cache->pool;
+    part_set_flags(pool, part, (u8)(BIT_32_GET_AT_POS(PART_FLAG_ACTIVE) | BIT_32_GET_AT_POS(PART_FLAG_CACHED)));
+    *cache_link(pool, part) = cache->heads[order];
+    cache->heads[order] = part;
+    if (++cache->counts[order] == 2 * MEMPOOL_TCACHE_MAGAZINE) {
+        tcache_spill(cache, order);
+    }
+}
+
+/* Push a block onto the remote queue of its owner. Any thread may push, only the owner takes blocks off the queue, so
+ * the head needs no tag */
+static void tcache_remote_push(mempool_tcache* owner, char* part)
+{
+    mempool_instance* pool = owner->pool;
+    part_set_flags(pool, part, (u8)(part_get_flags(pool, part) | BIT_32_GET_AT_POS(PART_FLAG_CACHED)));
+
+    char* old_head = __atomic_load_n((char**)&owner->remote_head, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(cache_link(pool, part), old_head, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n((char**)&owner->remote_head, &old_head, part, true, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+/* Move all blocks queued by other threads into the bins of their owner */
+static void tcache_remote_drain(mempool_tcache* cache)
+{
+    mempool_instance* pool = cache->pool;
+    char* part = __atomic_exchange_n((char**)&cache->remote_head, NULL, __ATOMIC_ACQUIRE);
+    while (NULL != part) {
+        char* next = __atomic_load_n(cache_link(pool, part), __ATOMIC_RELAXED);
+        tcache_put(cache, part, part_get_order(pool, part));
+        part = next;
+    }
+}
+
+/* Return a chain of cached blocks to the buddy tree */
+static size free_chain(mempool_instance* pool, char* part)
+{
+    size freed = 0;
+    while (NULL != part) {
+        char* next = *cache_link(pool, part);
+        free_partition(pool, part);
+        freed++;
+        part = next;
+    }
+    return freed;
+}
+
+mempool_status mempool_claim_memory(mempool_instance* pool, size len, void** dst)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(len, 0, mempool_status_size_err);
+    ERROR_IF(dst, NULL, mempool_status_nullptr);
+
+    char* partition;
+    bool zeroed;
+    mempool_status status = claim_partition(pool, len, &partition, &zeroed);
+    if (LIKELY(mempool_status_ok == status)) {
+        *dst = partition + pool->hdr_size;
+    }
+    return status;
+}
+
+mempool_status mempool_claim_zeroed(mempool_instance* pool, size len, void** dst)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(len, 0, mempool_status_size_err);
+    ERROR_IF(dst, NULL, mempool_status_nullptr);
+
+    char* partition;
+    bool zeroed;
+    mempool_status status = claim_partition(pool, len, &partition, &zeroed);
+    if (LIKELY(mempool_status_ok == status)) {
+        *dst = partition + pool->hdr_size;
+        /* Released memory is already zeroed - do not fault its pages in */
+        if (!zeroed) {
+            memset(*dst, 0, len);
+        }
+    }
+    return status;
+}
+
+mempool_status mempool_claim_wait(mempool_instance* pool, size len, void** dst, u64 timeout_ns)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(len, 0, mempool_status_size_err);
+    ERROR_IF(dst, NULL, mempool_status_nullptr);
+    ERROR_IF(pool->thread_safe, false, mempool_status_not_supported);
+
+    /* Requests that cannot be represented never become satisfiable */
+    if (UNLIKELY(len > (size)-1 - pool->hdr_size || BIT_64_LOG2_CEIL(len + pool->hdr_size) >= MEMPOOL_ORDER_NUM)) {
+        return mempool_status_out_of_memory;
+    }
+#if MEMPOOL_THREAD_SAFE
+    mempool_ext* ext = pool_ext(pool);
+    u32 order = BIT_64_LOG2_CEIL(len + pool->hdr_size);
+    u64 wait_bit = BIT_64_GET_AT_POS(order);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    u64 start_ns = (u64)now.tv_sec * 1000000000u + (u64)now.tv_nsec;
+    for (;;) {
+        /* The bit is set before the attempt, so a partition freed after the attempt failed wakes us up */
+        __atomic_fetch_or(&ext->wait_map, wait_bit, __ATOMIC_SEQ_CST);
+        u32 seq = __atomic_load_n(&ext->wait_seqs[order], __ATOMIC_SEQ_CST);
+        mempool_status status = mempool_claim_memory(pool, len, dst);
+        if (mempool_status_out_of_memory != status) {
+            return status;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        u64 elapsed_ns = (u64)now.tv_sec * 1000000000u + (u64)now.tv_nsec - start_ns;
+        if (elapsed_ns >= timeout_ns) {
+            return status;
+        }
+
+        /* A waker might have cleared the bit in the meantime - it bumped the sequence then, so the wait returns */
+        __atomic_fetch_or(&ext->wait_map, wait_bit, __ATOMIC_SEQ_CST);
+        u64 remaining_ns = (MEMPOOL_WAIT_FOREVER == timeout_ns) ? MEMPOOL_WAIT_FOREVER : timeout_ns - elapsed_ns;
+        pool_wait(pool, &ext->wait_seqs[order], seq, remaining_ns);
+    }
+#else
+    (void)timeout_ns;
+    return mempool_status_not_supported;
+#endif
+}
+
+mempool_status mempool_free_memory(mempool_instance* pool, void* memory)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(memory, NULL, mempool_status_nullptr);
+
+    char* partition = (char*)memory - pool->hdr_size;
+
+#ifdef MEMPOOL_SANITY_CHECK
+    ERROR_IF(partition_sanity_check(pool, partition), false, mempool_status_inv_memory);
+#endif
+
+    /* Throw an error in case partition is not active */
+    ERROR_IF(part_is_active(pool, partition), false, mempool_status_inv_memory);
+
+    if (BIT_32_IS_SET(part_get_flags(pool, partition), PART_FLAG_DIRECT)) {
+        ERROR_IF(pool->direct_fn, NULL, mempool_status_inv_memory);
+
+        /* The header goes away with the mapping, the claim stays with the caller if it cannot be unmapped */
+        size claimed = part_get_claimed(pool, partition);
+        size granted = part_get_size(pool, partition);
+        void* map = partition;
+        size map_len = 0;
+        mempool_status status = pool->direct_fn(pool->backing, &map, &map_len);
+        if (LIKELY(mempool_status_ok == status)) {
+            claim_sub(pool, claimed, granted);
+        }
+        /* The provider may have refused direct claims that are possible now */
+        wake_waiters(pool, MEMPOOL_ORDER_NUM - 1);
+        return status;
+    }
+
+    /* Blocks kept in caches have already been freed */
+    ERROR_IF(part_is_cached(pool, partition), true, mempool_status_inv_memory);
+    claim_uncount(pool, partition);
+
+    /* Cached blocks are coalesced later by mempool_drain_cache() */
+    if (pool->lock_free) {
+        cache_push(pool, partition);
+        wake_waiters(pool, part_get_order(pool, partition));
+        return mempool_status_ok;
+    }
+
+    free_partition(pool, partition);
+    return mempool_status_ok;
+}
+
+mempool_status mempool_free_batch(mempool_instance* pool, void* const* blocks, size cnt)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(blocks, NULL, mempool_status_nullptr);
+
+    /* An undo log covers a single block, lock-free caches take blocks one by one anyway */
+    mempool_status status = mempool_status_ok;
+    if (0 != pool->log_off || pool->lock_free) {
+        for (size i = 0; i < cnt; ++i) {
+            mempool_status block_status = mempool_free_memory(pool, blocks[i]);
+            status = (mempool_status_ok == block_status) ? status : block_status;
+        }
+        return status;
+    }
+
+    char* pending[MEMPOOL_ORDER_NUM] = {NULL};
+    u64 pending_map = 0;
+    for (size i = 0; i < cnt; ++i) {
+        if (UNLIKELY(NULL == blocks[i])) {
+            status = mempool_status_nullptr;
+            continue;
+        }
+        char* partition = (char*)blocks[i] - pool->hdr_size;
+#ifdef MEMPOOL_SANITY_CHECK
+        if (UNLIKELY(!partition_sanity_check(pool, partition))) {
+            status = mempool_status_inv_memory;
+            continue;
+        }
+#endif
+        if (UNLIKELY(!part_is_active(pool, partition) || part_is_cached(pool, partition))) {
+            status = mempool_status_inv_memory;
+            continue;
+        }
+        if (BIT_32_IS_SET(part_get_flags(pool, partition), PART_FLAG_DIRECT)) {
+            mempool_status block_status = mempool_free_memory(pool, blocks[i]);
+            status = (mempool_status_ok == block_status) ? status : block_status;
+            continue;
+        }
+
+        claim_uncount(pool, partition);
+        u32 order = part_get_order(pool, partition);
+        used_count_sub(pool, order);
+        part_set_flags(pool, partition, 0);
+        part_set_next(pool, partition, pending[order]);
+        pending[order] = partition;
+        BIT_64_SET(pending_map, order);
+    }
+    if (0 != pending_map) {
+        merge_batch(pool, pending, pending_map);
+    }
+    return status;
+}
+
+mempool_status mempool_realloc_memory(mempool_instance* pool, void** memory, size len)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(memory, NULL, mempool_status_nullptr);
+    ERROR_IF(len, 0, mempool_status_size_err);
+    if (NULL == *memory) {
+        return mempool_claim_memory(pool, len, memory);
+    }
+
+    char* partition = (char*)*memory - pool->hdr_size;
+#ifdef MEMPOOL_SANITY_CHECK
+    ERROR_IF(partition_sanity_check(pool, partition), false, mempool_status_inv_memory);
+#endif
+    ERROR_IF(part_is_active(pool, partition), false, mempool_status_inv_memory);
+
+    size usable = part_get_size(pool, partition) - pool->hdr_size;
+    bool direct = BIT_32_IS_SET(part_get_flags(pool, partition), PART_FLAG_DIRECT);
+    if (direct && 0 != pool->direct_threshold && len >= pool->direct_threshold) {
+        /* The provider resizes the mapping, so the content is not copied here */
+        ERROR_IF(len > (size)-1 - pool->hdr_size, true, mempool_status_out_of_memory);
+        size claimed = part_get_claimed(pool, partition);
+        size granted = part_get_size(pool, partition);
+        void* map = partition;
+        size map_len = len + pool->hdr_size;
+        mempool_status status = pool->direct_fn(pool->backing, &map, &map_len);
+        if (UNLIKELY(mempool_status_ok != status)) {
+            return status;
+        }
+        claim_sub(pool, claimed, granted);
+        part_set_size(pool, map, map_len);
+        claim_count(pool, map, len);
+        *memory = (char*)map + pool->hdr_size;
+        return mempool_status_ok;
+    }
+    if (!direct && len <= usable) {
+        /* Claims served by thread caches stay uncounted */
+        if (0 != part_get_claimed(pool, partition)) {
+            claim_uncount(pool, partition);
+            claim_count(pool, partition, len);
+            undo_commit(pool);
+        }
+        return mempool_status_ok;
+    }
+
+    void* moved;
+    mempool_status status = mempool_claim_memory(pool, len, &moved);
+    if (LIKELY(mempool_status_ok == status)) {
+        memcpy(moved, *memory, (len < usable) ? len : usable);
+        (void)mempool_free_memory(pool, *memory);
+        *memory = moved;
+    }
+    return status;
+}
+
+mempool_status mempool_set_direct_threshold(mempool_instance* pool, size threshold)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(pool->hdr_type, mempool_hdr_off16, mempool_status_not_supported);
+    ERROR_IF(pool->hdr_type, mempool_hdr_off32, mempool_status_not_supported);
+    ERROR_IF(pool->direct_fn, NULL, mempool_status_not_supported);
+    pool->direct_threshold = threshold;
+    return mempool_status_ok;
+}
+
+size mempool_drain_cache(mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, 0);
+
+    /* Caches and magazines are kept in the extended state */
+    mempool_ext* ext = pool_ext(pool);
+    if (NULL == ext) {
+        return 0;
+    }
+
+    size drained = 0;
+    for (u32 order = 0; pool->lock_free && order < MEMPOOL_ORDER_NUM; ++order) {
+        /* Detach the whole stack at once - concurrent frees start a new one */
+        u64 old_head = __atomic_load_n(&ext->cache_heads[order], __ATOMIC_ACQUIRE);
+        while (NULL != tagged_ptr(old_head) &&
+               !__atomic_compare_exchange_n(&ext->cache_heads[order], &old_head,
+                                            tagged_pack(NULL, tagged_tag(old_head) + 1), false, __ATOMIC_ACQUIRE,
+                                            __ATOMIC_ACQUIRE)) {
+        }
+
+        char* part = tagged_ptr(old_head);
+        while (NULL != part) {
+            char* next = __atomic_load_n(cache_link(pool, part), __ATOMIC_RELAXED);
+            free_partition(pool, part);
+            drained++;
+            part = next;
+        }
+    }
+
+    /* Magazines are detached under the lock, but coalesced without holding it */
+    for (u32 order = 0; order < MEMPOOL_TCACHE_ORDERS; ++order) {
+        order_lock(pool, order);
+        char* magazine = ext->depot_heads[order];
+        ext->depot_heads[order] = NULL;
+        order_unlock(pool, order);
+
+        while (NULL != magazine) {
+            char* next = *depot_link(pool, magazine);
+            drained += free_chain(pool, magazine);
+            magazine = next;
+        }
+    }
+    return drained;
+}
+
+size mempool_trim(mempool_instance* pool, size keep_bytes)
+{
+    ERROR_IF(pool, NULL, 0);
+    ERROR_IF(pool->release_fn, NULL, 0);
+
+    /* Cached blocks have to be coalesced first to form large free partitions */
+    (void)mempool_drain_cache(pool);
+
+    /* Count free memory that is still backed */
+    size resident = 0;
+    for (u32 order = 0; order < MEMPOOL_ORDER_NUM; ++order) {
+        order_lock(pool, order);
+        char* part = head_to_part(pool, pool->free_heads[order]);
+        for (; NULL != part; part = part_get_next(pool, part)) {
+            resident += part_is_released(pool, part) ? 0 : (size)1 << order;
+        }
+        order_unlock(pool, order);
+    }
+
+    /* Release the largest partitions first - they give the biggest page-aligned ranges */
+    size released = 0;
+    for (u32 order = MEMPOOL_ORDER_NUM; order-- > 0 && resident > keep_bytes;) {
+        order_lock(pool, order);
+        char* part = head_to_part(pool, pool->free_heads[order]);
+        for (; NULL != part && resident > keep_bytes; part = part_get_next(pool, part)) {
+            if (!part_is_released(pool, part) && release_partition(pool, part)) {
+                resident -= (size)1 << order;
+                released += ((size)1 << order) - pool->hdr_size;
+            }
+        }
+        order_unlock(pool, order);
+    }
+    return released;
+}
+
+void mempool_set_trim_threshold(mempool_instance* pool, size threshold)
+{
+    if (LIKELY(NULL != pool)) {
+        pool->trim_threshold = threshold;
+    }
+}
+
+mempool_status mempool_tcache_init(mempool_tcache* cache, mempool_instance* pool)
+{
+    ERROR_IF(cache, NULL, mempool_status_nullptr);
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    /* Magazine depots link blocks with native pointers */
+    ERROR_IF(pool->shared, true, mempool_status_not_supported);
+    mempool_ext* ext = pool_ext(pool);
+    ERROR_IF(ext, NULL, mempool_status_not_supported);
+
+    cache->pool = pool;
+    for (u32 order = 0; order < MEMPOOL_TCACHE_ORDERS; ++order) {
+        cache->heads[order] = NULL;
+        cache->counts[order] = 0;
+    }
+    cache->remote_head = NULL;
+
+    /* Take the first unused owner id. Blocks of caches without an id are never queued remotely */
+    cache->owner_id = 0;
+    for (u32 id = 0; mempool_hdr_ptr == pool->hdr_type && 0 == cache->owner_id && id < MEMPOOL_TCACHE_OWNERS_MAX;
+         ++id) {
+        mempool_tcache* expected = NULL;
+        if (__atomic_compare_exchange_n(&ext->owners[id], &expected, cache, false, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+            cache->owner_id = (u8)(id + 1);
+        }
+    }
+    return mempool_status_ok;
+}
+
+mempool_status mempool_tcache_claim(mempool_tcache* cache, size len, void** dst)
+{
+    ERROR_IF(cache, NULL, mempool_status_nullptr);
+    ERROR_IF(len, 0, mempool_status_size_err);
+    ERROR_IF(dst, NULL, mempool_status_nullptr);
+
+    mempool_instance* pool = cache->pool;
+    if (NULL != __atomic_load_n((char**)&cache->remote_head, __ATOMIC_RELAXED)) {
+        tcache_remote_drain(cache);
+    }
+
+    u32 order = tcache_order(pool, len);
+    if (!tcache_order_valid(pool, order) || (0 == cache->counts[order] && !tcache_refill(cache, order))) {
+        return mempool_claim_memory(pool, len, dst);
+    }
+
+    char* part = cache->heads[order];
+    cache->heads[order] = *cache_link(pool, part);
+    cache->counts[order]--;
+    part_set_flags(pool, part, (u8)BIT_32_GET_AT_POS(PART_FLAG_ACTIVE));
+    part_set_owner(pool, part, cache->owner_id);
+    part_set_claimed(pool, part, 0);
+    *dst = part + pool->hdr_size;
+    return mempool_status_ok;
+}
+
+mempool_status mempool_tcache_free(mempool_tcache* cache, void* memory)
+{
+    ERROR_IF(cache, NULL, mempool_status_nullptr);
+    ERROR_IF(memory, NULL, mempool_status_nullptr);
+
+    mempool_instance* pool = cache->pool;
+    char* partition = (char*)memory - pool->hdr_size;
+
+#ifdef MEMPOOL_SANITY_CHECK
+    ERROR_IF(partition_sanity_check(pool, partition), false, mempool_status_inv_memory);
+#endif
+    ERROR_IF(part_is_active(pool, partition), false, mempool_status_inv_memory);
+    ERROR_IF(part_is_cached(pool, partition), true, mempool_status_inv_memory);
+
+    u8 flags = part_get_flags(pool, partition);
+    u32 order = part_get_order(pool, partition);
+    if (BIT_32_IS_SET(flags, PART_FLAG_DIRECT) || !tcache_order_valid(pool, order)) {
+        return mempool_free_memory(pool, memory);
+    }
+
+    claim_uncount(pool, partition);
+
+    /* Blocks of a released owner are kept by whoever frees them */
+    u8 owner_id = part_get_owner(pool, partition);
+    mempool_tcache* owner =
+        (0 == owner_id) ? NULL : __atomic_load_n(&pool_ext(pool)->owners[owner_id - 1], __ATOMIC_ACQUIRE);
+    if (NULL != owner && owner != cache) {
+        tcache_remote_push(owner, partition);
+    } else {
+        tcache_put(cache, partition, order);
+    }
+    return mempool_status_ok;
+}
+
+size mempool_tcache_flush(mempool_tcache* cache)
+{
+    ERROR_IF(cache, NULL, 0);
+
+    tcache_remote_drain(cache);
+    size flushed = 0;
+    for (u32 order = 0; order < MEMPOOL_TCACHE_ORDERS; ++order) {
+        flushed += free_chain(cache->pool, cache->heads[order]);
+        cache->heads[order] = NULL;
+        cache->counts[order] = 0;
+    }
+    return flushed;
+}
+
+size mempool_tcache_release(mempool_tcache* cache)
+{
+    ERROR_IF(cache, NULL, 0);
+
+    if (0 != cache->owner_id) {
+        __atomic_store_n(&pool_ext(cache->pool)->owners[cache->owner_id - 1], NULL, __ATOMIC_RELEASE);
+        cache->owner_id = 0;
+    }
+    return mempool_tcache_flush(cache);
+}
+
+mempool_status mempool_set_low_watermark(mempool_instance* pool, size len, u32 count)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(len, 0, mempool_status_size_err);
+    if (UNLIKELY(len > (size)-1 - pool->hdr_size || BIT_64_LOG2_CEIL(len + pool->hdr_size) >= MEMPOOL_ORDER_NUM - 1)) {
+        return mempool_status_size_err;
+    }
+
+    mempool_ext* ext = pool_ext(pool);
+    ERROR_IF(ext, NULL, mempool_status_not_supported);
+
+    u32 order = BIT_64_LOG2_CEIL(len + pool->hdr_size);
+    __atomic_store_n(&ext->low_marks[order], count, __ATOMIC_RELAXED);
+    if (0 != count) {
+        __atomic_fetch_or(&ext->stock_map, BIT_64_GET_AT_POS(order), __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_and(&ext->stock_map, BIT_64_NOT(BIT_64_GET_AT_POS(order)), __ATOMIC_RELAXED);
+    }
+    return mempool_status_ok;
+}
+
+size mempool_replenish(mempool_instance* pool, size max_splits)
+{
+    ERROR_IF(pool, NULL, 0);
+
+    size splits = 0;
+    u64 orders = stock_map_get(pool);
+    while (0 != orders && splits < max_splits) {
+        u32 order = BIT_64_CTZ(orders);
+        u32 part_order;
+        char* partition = NULL;
+        if (stock_low(pool, order)) {
+            partition = take_free_partition(pool, order + 1, &part_order);
+        }
+        if (NULL == partition) {
+            BIT_64_CLR(orders, order);
+            continue;
+        }
+        if (UNLIKELY(NULL != pool->commit_fn && !commit_claim(pool, partition, order, part_order))) {
+            order_lock(pool, part_order);
+            free_list_push(pool, partition, part_order);
+            order_unlock(pool, part_order);
+            detach_end(pool);
+            break;
+        }
+
+        /* Both halves of the last split stay free */
+        u8 flags = split_partition(pool, partition, part_order, order);
+        part_set_flags(pool, partition, (u8)(flags & BIT_32_GET_AT_POS(PART_FLAG_RELEASED)));
+        order_lock(pool, order);
+        free_list_push(pool, partition, order);
+        order_unlock(pool, order);
+        undo_commit(pool);
+        detach_end(pool);
+        splits++;
+    }
+    return splits;
+}
+
+/* Check if mempool_maintain() would find any work. Other threads may add work right after the check */
+static bool maint_pending(mempool_instance* pool)
+{
+    /* Cached blocks and magazines are queued in the extended state only */
+    mempool_ext* ext = pool_ext(pool);
+    for (u32 order = 0; pool->lock_free && order < MEMPOOL_ORDER_NUM; ++order) {
+        if (NULL != tagged_ptr(__atomic_load_n(&ext->cache_heads[order], __ATOMIC_RELAXED))) {
+            return true;
+        }
+    }
+
+    for (u32 order = 0; NULL != ext && order < MEMPOOL_TCACHE_ORDERS; ++order) {
+        order_lock(pool, order);
+        bool magazine = NULL != ext->depot_heads[order];
+        order_unlock(pool, order);
+        if (magazine) {
+            return true;
+        }
+    }
+
+    /* A stock is refilled by splitting any larger free partition */
+    u64 orders = stock_map_get(pool);
+    u64 free_map = __atomic_load_n(&pool->free_map, __ATOMIC_RELAXED);
+    while (0 != orders) {
+        u32 order = BIT_64_CTZ(orders);
+        BIT_64_CLR(orders, order);
+        if (stock_low(pool, order) && 0 != (free_map & BIT_64_NOT(BIT_64_GET_AT_POS(order + 1) - 1))) {
+            return true;
+        }
+    }
+
+    if (0 == pool->trim_threshold || NULL == pool->release_fn) {
+        return false;
+    }
+    for (u32 order = BIT_64_LOG2_CEIL(pool->trim_threshold); order < MEMPOOL_ORDER_NUM; ++order) {
+        bool backed = false;
+        order_lock(pool, order);
+        char* part = head_to_part(pool, pool->free_heads[order]);
+        for (; NULL != part && !backed; part = part_get_next(pool, part)) {
+            backed = !part_is_released(pool, part);
+        }
+        order_unlock(pool, order);
+        if (backed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool mempool_maintain(mempool_instance* pool, size max_ops)
+{
+    ERROR_IF(pool, NULL, false);
+    if (0 == max_ops) {
+        return maint_pending(pool);
+    }
+
+    size ops = 0;
+    for (u32 order = 0; pool->lock_free && order < MEMPOOL_ORDER_NUM; ++order) {
+        for (char* part; ops < max_ops && NULL != (part = cache_pop(pool, order)); ++ops) {
+            free_partition(pool, part);
+        }
+        if (ops == max_ops) {
+            return maint_pending(pool);
+        }
+    }
+
+    mempool_ext* ext = pool_ext(pool);
+    for (u32 order = 0; NULL != ext && order < MEMPOOL_TCACHE_ORDERS; ++order) {
+        for (; ops < max_ops; ++ops) {
+            order_lock(pool, order);
+            char* magazine = ext->depot_heads[order];
+            if (NULL != magazine) {
+                ext->depot_heads[order] = *depot_link(pool, magazine);
+            }
+            order_unlock(pool, order);
+            if (NULL == magazine) {
+                break;
+            }
+            (void)free_chain(pool, magazine);
+        }
+        if (ops == max_ops) {
+            return maint_pending(pool);
+        }
+    }
+
+    ops += mempool_replenish(pool, max_ops - ops);
+    if (ops == max_ops) {
+        return maint_pending(pool);
+    }
+
+    if (0 == pool->trim_threshold || NULL == pool->release_fn) {
+        return false;
+    }
+    for (u32 order = BIT_64_LOG2_CEIL(pool->trim_threshold); order < MEMPOOL_ORDER_NUM; ++order) {
+        while (ops < max_ops) {
+            /* Released partitions stay on free lists, so each step looks for the first one still backed */
+            bool released = false;
+            order_lock(pool, order);
+            char* part = head_to_part(pool, pool->free_heads[order]);
+            for (; NULL != part && !released; part = part_get_next(pool, part)) {
+                released = !part_is_released(pool, part) && release_partition(pool, part);
+            }
+            order_unlock(pool, order);
+            if (!released) {
+                break;
+            }
+            ops++;
+        }
+        if (ops == max_ops) {
+            return maint_pending(pool);
+        }
+    }
+    return false;
 }
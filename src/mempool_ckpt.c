@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mempool_ckpt.h"
+#include "bit.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------- Private data types ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Number of pages tracked by a single word of dirty map */
+#define PAGES_PER_WORD 64u
+
+/* Trackers looked up by the fault handler */
+static mempool_ckpt* trackers[MEMPOOL_CKPT_TRACKERS_MAX];
+
+/* Non-zero once the fault handler is installed */
+static u32 handler_installed;
+
+/* Action of SIGSEGV installed before the fault handler */
+static struct sigaction prev_action;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Private functions ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Mark a page dirty */
+static inline void page_set_dirty(mempool_ckpt* ckpt, size page)
+{
+    __atomic_fetch_or(&ckpt->dirty_map[page / PAGES_PER_WORD], (u64)1 << (page % PAGES_PER_WORD), __ATOMIC_RELAXED);
+}
+
+/* Mark all pages dirty, so the next checkpoint writes the whole buffer */
+static void mark_all_dirty(mempool_ckpt* ckpt)
+{
+    for (size page = 0; page < ckpt->page_cnt; ++page) {
+        page_set_dirty(ckpt, page);
+    }
+}
+
+/* Pass a fault outside tracked pools on to the previous handler */
+static void chain_fault(int sig, siginfo_t* info, void* ucontext)
+{
+    if (0 != (prev_action.sa_flags & SA_SIGINFO)) {
+        prev_action.sa_sigaction(sig, info, ucontext);
+    } else if (SIG_IGN == prev_action.sa_handler) {
+        return;
+    } else if (SIG_DFL == prev_action.sa_handler) {
+        /* The faulting instruction runs again and the default action takes place */
+        struct sigaction dfl;
+        memset(&dfl, 0, sizeof(dfl));
+        dfl.sa_handler = SIG_DFL;
+        sigaction(SIGSEGV, &dfl, NULL);
+    } else {
+        prev_action.sa_handler(sig);
+    }
+}
+
+/* Handle the first write to a read-only page of a tracked pool */
+static void fault_handler(int sig, siginfo_t* info, void* ucontext)
+{
+    char* addr = info->si_addr;
+    for (u32 i = 0; i < MEMPOOL_CKPT_TRACKERS_MAX; ++i) {
+        mempool_ckpt* ckpt = __atomic_load_n(&trackers[i], __ATOMIC_ACQUIRE);
+        if (NULL != ckpt && addr >= ckpt->base_addr && addr < ckpt->base_addr + ckpt->pool->size) {
+            size page = (size)(addr - ckpt->base_addr) / ckpt->page_size;
+            page_set_dirty(ckpt, page);
+            mprotect(ckpt->base_addr + page * ckpt->page_size, ckpt->page_size, PROT_READ | PROT_WRITE);
+            return;
+        }
+    }
+    chain_fault(sig, info, ucontext);
+}
+
+/* Install the fault handler once per process */
+static bool install_handler(void)
+{
+    u32 expected = 0;
+    if (!__atomic_compare_exchange_n(&handler_installed, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return true;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = fault_handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (UNLIKELY(0 != sigaction(SIGSEGV, &action, &prev_action))) {
+        __atomic_store_n(&handler_installed, 0, __ATOMIC_RELEASE);
+        return false;
+    }
+    return true;
+}
+
+/* Write a range of memory to a file at the given offset */
+static bool write_all(int fd, const char* addr, size len, u64 off)
+{
+    while (len > 0) {
+        ssize_t written = pwrite(fd, addr, len, (off_t)off);
+        if (UNLIKELY(written <= 0)) {
+            return false;
+        }
+        addr += written;
+        len -= (size)written;
+        off += (u64)written;
+    }
+    return true;
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+mempool_status mempool_ckpt_start(mempool_ckpt* ckpt, mempool_instance* pool)
+{
+    ERROR_IF(ckpt, NULL, mempool_status_nullptr);
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+
+    /* Memory changed without writes would be missed */
+    if (UNLIKELY(NULL != pool->commit_fn || NULL != pool->release_fn || pool->region_cnt > 1 ||
+                 0 != pool->direct_threshold)) {
+        return mempool_status_not_supported;
+    }
+    /* Base address of a shared pool is valid in the initializing process only */
+    char* base_addr = mempool_base_addr(pool);
+    size page_size = (size)sysconf(_SC_PAGESIZE);
+    if (UNLIKELY(pool->size < page_size || 0 != ((uintptr_t)base_addr & (page_size - 1)))) {
+        return mempool_status_size_err;
+    }
+
+    size page_cnt = pool->size / page_size;
+    size map_len = ((page_cnt + PAGES_PER_WORD - 1) / PAGES_PER_WORD) * sizeof(u64);
+    map_len = (map_len + page_size - 1) & ~(page_size - 1);
+    void* map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ERROR_IF(map, MAP_FAILED, mempool_status_out_of_memory);
+
+    ckpt->pool = pool;
+    ckpt->base_addr = base_addr;
+    ckpt->page_size = page_size;
+    ckpt->page_cnt = page_cnt;
+    ckpt->dirty_map = map;
+    ckpt->map_len = map_len;
+    ckpt->seq = 0;
+    ckpt->pages_written = 0;
+    mark_all_dirty(ckpt);
+
+    for (u32 i = 0; i < MEMPOOL_CKPT_TRACKERS_MAX; ++i) {
+        mempool_ckpt* expected = NULL;
+        if (__atomic_compare_exchange_n(&trackers[i], &expected, ckpt, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            if (LIKELY(install_handler())) {
+                return mempool_status_ok;
+            }
+            __atomic_store_n(&trackers[i], NULL, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    munmap(map, map_len);
+    return mempool_status_nok;
+}
+
+mempool_status mempool_ckpt_stop(mempool_ckpt* ckpt)
+{
+    ERROR_IF(ckpt, NULL, mempool_status_nullptr);
+
+    /* Pages are writable again before the handler stops recognizing them */
+    mprotect(ckpt->base_addr, ckpt->pool->size, PROT_READ | PROT_WRITE);
+    for (u32 i = 0; i < MEMPOOL_CKPT_TRACKERS_MAX; ++i) {
+        mempool_ckpt* expected = ckpt;
+        (void)__atomic_compare_exchange_n(&trackers[i], &expected, NULL, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+    }
+    munmap(ckpt->dirty_map, ckpt->map_len);
+    ckpt->dirty_map = NULL;
+    return mempool_status_ok;
+}
+
+mempool_status mempool_ckpt_touch(mempool_ckpt* ckpt, const void* addr, size len)
+{
+    ERROR_IF(ckpt, NULL, mempool_status_nullptr);
+    ERROR_IF(addr, NULL, mempool_status_nullptr);
+
+    size off = (size)((uintptr_t)addr - (uintptr_t)ckpt->base_addr);
+    if (UNLIKELY((const char*)addr < ckpt->base_addr || off > ckpt->pool->size || len > ckpt->pool->size - off)) {
+        return mempool_status_inv_memory;
+    }
+    if (0 == len) {
+        return mempool_status_ok;
+    }
+
+    /* Pages are dirty before they become writable, the same way the fault handler handles them */
+    size first = off / ckpt->page_size;
+    size last = (off + len - 1) / ckpt->page_size;
+    for (size page = first; page <= last; ++page) {
+        page_set_dirty(ckpt, page);
+    }
+    mprotect(ckpt->base_addr + first * ckpt->page_size, (last - first + 1) * ckpt->page_size, PROT_READ | PROT_WRITE);
+    return mempool_status_ok;
+}
+
+mempool_status mempool_checkpoint(mempool_ckpt* ckpt, int fd)
+{
+    ERROR_IF(ckpt, NULL, mempool_status_nullptr);
+
+    const mempool_instance* pool = ckpt->pool;
+    const mempool_ext* ext = mempool_ext_addr(pool);
+    size data_off = sizeof(mempool_ckpt_manifest) + sizeof(mempool_instance) + sizeof(mempool_ext);
+    data_off = (data_off + ckpt->page_size - 1) & ~(ckpt->page_size - 1);
+
+    /* Each run of dirty pages is protected before it is written. A write racing with the checkpoint either lands
+     * before the page is written or faults and makes the page dirty for the next checkpoint */
+    size written = 0;
+    for (size word = 0; word * PAGES_PER_WORD < ckpt->page_cnt; ++word) {
+        u64 bits = __atomic_exchange_n(&ckpt->dirty_map[word], 0, __ATOMIC_ACQ_REL);
+        while (0 != bits) {
+            u32 first = BIT_64_CTZ(bits);
+            u32 run = (UINT64_MAX == (bits >> first)) ? PAGES_PER_WORD - first : BIT_64_CTZ(~(bits >> first));
+            bits &= (first + run >= PAGES_PER_WORD) ? 0 : UINT64_MAX << (first + run);
+
+            size page = word * PAGES_PER_WORD + first;
+            char* addr = ckpt->base_addr + page * ckpt->page_size;
+            size len = (size)run * ckpt->page_size;
+            mprotect(addr, len, PROT_READ);
+            if (UNLIKELY(!write_all(fd, addr, len, data_off + page * ckpt->page_size))) {
+                mark_all_dirty(ckpt);
+                return mempool_status_nok;
+            }
+            written += run;
+        }
+    }
+
+    /* The manifest is written last, so it never describes pages that were not written */
+    struct
+    {
+        mempool_ckpt_manifest manifest;
+        mempool_instance instance;
+        mempool_ext ext;
+    } header;
+    memset(&header, 0, sizeof(header));
+    header.manifest.magic = MEMPOOL_CKPT_MAGIC;
+    header.manifest.instance_len = (u32)sizeof(mempool_instance);
+    header.manifest.ext_len = (NULL != ext) ? (u32)sizeof(mempool_ext) : 0;
+    header.manifest.seq = ckpt->seq + 1;
+    header.manifest.pool_size = (u64)pool->size;
+    header.manifest.page_size = (u64)ckpt->page_size;
+    header.manifest.data_off = (u64)data_off;
+    header.manifest.base_addr = (u64)(uintptr_t)ckpt->base_addr;
+    memcpy(&header.instance, pool, sizeof(mempool_instance));
+    if (NULL != ext) {
+        memcpy(&header.ext, ext, sizeof(mempool_ext));
+    }
+    if (UNLIKELY(!write_all(fd, (const char*)&header, sizeof(header), 0))) {
+        mark_all_dirty(ckpt);
+        return mempool_status_nok;
+    }
+    ckpt->seq++;
+    ckpt->pages_written = written;
+    return mempool_status_ok;
+}
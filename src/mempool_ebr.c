@@ -0,0 +1,179 @@
+#include <sched.h>
+
+#include "mempool_ebr.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------- Private data types ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Bit of a thread epoch set while the thread is inside a critical section */
+#define EBR_ACTIVE 1u
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Private functions ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Advance the global epoch if every thread inside a critical section has seen it. The global epoch is returned */
+static u64 try_advance(mempool_ebr* ebr)
+{
+    u64 epoch = __atomic_load_n(&ebr->epoch, __ATOMIC_SEQ_CST);
+    u64 slots = __atomic_load_n(&ebr->slot_map, __ATOMIC_ACQUIRE);
+    while (0 != slots) {
+        u32 slot = (u32)__builtin_ctzll(slots);
+        slots &= slots - 1;
+        u64 local = __atomic_load_n(&ebr->locals[slot], __ATOMIC_SEQ_CST);
+        if (0 != (local & EBR_ACTIVE) && (local >> 1) != epoch) {
+            return epoch;
+        }
+    }
+    /* A failed exchange means another thread has advanced the epoch already */
+    if (__atomic_compare_exchange_n(&ebr->epoch, &epoch, epoch + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return epoch + 1;
+    }
+    return epoch;
+}
+
+/* Return all blocks of a bucket to the pool */
+static size free_bucket(mempool_ebr_thread* thread, u32 bucket)
+{
+    size freed = thread->bucket_counts[bucket];
+    (void)mempool_free_batch(thread->ebr->pool, thread->buckets[bucket], freed);
+    thread->bucket_counts[bucket] = 0;
+    return freed;
+}
+
+/* Free buckets retired at least two epochs before the given one */
+static size collect_buckets(mempool_ebr_thread* thread, u64 epoch)
+{
+    size freed = 0;
+    for (u32 bucket = 0; bucket < MEMPOOL_EBR_EPOCHS; ++bucket) {
+        if (0 != thread->bucket_counts[bucket] && thread->bucket_epochs[bucket] + 2 <= epoch) {
+            freed += free_bucket(thread, bucket);
+        }
+    }
+    return freed;
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+mempool_status mempool_ebr_init(mempool_ebr* ebr, mempool_instance* pool)
+{
+    ERROR_IF(ebr, NULL, mempool_status_nullptr);
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(pool->thread_safe, false, mempool_status_not_supported);
+
+    ebr->pool = pool;
+    ebr->epoch = 0;
+    ebr->slot_map = 0;
+    for (u32 i = 0; i < MEMPOOL_EBR_THREADS_MAX; ++i) {
+        ebr->locals[i] = 0;
+    }
+    return mempool_status_ok;
+}
+
+mempool_status mempool_ebr_register(mempool_ebr* ebr, mempool_ebr_thread* thread)
+{
+    ERROR_IF(ebr, NULL, mempool_status_nullptr);
+    ERROR_IF(thread, NULL, mempool_status_nullptr);
+
+    u64 slots = __atomic_load_n(&ebr->slot_map, __ATOMIC_RELAXED);
+    u32 slot;
+    do {
+        if (UNLIKELY(~(u64)0 == slots)) {
+            return mempool_status_nok;
+        }
+        slot = (u32)__builtin_ctzll(~slots);
+    } while (!__atomic_compare_exchange_n(&ebr->slot_map, &slots, slots | ((u64)1 << slot), true, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+
+    __atomic_store_n(&ebr->locals[slot], 0, __ATOMIC_RELAXED);
+    thread->ebr = ebr;
+    thread->slot = slot;
+    thread->nesting = 0;
+    for (u32 bucket = 0; bucket < MEMPOOL_EBR_EPOCHS; ++bucket) {
+        thread->bucket_epochs[bucket] = 0;
+        thread->bucket_counts[bucket] = 0;
+    }
+    return mempool_status_ok;
+}
+
+mempool_status mempool_ebr_unregister(mempool_ebr_thread* thread)
+{
+    ERROR_IF(thread, NULL, mempool_status_nullptr);
+    if (UNLIKELY(0 != thread->nesting)) {
+        return mempool_status_nok;
+    }
+
+    /* Outside a critical section the thread does not hold back the epoch, so the loop ends once readers leave */
+    for (;;) {
+        (void)mempool_ebr_collect(thread);
+        u32 pending = 0;
+        for (u32 bucket = 0; bucket < MEMPOOL_EBR_EPOCHS; ++bucket) {
+            pending += thread->bucket_counts[bucket];
+        }
+        if (0 == pending) {
+            break;
+        }
+        sched_yield();
+    }
+    __atomic_fetch_and(&thread->ebr->slot_map, ~((u64)1 << thread->slot), __ATOMIC_RELEASE);
+    thread->ebr = NULL;
+    return mempool_status_ok;
+}
+
+void mempool_ebr_enter(mempool_ebr_thread* thread)
+{
+    if (UNLIKELY(NULL == thread) || 0 != thread->nesting++) {
+        return;
+    }
+    mempool_ebr* ebr = thread->ebr;
+    u64 epoch = __atomic_load_n(&ebr->epoch, __ATOMIC_RELAXED);
+    __atomic_store_n(&ebr->locals[thread->slot], (epoch << 1) | EBR_ACTIVE, __ATOMIC_RELAXED);
+    /* The pinned epoch has to be visible before any shared node is read */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void mempool_ebr_exit(mempool_ebr_thread* thread)
+{
+    if (UNLIKELY(NULL == thread || 0 == thread->nesting) || 0 != --thread->nesting) {
+        return;
+    }
+    __atomic_store_n(&thread->ebr->locals[thread->slot], 0, __ATOMIC_RELEASE);
+}
+
+mempool_status mempool_retire(mempool_ebr_thread* thread, void* memory)
+{
+    ERROR_IF(thread, NULL, mempool_status_nullptr);
+    ERROR_IF(memory, NULL, mempool_status_nullptr);
+
+    for (;;) {
+        u64 epoch = __atomic_load_n(&thread->ebr->epoch, __ATOMIC_SEQ_CST);
+        (void)collect_buckets(thread, epoch);
+        u32 bucket = (u32)(epoch % MEMPOOL_EBR_EPOCHS);
+        if (0 == thread->bucket_counts[bucket]) {
+            thread->bucket_epochs[bucket] = epoch;
+        }
+        /* The bucket cannot hold blocks of an older epoch - those are at least three epochs old and collected above */
+        if (LIKELY(thread->bucket_counts[bucket] < MEMPOOL_EBR_BATCH)) {
+            thread->buckets[bucket][thread->bucket_counts[bucket]++] = memory;
+            return mempool_status_ok;
+        }
+
+        if (epoch == try_advance(thread->ebr)) {
+            /* Inside a critical section the thread may pin the epoch itself, so waiting could never end */
+            if (UNLIKELY(0 != thread->nesting)) {
+                return mempool_status_out_of_memory;
+            }
+            sched_yield();
+        }
+    }
+}
+
+size mempool_ebr_collect(mempool_ebr_thread* thread)
+{
+    ERROR_IF(thread, NULL, 0);
+
+    return collect_buckets(thread, try_advance(thread->ebr));
+}
@@ -0,0 +1,75 @@
+#include "mempool_maint.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------- Private data types ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Number of maintenance steps done between checks of the stop request */
+#define MAINT_BATCH 64
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Private functions ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Body of the maintenance thread */
+static void* maint_thread(void* arg)
+{
+    mempool_maint* maint = arg;
+    mempool_instance* pool = maint->pool;
+    mempool_ext* ext = mempool_ext_addr(pool);
+    while (0 == __atomic_load_n(&maint->stop, __ATOMIC_ACQUIRE)) {
+        /* Ask to be kicked before looking at the stocks, so a claim that drains them after the pass is not missed */
+        __atomic_store_n(&ext->maint_waiting, 1, __ATOMIC_SEQ_CST);
+        u32 seq = __atomic_load_n(&ext->maint_seq, __ATOMIC_SEQ_CST);
+
+        while (mempool_maintain(pool, MAINT_BATCH) && 0 == __atomic_load_n(&maint->stop, __ATOMIC_ACQUIRE)) {
+        }
+        __atomic_store_n(&maint->passes, maint->passes + 1, __ATOMIC_RELAXED);
+
+        if (0 == __atomic_load_n(&maint->stop, __ATOMIC_ACQUIRE)) {
+            if (pool->shared) {
+                (void)futex_wait_pshared(&ext->maint_seq, seq, maint->interval_ns);
+            } else {
+                (void)futex_wait(&ext->maint_seq, seq, maint->interval_ns);
+            }
+        }
+    }
+    __atomic_store_n(&ext->maint_waiting, 0, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+mempool_status mempool_maint_start(mempool_maint* maint, mempool_instance* pool, u64 interval_ns)
+{
+    ERROR_IF(maint, NULL, mempool_status_nullptr);
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(pool->thread_safe, false, mempool_status_not_supported);
+
+    maint->pool = pool;
+    maint->interval_ns = interval_ns;
+    maint->stop = 0;
+    maint->passes = 0;
+    if (UNLIKELY(0 != pthread_create(&maint->thread, NULL, maint_thread, maint))) {
+        return mempool_status_nok;
+    }
+    return mempool_status_ok;
+}
+
+mempool_status mempool_maint_stop(mempool_maint* maint)
+{
+    ERROR_IF(maint, NULL, mempool_status_nullptr);
+
+    mempool_ext* ext = mempool_ext_addr(maint->pool);
+    __atomic_store_n(&maint->stop, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&ext->maint_seq, 1, __ATOMIC_SEQ_CST);
+    if (maint->pool->shared) {
+        futex_wake_pshared(&ext->maint_seq);
+    } else {
+        futex_wake(&ext->maint_seq);
+    }
+    pthread_join(maint->thread, NULL);
+    return mempool_status_ok;
+}
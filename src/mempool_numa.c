@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+#include <linux/mempolicy.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "mempool_numa.h"
+#include "mempool_vm.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------- Private data types ------------------ */
+/* ------------------------------------------------------------ */
+
+/* File listing online NUMA nodes, e.g. "0-1,3" */
+#define NODES_ONLINE_PATH "/sys/devices/system/node/online"
+
+/* Number of bits in node mask passed to mbind() */
+#define NODE_MASK_BITS 64u
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Private functions ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Read identifiers of online nodes. Node 0 is assumed when the topology is not exposed */
+static u32 read_online_nodes(u32* ids)
+{
+    u32 cnt = 0;
+    FILE* file = fopen(NODES_ONLINE_PATH, "r");
+    if (NULL != file) {
+        unsigned first;
+        unsigned last;
+        int sep;
+        while (cnt < MEMPOOL_NUMA_NODES_MAX && 1 == fscanf(file, "%u", &first)) {
+            last = first;
+            sep = fgetc(file);
+            if ('-' == sep) {
+                if (1 != fscanf(file, "%u", &last)) {
+                    break;
+                }
+                sep = fgetc(file);
+            }
+            for (unsigned node = first; node <= last && cnt < MEMPOOL_NUMA_NODES_MAX; ++node) {
+                ids[cnt++] = node;
+            }
+            if (',' != sep) {
+                break;
+            }
+        }
+        fclose(file);
+    }
+    if (0 == cnt) {
+        ids[cnt++] = 0;
+    }
+    return cnt;
+}
+
+/* Prefer allocating pages of a range on the given node */
+static bool bind_to_node(void* addr, size len, u32 node)
+{
+    if (node >= NODE_MASK_BITS) {
+        return false;
+    }
+    unsigned long mask = 1ul << node;
+    return 0 == syscall(SYS_mbind, addr, len, MPOL_PREFERRED, &mask, NODE_MASK_BITS, MPOL_MF_MOVE);
+}
+
+/* Get index of the pool serving the node the calling thread runs on */
+static u32 local_index(const mempool_numa_set* set)
+{
+    unsigned cpu;
+    unsigned node;
+    if (1 == set->node_cnt || 0 != syscall(SYS_getcpu, &cpu, &node, NULL)) {
+        return 0;
+    }
+    for (u32 i = 0; i < set->node_cnt; ++i) {
+        if (set->node_ids[i] == node) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/* Implementation of mempool_prepare_fn. Memory of each pool is bound to its node before any page is faulted in */
+static void bind_pool(void* arg, u32 index, void* addr, size len)
+{
+    mempool_numa_set* set = arg;
+    if (!bind_to_node(addr, len, set->node_ids[index])) {
+        set->bound = false;
+    }
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+mempool_status mempool_numa_create(mempool_numa_set* set, size pool_size, u32 flags)
+{
+    ERROR_IF(set, NULL, mempool_status_nullptr);
+
+    set->node_cnt = 0;
+    set->bound = true;
+    u32 nodes = read_online_nodes(set->node_ids);
+
+    /* A single node does not need any policy */
+    mempool_status status = mempool_create_mapped_array(set->pools, nodes, pool_size, flags,
+                                                        (nodes > 1) ? bind_pool : NULL, set);
+    if (LIKELY(mempool_status_ok == status)) {
+        set->node_cnt = nodes;
+    }
+    return status;
+}
+
+mempool_status mempool_numa_destroy(mempool_numa_set* set)
+{
+    ERROR_IF(set, NULL, mempool_status_nullptr);
+    for (u32 i = 0; i < set->node_cnt; ++i) {
+        mempool_destroy(&set->pools[i]);
+    }
+    set->node_cnt = 0;
+    return mempool_status_ok;
+}
+
+mempool_status mempool_numa_claim(mempool_numa_set* set, size len, void** dst)
+{
+    ERROR_IF(set, NULL, mempool_status_nullptr);
+    ERROR_IF(set->node_cnt, 0, mempool_status_out_of_memory);
+
+    u32 local = local_index(set);
+    mempool_status status = mempool_claim_memory(&set->pools[local], len, dst);
+    if (LIKELY(mempool_status_out_of_memory != status)) {
+        return status;
+    }
+
+    /* Remote memory is better than no memory */
+    for (u32 i = 0; i < set->node_cnt; ++i) {
+        if (i != local) {
+            status = mempool_claim_memory(&set->pools[i], len, dst);
+            if (mempool_status_out_of_memory != status) {
+                break;
+            }
+        }
+    }
+    return status;
+}
+
+mempool_status mempool_numa_free(mempool_numa_set* set, void* memory)
+{
+    ERROR_IF(set, NULL, mempool_status_nullptr);
+    ERROR_IF(memory, NULL, mempool_status_nullptr);
+
+    u32 owner = mempool_numa_owner(set, memory);
+    ERROR_IF(owner, MEMPOOL_NUMA_NODES_MAX, mempool_status_inv_memory);
+    return mempool_free_memory(&set->pools[owner], memory);
+}
+
+u32 mempool_numa_owner(const mempool_numa_set* set, const void* memory)
+{
+    ERROR_IF(set, NULL, MEMPOOL_NUMA_NODES_MAX);
+    ERROR_IF(set->node_cnt, 0, MEMPOOL_NUMA_NODES_MAX);
+    u32 owner = mempool_mapped_array_owner(set->pools, set->node_cnt, memory);
+    return (owner == set->node_cnt) ? MEMPOOL_NUMA_NODES_MAX : owner;
+}
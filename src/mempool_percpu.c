@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <unistd.h>
+
+#include "mempool_percpu.h"
+#include "mempool_vm.h"
+
+#if defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define PERCPU_HAVE_RSEQ 1
+#endif
+#endif
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Private functions ------------------ */
+/* ------------------------------------------------------------ */
+
+#ifdef PERCPU_HAVE_RSEQ
+/* Get the rseq area of the calling thread. The C library registers it for every thread it creates */
+static inline const struct rseq* rseq_area(void)
+{
+    return (const struct rseq*)((const char*)__builtin_thread_pointer() + __rseq_offset);
+}
+#endif
+
+/* Check if CPU numbers may be read from the rseq area */
+static bool rseq_available(void)
+{
+#ifdef PERCPU_HAVE_RSEQ
+    /* A negative id means the area is not registered for the thread */
+    return 0 != __rseq_size && (i32)__atomic_load_n(&rseq_area()->cpu_id, __ATOMIC_RELAXED) >= 0;
+#else
+    return false;
+#endif
+}
+
+/* Get the CPU the calling thread runs on. The value may be stale as soon as it is read, which only costs locality */
+static inline int current_cpu(const mempool_percpu_set* set)
+{
+#ifdef PERCPU_HAVE_RSEQ
+    if (set->rseq) {
+        return (int)(i32)__atomic_load_n(&rseq_area()->cpu_id, __ATOMIC_RELAXED);
+    }
+#else
+    (void)set;
+#endif
+    return sched_getcpu();
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+mempool_status mempool_percpu_create(mempool_percpu_set* set, size pool_size, u32 flags)
+{
+    ERROR_IF(set, NULL, mempool_status_nullptr);
+
+    set->pool_cnt = 0;
+    set->rseq = rseq_available();
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    u32 pools = (cpus < 1) ? 1 : (cpus > MEMPOOL_PERCPU_MAX) ? MEMPOOL_PERCPU_MAX : (u32)cpus;
+
+    mempool_status status = mempool_create_mapped_array(set->pools, pools, pool_size, flags | MEMPOOL_MAP_THREAD_SAFE,
+                                                        NULL, NULL);
+    if (LIKELY(mempool_status_ok == status)) {
+        set->pool_cnt = pools;
+    }
+    return status;
+}
+
+mempool_status mempool_percpu_destroy(mempool_percpu_set* set)
+{
+    ERROR_IF(set, NULL, mempool_status_nullptr);
+    for (u32 i = 0; i < set->pool_cnt; ++i) {
+        mempool_destroy(&set->pools[i]);
+    }
+    set->pool_cnt = 0;
+    return mempool_status_ok;
+}
+
+u32 mempool_percpu_current(const mempool_percpu_set* set)
+{
+    ERROR_IF(set, NULL, 0);
+    int cpu = current_cpu(set);
+    return (cpu < 0 || 0 == set->pool_cnt) ? 0 : (u32)cpu % set->pool_cnt;
+}
+
+mempool_status mempool_percpu_claim(mempool_percpu_set* set, size len, void** dst)
+{
+    ERROR_IF(set, NULL, mempool_status_nullptr);
+    ERROR_IF(set->pool_cnt, 0, mempool_status_out_of_memory);
+
+    u32 local = mempool_percpu_current(set);
+    mempool_status status = mempool_claim_memory(&set->pools[local], len, dst);
+    if (LIKELY(mempool_status_out_of_memory != status)) {
+        return status;
+    }
+
+    /* Pools of other CPUs are tried in turn, starting from the next one to spread the load */
+    for (u32 i = 1; i < set->pool_cnt; ++i) {
+        status = mempool_claim_memory(&set->pools[(local + i) % set->pool_cnt], len, dst);
+        if (mempool_status_out_of_memory != status) {
+            break;
+        }
+    }
+    return status;
+}
+
+mempool_status mempool_percpu_free(mempool_percpu_set* set, void* memory)
+{
+    ERROR_IF(set, NULL, mempool_status_nullptr);
+    ERROR_IF(memory, NULL, mempool_status_nullptr);
+
+    u32 owner = mempool_percpu_owner(set, memory);
+    ERROR_IF(owner, MEMPOOL_PERCPU_MAX, mempool_status_inv_memory);
+    return mempool_free_memory(&set->pools[owner], memory);
+}
+
+u32 mempool_percpu_owner(const mempool_percpu_set* set, const void* memory)
+{
+    ERROR_IF(set, NULL, MEMPOOL_PERCPU_MAX);
+    ERROR_IF(set->pool_cnt, 0, MEMPOOL_PERCPU_MAX);
+    u32 owner = mempool_mapped_array_owner(set->pools, set->pool_cnt, memory);
+    return (owner == set->pool_cnt) ? MEMPOOL_PERCPU_MAX : owner;
+}
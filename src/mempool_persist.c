@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mempool_persist.h"
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Private functions ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Round a length up to whole pages */
+static inline size page_round(size len)
+{
+    size page_size = (size)sysconf(_SC_PAGESIZE);
+    return (len + page_size - 1) & ~(page_size - 1);
+}
+
+/* Lay out a new pool in an empty file */
+static mempool_status create_pool(mempool_shm* shm, int fd, size pool_size)
+{
+    if (UNLIKELY(0 == pool_size || 0 != (pool_size & (pool_size - 1)) || (u64)pool_size > ((u64)1 << 32))) {
+        return mempool_status_size_err;
+    }
+    size instance_len = page_round(sizeof(mempool_instance));
+    size log_len = page_round(mempool_calc_undo_log_size());
+    size map_len = instance_len + log_len + pool_size;
+    ERROR_IF(ftruncate(fd, (off_t)map_len), -1, mempool_status_out_of_memory);
+    char* map_addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ERROR_IF(map_addr, MAP_FAILED, mempool_status_out_of_memory);
+
+    mempool_instance* pool = (mempool_instance*)map_addr;
+    pool->base_addr = map_addr + instance_len + log_len;
+    pool->size = pool_size;
+    mempool_config config;
+    mempool_default_config(&config);
+    config.hdr_type = (pool_size <= ((size)1 << 16)) ? mempool_hdr_off16 : mempool_hdr_off32;
+    config.shared = true;
+    config.undo_log = map_addr + instance_len;
+    config.undo_log_len = log_len;
+    mempool_status status = mempool_init_ex(pool, &config);
+    if (UNLIKELY(mempool_status_ok != status)) {
+        munmap(map_addr, map_len);
+        return status;
+    }
+
+    shm->map_addr = map_addr;
+    shm->map_len = map_len;
+    shm->pool = pool;
+    return mempool_status_ok;
+}
+
+/* Map a file holding a pool and roll back the operation interrupted by a crash */
+static mempool_status reopen_pool(mempool_shm* shm, int fd, size file_len, size* undone)
+{
+    size instance_len = page_round(sizeof(mempool_instance));
+    size log_len = page_round(mempool_calc_undo_log_size());
+    ERROR_IF(file_len > instance_len + log_len, false, mempool_status_inv_memory);
+    char* map_addr = mmap(NULL, file_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ERROR_IF(map_addr, MAP_FAILED, mempool_status_out_of_memory);
+
+    /* The instance has to describe a buffer filling the rest of the file */
+    mempool_instance* pool = (mempool_instance*)map_addr;
+    mempool_status status = mempool_status_inv_memory;
+    if (pool->shared && instance_len == pool->log_off && instance_len + log_len == pool->base_off &&
+        pool->base_off + pool->size == file_len) {
+        status = mempool_recover(pool, undone);
+    }
+    if (UNLIKELY(mempool_status_ok != status)) {
+        munmap(map_addr, file_len);
+        return status;
+    }
+
+    shm->map_addr = map_addr;
+    shm->map_len = file_len;
+    shm->pool = pool;
+    return mempool_status_ok;
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+mempool_status mempool_persist_open(mempool_shm* shm, int fd, size pool_size, size* undone)
+{
+    ERROR_IF(shm, NULL, mempool_status_nullptr);
+
+    struct stat st;
+    ERROR_IF(fstat(fd, &st), -1, mempool_status_inv_memory);
+    if (0 == st.st_size) {
+        if (NULL != undone) {
+            *undone = 0;
+        }
+        return create_pool(shm, fd, pool_size);
+    }
+    return reopen_pool(shm, fd, (size)st.st_size, undone);
+}
+
+mempool_status mempool_persist_sync(const mempool_shm* shm)
+{
+    ERROR_IF(shm, NULL, mempool_status_nullptr);
+    ERROR_IF(msync(shm->map_addr, shm->map_len, MS_SYNC), -1, mempool_status_nok);
+    return mempool_status_ok;
+}
@@ -0,0 +1,92 @@
+#include <pthread.h>
+
+#include "mempool_shard.h"
+#include "bit.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------- Private data types ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Multiplier of Fibonacci hashing - spreads thread identifiers, which are usually aligned, over all shards */
+#define SHARD_HASH_MUL 0x9E3779B97F4A7C15ull
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+mempool_status mempool_shard_init(mempool_sharded* pool, u32 shard_cnt, const mempool_config* config)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(config, NULL, mempool_status_nullptr);
+    ERROR_IF(pool->base_addr, NULL, mempool_status_nullptr);
+
+    /* Shards are thread-safe, each one needs its own extended state */
+    pool->shard_cnt = 0;
+    ERROR_IF(config->ext, NULL, mempool_status_not_supported);
+    if (UNLIKELY(0 == shard_cnt || shard_cnt > MEMPOOL_SHARDS_MAX || (shard_cnt & (shard_cnt - 1)))) {
+        return mempool_status_size_err;
+    }
+    if (UNLIKELY(0 == pool->size || (pool->size & (pool->size - 1)) || pool->size < shard_cnt)) {
+        return mempool_status_size_err;
+    }
+
+    mempool_config shard_config = *config;
+    shard_config.thread_safe = true;
+    size shard_size = pool->size / shard_cnt;
+    for (u32 i = 0; i < shard_cnt; ++i) {
+        mempool_instance* shard = &pool->shards[i];
+        shard->base_addr = pool->base_addr + i * shard_size;
+        shard->size = shard_size;
+        shard_config.ext = config->ext + i;
+        mempool_status status = mempool_init_ex(shard, &shard_config);
+        if (UNLIKELY(mempool_status_ok != status)) {
+            return status;
+        }
+    }
+    pool->shard_shift = BIT_64_CTZ(shard_size);
+    pool->shard_cnt = shard_cnt;
+    return mempool_status_ok;
+}
+
+u32 mempool_shard_current(const mempool_sharded* pool)
+{
+    ERROR_IF(pool, NULL, 0);
+    if (pool->shard_cnt <= 1) {
+        return 0;
+    }
+    u64 hash = (u64)(uintptr_t)pthread_self() * SHARD_HASH_MUL;
+    return (u32)(hash >> (64 - BIT_64_CTZ(pool->shard_cnt)));
+}
+
+mempool_status mempool_shard_claim(mempool_sharded* pool, size len, void** dst)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(pool->shard_cnt, 0, mempool_status_out_of_memory);
+
+    u32 local = mempool_shard_current(pool);
+    mempool_status status = mempool_claim_memory(&pool->shards[local], len, dst);
+    for (u32 i = 1; mempool_status_out_of_memory == status && i < pool->shard_cnt; ++i) {
+        status = mempool_claim_memory(&pool->shards[(local + i) & (pool->shard_cnt - 1)], len, dst);
+    }
+    return status;
+}
+
+mempool_status mempool_shard_free(mempool_sharded* pool, void* memory)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+    ERROR_IF(memory, NULL, mempool_status_nullptr);
+
+    u32 shard = mempool_shard_of(pool, memory);
+    ERROR_IF(shard, MEMPOOL_SHARDS_MAX, mempool_status_inv_memory);
+    return mempool_free_memory(&pool->shards[shard], memory);
+}
+
+u32 mempool_shard_of(const mempool_sharded* pool, const void* memory)
+{
+    ERROR_IF(pool, NULL, MEMPOOL_SHARDS_MAX);
+    const char* addr = memory;
+    if (0 == pool->shard_cnt || addr < pool->base_addr || addr >= pool->base_addr + pool->size) {
+        return MEMPOOL_SHARDS_MAX;
+    }
+    return (u32)((size)(addr - pool->base_addr) >> pool->shard_shift);
+}
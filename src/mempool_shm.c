@@ -0,0 +1,117 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mempool_shm.h"
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Private functions ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Length of the segment part holding the pool instance and its extended state. The buffer starts on the next page
+ * boundary */
+static size instance_area_len(void)
+{
+    size page_size = (size)sysconf(_SC_PAGESIZE);
+    return (sizeof(mempool_instance) + sizeof(mempool_ext) + page_size - 1) & ~(page_size - 1);
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+mempool_status mempool_shm_create(mempool_shm* shm, int fd, size pool_size)
+{
+    ERROR_IF(shm, NULL, mempool_status_nullptr);
+    if (UNLIKELY(0 == pool_size || 0 != (pool_size & (pool_size - 1)) || (u64)pool_size > ((u64)1 << 32))) {
+        return mempool_status_size_err;
+    }
+
+    size area_len = instance_area_len();
+    size map_len = area_len + pool_size;
+    ERROR_IF(ftruncate(fd, (off_t)map_len), -1, mempool_status_out_of_memory);
+    void* map_addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ERROR_IF(map_addr, MAP_FAILED, mempool_status_out_of_memory);
+
+    mempool_instance* pool = map_addr;
+    pool->base_addr = (char*)map_addr + area_len;
+    pool->size = pool_size;
+    mempool_config config;
+    mempool_default_config(&config);
+    config.hdr_type = (pool_size <= ((size)1 << 16)) ? mempool_hdr_off16 : mempool_hdr_off32;
+    config.thread_safe = true;
+    config.shared = true;
+    config.ext = (mempool_ext*)((char*)map_addr + sizeof(mempool_instance));
+    mempool_status status = mempool_init_ex(pool, &config);
+    if (UNLIKELY(mempool_status_ok != status)) {
+        munmap(map_addr, map_len);
+        return status;
+    }
+
+    shm->map_addr = map_addr;
+    shm->map_len = map_len;
+    shm->pool = pool;
+    return mempool_status_ok;
+}
+
+mempool_status mempool_shm_attach(mempool_shm* shm, int fd)
+{
+    ERROR_IF(shm, NULL, mempool_status_nullptr);
+
+    struct stat st;
+    ERROR_IF(fstat(fd, &st), -1, mempool_status_inv_memory);
+    size area_len = instance_area_len();
+    ERROR_IF((size)st.st_size > area_len, false, mempool_status_inv_memory);
+
+    size map_len = (size)st.st_size;
+    void* map_addr = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ERROR_IF(map_addr, MAP_FAILED, mempool_status_out_of_memory);
+
+    /* The instance has to describe a buffer filling the rest of the segment */
+    mempool_instance* pool = map_addr;
+    if (UNLIKELY(!pool->shared || area_len != pool->base_off || area_len + pool->size != map_len)) {
+        munmap(map_addr, map_len);
+        return mempool_status_inv_memory;
+    }
+
+    shm->map_addr = map_addr;
+    shm->map_len = map_len;
+    shm->pool = pool;
+    return mempool_status_ok;
+}
+
+mempool_status mempool_shm_detach(mempool_shm* shm)
+{
+    ERROR_IF(shm, NULL, mempool_status_nullptr);
+
+    if (NULL != shm->map_addr) {
+        munmap(shm->map_addr, shm->map_len);
+    }
+    shm->map_addr = NULL;
+    shm->map_len = 0;
+    shm->pool = NULL;
+    return mempool_status_ok;
+}
+
+u64 mempool_shm_offset(const mempool_shm* shm, const void* memory)
+{
+    ERROR_IF(shm, NULL, MEMPOOL_SHM_OFFSET_NULL);
+    ERROR_IF(memory, NULL, MEMPOOL_SHM_OFFSET_NULL);
+
+    const char* mem = memory;
+    if (UNLIKELY(mem < shm->map_addr || mem >= shm->map_addr + shm->map_len)) {
+        return MEMPOOL_SHM_OFFSET_NULL;
+    }
+    return (u64)(mem - shm->map_addr);
+}
+
+void* mempool_shm_pointer(const mempool_shm* shm, u64 offset)
+{
+    ERROR_IF(shm, NULL, NULL);
+
+    if (UNLIKELY(offset >= (u64)shm->map_len)) {
+        return NULL;
+    }
+    return shm->map_addr + offset;
+}
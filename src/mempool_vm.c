@@ -0,0 +1,617 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mempool_vm.h"
+#include "bit.h"
+#include "futex_lock.h"
+
+/* ------------------------------------------------------------ */
+/* ---------------------- Private data types ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Magic number identifying backing descriptors created by this module */
+#define BACKING_MAGIC 0x564D4D50u
+
+/* Number of pages tracked by a single word of commit map */
+#define PAGES_PER_WORD 64u
+
+/* Backing descriptor. It lives in its own anonymous mapping, so the pool buffer keeps its power-of-two size */
+typedef struct vm_backing_
+{
+    u32 magic;
+    u32 page_shift;
+    mempool_map_backing map_backing; /* Backing of mapped pools */
+    char* map_addr; /* Address of the pool mapping */
+    size map_len; /* Length of the pool mapping */
+    size desc_len; /* Length of the mapping holding this descriptor */
+    size committed; /* Number of committed bytes */
+    futex_lock direct_lock; /* Lock of the table of direct mappings */
+    u32 direct_cnt; /* Number of live direct mappings */
+    mempool_region direct_maps[MEMPOOL_DIRECT_MAPS_MAX]; /* Live direct mappings */
+    mempool_ext ext; /* Extended state of the pool */
+    u64 commit_map[]; /* Bit set for each committed page. Only used by reserved pools */
+} vm_backing;
+
+/* Maximum number of threads used by mempool_prefault() */
+#define PREFAULT_THREADS_MAX 64u
+
+/* Chunk of memory touched by a single prefault thread */
+typedef struct prefault_chunk_
+{
+    char* addr;
+    size len;
+    size page_size;
+} prefault_chunk;
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Private functions ------------------ */
+/* ------------------------------------------------------------ */
+
+/* Map anonymous memory. NULL is returned on failure */
+static void* map_anonymous(size len, int prot)
+{
+    void* addr = mmap(NULL, len, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return (MAP_FAILED == addr) ? NULL : addr;
+}
+
+/* Map anonymous memory aligned to 'align' bytes. The excess is unmapped afterwards */
+static void* map_aligned(size len, size align, int extra_flags)
+{
+    size over_len = len + align;
+    char* addr = mmap(NULL, over_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+    if (UNLIKELY(MAP_FAILED == addr)) {
+        return NULL;
+    }
+    char* aligned = (char*)(((uintptr_t)addr + align - 1) & ~((uintptr_t)align - 1));
+    if (aligned > addr) {
+        munmap(addr, (size)(aligned - addr));
+    }
+    munmap(aligned + len, (size)(addr + over_len - (aligned + len)));
+    return aligned;
+}
+
+/* Touch every page of a chunk. Adding zero atomically forces a write fault without changing page content */
+static void* touch_pages(void* arg)
+{
+    const prefault_chunk* chunk = arg;
+    for (size off = 0; off < chunk->len; off += chunk->page_size) {
+        __atomic_fetch_add(chunk->addr + off, 0, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/* Let the kernel fault in a range. Pages are touched one by one when it is not supported */
+static void populate_range(char* addr, size len, size page_size)
+{
+#ifdef MADV_POPULATE_WRITE
+    if (0 == madvise(addr, len, MADV_POPULATE_WRITE)) {
+        return;
+    }
+#endif
+    prefault_chunk chunk = {addr, len, page_size};
+    touch_pages(&chunk);
+}
+
+/* Map memory of pools 'pool_len' bytes long according to MEMPOOL_MAP_* flags and store the backing obtained. Pages
+ * are not faulted in */
+static void* map_pool_memory(size len, size pool_len, u32 flags, mempool_map_backing* backing)
+{
+    /* Huge page mappings are naturally aligned to the huge page size */
+    if (flags & MEMPOOL_MAP_HUGETLB) {
+        if (0 == pool_len % MEMPOOL_MAP_ALIGNMENT) {
+            void* addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (MAP_FAILED != addr) {
+                *backing = mempool_map_backing_hugetlb;
+                return addr;
+            }
+        }
+        if (!(flags & MEMPOOL_MAP_THP)) {
+            return NULL;
+        }
+    }
+
+    void* addr = map_aligned(len, MEMPOOL_MAP_ALIGNMENT, 0);
+    if (UNLIKELY(NULL == addr)) {
+        return NULL;
+    }
+    *backing = mempool_map_backing_pages;
+    if ((flags & MEMPOOL_MAP_THP) && 0 == madvise(addr, len, MADV_HUGEPAGE)) {
+        *backing = mempool_map_backing_thp;
+    }
+    return addr;
+}
+
+/* Allocate backing descriptor with commit map large enough to track 'pages' pages */
+static vm_backing* create_backing(size pages)
+{
+    size words = (pages + PAGES_PER_WORD - 1) / PAGES_PER_WORD;
+    size desc_len = sizeof(vm_backing) + words * sizeof(u64);
+
+    /* The map is zeroed by the OS and its pages are faulted in only when the pool touches related pages */
+    vm_backing* vm = map_anonymous(desc_len, PROT_READ | PROT_WRITE);
+    if (NULL != vm) {
+        vm->magic = BACKING_MAGIC;
+        vm->desc_len = desc_len;
+        futex_lock_init(&vm->direct_lock);
+    }
+    return vm;
+}
+
+static inline bool page_committed(const vm_backing* vm, size page)
+{
+    u64 word = __atomic_load_n(&vm->commit_map[page / PAGES_PER_WORD], __ATOMIC_ACQUIRE);
+    return BIT_64_IS_SET(word, page % PAGES_PER_WORD);
+}
+
+/* Mark pages as committed and update the counter with pages that were not marked before */
+static void mark_committed(vm_backing* vm, size first, size last)
+{
+    size newly_committed = 0;
+    for (size page = first; page <= last;) {
+        u32 bit = (u32)(page % PAGES_PER_WORD);
+        u32 bits = (u32)((last - page + 1 < PAGES_PER_WORD - bit) ? (last - page + 1) : (PAGES_PER_WORD - bit));
+        u64 mask = (64 == bits) ? UINT64_MAX : ((BIT_64_GET_AT_POS(bits) - 1) << bit);
+        u64 old = __atomic_fetch_or(&vm->commit_map[page / PAGES_PER_WORD], mask, __ATOMIC_RELEASE);
+        newly_committed += (size)__builtin_popcountll(mask & ~old);
+        page += bits;
+    }
+    __atomic_fetch_add(&vm->committed, newly_committed << vm->page_shift, __ATOMIC_RELAXED);
+}
+
+/* Implementation of mempool_commit_fn for reserved pools */
+static bool commit_impl(void* backing, void* addr, size len)
+{
+    vm_backing* vm = backing;
+    char* start = addr;
+
+    /* Memory outside the reservation (e.g. extra regions) is always accessible */
+    if (start < vm->map_addr || start >= vm->map_addr + vm->map_len) {
+        return true;
+    }
+
+    size first = (size)(start - vm->map_addr) >> vm->page_shift;
+    size last = (size)(start + len - 1 - vm->map_addr) >> vm->page_shift;
+    size page = first;
+    while (page <= last) {
+        /* Skip fully committed words quickly - large partitions are typically reused */
+        if (0 == page % PAGES_PER_WORD && page + PAGES_PER_WORD - 1 <= last &&
+            UINT64_MAX == __atomic_load_n(&vm->commit_map[page / PAGES_PER_WORD], __ATOMIC_ACQUIRE)) {
+            page += PAGES_PER_WORD;
+            continue;
+        }
+        if (page_committed(vm, page)) {
+            page++;
+            continue;
+        }
+
+        /* Commit the whole run of uncommitted pages with a single call */
+        size run_end = page;
+        while (run_end < last && !page_committed(vm, run_end + 1)) {
+            run_end++;
+        }
+        char* run_addr = vm->map_addr + (page << vm->page_shift);
+        size run_len = (run_end - page + 1) << vm->page_shift;
+        if (UNLIKELY(0 != mprotect(run_addr, run_len, PROT_READ | PROT_WRITE))) {
+            return false;
+        }
+        mark_committed(vm, page, run_end);
+        page = run_end + 1;
+    }
+    return true;
+}
+
+/* Clear commit bits of pages and update the counter with pages that were marked before */
+static void mark_decommitted(vm_backing* vm, size first, size last)
+{
+    size decommitted = 0;
+    for (size page = first; page <= last;) {
+        u32 bit = (u32)(page % PAGES_PER_WORD);
+        u32 bits = (u32)((last - page + 1 < PAGES_PER_WORD - bit) ? (last - page + 1) : (PAGES_PER_WORD - bit));
+        u64 mask = (64 == bits) ? UINT64_MAX : ((BIT_64_GET_AT_POS(bits) - 1) << bit);
+        u64 old = __atomic_fetch_and(&vm->commit_map[page / PAGES_PER_WORD], ~mask, __ATOMIC_RELEASE);
+        decommitted += (size)__builtin_popcountll(mask & old);
+        page += bits;
+    }
+    __atomic_fetch_sub(&vm->committed, decommitted << vm->page_shift, __ATOMIC_RELAXED);
+}
+
+/* Zero edges of a range and find its page-aligned interior. False is returned when there is no whole page inside */
+static bool page_interior(size page_size, char* addr, size len, char** first, char** last)
+{
+    char* start = (char*)(((uintptr_t)addr + page_size - 1) & ~((uintptr_t)page_size - 1));
+    char* end = (char*)(((uintptr_t)addr + len) & ~((uintptr_t)page_size - 1));
+    if (start >= end || start < addr) {
+        return false;
+    }
+    memset(addr, 0, (size)(start - addr));
+    memset(end, 0, (size)(addr + len - end));
+    *first = start;
+    *last = end;
+    return true;
+}
+
+/* Implementation of mempool_release_fn for reserved pools. Released pages are decommitted as well */
+static bool release_impl(void* backing, void* addr, size len)
+{
+    vm_backing* vm = backing;
+    char* start = addr;
+
+    /* Memory outside the reservation is handled as a plain anonymous memory */
+    if (start < vm->map_addr || start >= vm->map_addr + vm->map_len) {
+        return mempool_release_pages(NULL, addr, len);
+    }
+
+    char* first;
+    char* last;
+    if (!page_interior((size)1 << vm->page_shift, start, len, &first, &last)) {
+        return false;
+    }
+    /* Mapping the pages again drops their content and makes them inaccessible in a single call */
+    void* remapped = mmap(first, (size)(last - first), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+                          MAP_FIXED, -1, 0);
+    if (UNLIKELY(MAP_FAILED == remapped)) {
+        return false;
+    }
+    mark_decommitted(vm, (size)(first - vm->map_addr) >> vm->page_shift,
+                     ((size)(last - vm->map_addr) >> vm->page_shift) - 1);
+    return true;
+}
+
+/* Find entry of a direct mapping. NULL is returned when it is not there. The table has to be locked */
+static mempool_region* direct_find(vm_backing* vm, const void* addr)
+{
+    for (u32 i = 0; i < vm->direct_cnt; ++i) {
+        if (vm->direct_maps[i].base_addr == addr) {
+            return &vm->direct_maps[i];
+        }
+    }
+    return NULL;
+}
+
+/* Check if memory lies inside an extra region or a direct mapping of a pool */
+static bool pool_owns_extra(const mempool_instance* pool, const char* memory)
+{
+    for (u16 i = 1; i < pool->region_cnt; ++i) {
+        const mempool_region* region = &pool->regions[i - 1];
+        if (memory >= region->base_addr && memory < region->base_addr + region->size) {
+            return true;
+        }
+    }
+    return mempool_direct_owns(pool, memory);
+}
+
+/* Create a direct mapping and store it in the table */
+static mempool_status direct_map(vm_backing* vm, void** addr, size map_len)
+{
+    /* The counter is read without the lock as a hint, so a full table does not cost a system call */
+    if (UNLIKELY(MEMPOOL_DIRECT_MAPS_MAX == __atomic_load_n(&vm->direct_cnt, __ATOMIC_RELAXED))) {
+        return mempool_status_out_of_memory;
+    }
+    char* map = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (UNLIKELY(MAP_FAILED == map)) {
+        return mempool_status_out_of_memory;
+    }
+
+    /* The table may have been filled up in the meantime */
+    futex_lock_acquire(&vm->direct_lock);
+    bool stored = vm->direct_cnt < MEMPOOL_DIRECT_MAPS_MAX;
+    if (stored) {
+        vm->direct_maps[vm->direct_cnt].base_addr = map;
+        vm->direct_maps[vm->direct_cnt].size = map_len;
+        __atomic_store_n(&vm->direct_cnt, vm->direct_cnt + 1, __ATOMIC_RELAXED);
+    }
+    futex_lock_release(&vm->direct_lock);
+    if (UNLIKELY(!stored)) {
+        munmap(map, map_len);
+        return mempool_status_out_of_memory;
+    }
+    *addr = map;
+    return mempool_status_ok;
+}
+
+/* Resize a direct mapping or unmap it when the new length is zero */
+static mempool_status direct_remap(vm_backing* vm, void** addr, size map_len)
+{
+    futex_lock_acquire(&vm->direct_lock);
+    mempool_region* entry = direct_find(vm, *addr);
+    if (UNLIKELY(NULL == entry)) {
+        futex_lock_release(&vm->direct_lock);
+        return mempool_status_inv_memory;
+    }
+
+    if (0 == map_len) {
+        mempool_region map = *entry;
+        __atomic_store_n(&vm->direct_cnt, vm->direct_cnt - 1, __ATOMIC_RELAXED);
+        *entry = vm->direct_maps[vm->direct_cnt];
+        futex_lock_release(&vm->direct_lock);
+        munmap(map.base_addr, map.size);
+        return mempool_status_ok;
+    }
+
+    /* Let the kernel move page table entries instead of copying the content */
+    char* remapped = mremap(entry->base_addr, entry->size, map_len, MREMAP_MAYMOVE);
+    if (MAP_FAILED != remapped) {
+        entry->base_addr = remapped;
+        entry->size = map_len;
+    }
+    futex_lock_release(&vm->direct_lock);
+    ERROR_IF(remapped, MAP_FAILED, mempool_status_out_of_memory);
+    *addr = remapped;
+    return mempool_status_ok;
+}
+
+/* Implementation of mempool_direct_fn. Mappings are tracked, so frees can be validated and mappings still live are
+ * unmapped together with the pool */
+static mempool_status direct_impl(void* backing, void** addr, size* len)
+{
+    vm_backing* vm = backing;
+    size page_size = (size)1 << vm->page_shift;
+    if (UNLIKELY(*len > (size)-1 - page_size)) {
+        return mempool_status_out_of_memory;
+    }
+    size map_len = (*len + page_size - 1) & ~(page_size - 1);
+    mempool_status status = (NULL == *addr) ? direct_map(vm, addr, map_len) : direct_remap(vm, addr, map_len);
+    if (LIKELY(mempool_status_ok == status)) {
+        *len = map_len;
+    }
+    return status;
+}
+
+/* ------------------------------------------------------------ */
+/* ----------------------- Public functions ------------------- */
+/* ------------------------------------------------------------ */
+
+mempool_status mempool_create_reserved(mempool_instance* pool, size reserve_size)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+
+    size page_size = (size)sysconf(_SC_PAGESIZE);
+    if (UNLIKELY(0 == reserve_size || (reserve_size & (reserve_size - 1)) || reserve_size < page_size)) {
+        return mempool_status_size_err;
+    }
+
+    vm_backing* vm = create_backing(reserve_size / page_size);
+    ERROR_IF(vm, NULL, mempool_status_out_of_memory);
+    vm->page_shift = BIT_64_CTZ(page_size);
+    vm->map_len = reserve_size;
+    vm->map_addr = map_anonymous(reserve_size, PROT_NONE);
+    if (UNLIKELY(NULL == vm->map_addr)) {
+        munmap(vm, vm->desc_len);
+        return mempool_status_out_of_memory;
+    }
+
+    mempool_config config;
+    mempool_default_config(&config);
+    config.commit_fn = commit_impl;
+    config.release_fn = release_impl;
+    config.direct_fn = direct_impl;
+    config.backing = vm;
+    config.ext = &vm->ext;
+
+    pool->base_addr = vm->map_addr;
+    pool->size = reserve_size;
+    mempool_status status = mempool_init_ex(pool, &config);
+    if (UNLIKELY(mempool_status_ok != status)) {
+        munmap(vm->map_addr, vm->map_len);
+        munmap(vm, vm->desc_len);
+    }
+    return status;
+}
+
+mempool_status mempool_create_mapped(mempool_instance* pool, size len, u32 flags)
+{
+    return mempool_create_mapped_array(pool, 1, len, flags, NULL, NULL);
+}
+
+mempool_status mempool_create_mapped_array(mempool_instance* pools, u32 cnt, size len, u32 flags,
+                                           mempool_prepare_fn prepare, void* arg)
+{
+    ERROR_IF(pools, NULL, mempool_status_nullptr);
+
+    size page_size = (size)sysconf(_SC_PAGESIZE);
+    if (UNLIKELY(0 == cnt || 0 == len || (len & (len - 1)) || len < page_size || len > (size)-1 / cnt)) {
+        return mempool_status_size_err;
+    }
+
+    mempool_map_backing map_backing;
+    char* addr = map_pool_memory(cnt * len, len, flags, &map_backing);
+    ERROR_IF(addr, NULL, mempool_status_out_of_memory);
+    for (u32 i = 0; NULL != prepare && i < cnt; ++i) {
+        prepare(arg, i, addr + i * len, len);
+    }
+
+    /* Populate only after the memory is prepared and the advice is applied, so policies and transparent huge pages
+     * are used for the faults */
+    if (flags & MEMPOOL_MAP_POPULATE) {
+        populate_range(addr, cnt * len, page_size);
+    }
+
+    /* Each pool gets its own descriptor covering its part of the mapping, so pools may be destroyed one by one */
+    for (u32 i = 0; i < cnt; ++i) {
+        mempool_status status = mempool_status_out_of_memory;
+        vm_backing* vm = create_backing(0);
+        if (LIKELY(NULL != vm)) {
+            vm->page_shift = BIT_64_CTZ(page_size);
+            vm->map_backing = map_backing;
+            vm->map_addr = addr + i * len;
+            vm->map_len = len;
+
+            mempool_config config;
+            mempool_default_config(&config);
+            /* Huge pages cannot be released partially */
+            if (mempool_map_backing_hugetlb != map_backing) {
+                config.release_fn = mempool_release_pages;
+            }
+            config.direct_fn = direct_impl;
+            config.backing = vm;
+            config.ext = &vm->ext;
+            config.thread_safe = (0 != (flags & MEMPOOL_MAP_THREAD_SAFE));
+            pools[i].base_addr = vm->map_addr;
+            pools[i].size = len;
+            status = mempool_init_ex(&pools[i], &config);
+            if (UNLIKELY(mempool_status_ok != status)) {
+                munmap(vm, vm->desc_len);
+            }
+        }
+        if (UNLIKELY(mempool_status_ok != status)) {
+            for (u32 created = 0; created < i; ++created) {
+                mempool_destroy(&pools[created]);
+            }
+            munmap(addr + i * len, (cnt - i) * len);
+            return status;
+        }
+    }
+    return mempool_status_ok;
+}
+
+mempool_map_backing mempool_map_backing_get(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, mempool_map_backing_none);
+    const vm_backing* vm = pool->backing;
+    if (NULL == vm || BACKING_MAGIC != vm->magic) {
+        return mempool_map_backing_none;
+    }
+    return vm->map_backing;
+}
+
+mempool_status mempool_prefault(mempool_instance* pool, u32 threads)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+
+    if (0 == threads) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? (u32)cpus : 1;
+    }
+    threads = (threads > PREFAULT_THREADS_MAX) ? PREFAULT_THREADS_MAX : threads;
+    size page_size = (size)sysconf(_SC_PAGESIZE);
+
+    for (u16 region = 0; region < pool->region_cnt; ++region) {
+        char* addr = (0 == region) ? pool->base_addr : pool->regions[region - 1].base_addr;
+        size len = (0 == region) ? pool->size : pool->regions[region - 1].size;
+        if (NULL != pool->commit_fn && UNLIKELY(!pool->commit_fn(pool->backing, addr, len))) {
+            return mempool_status_out_of_memory;
+        }
+
+        /* Chunks are page-aligned, the last one takes the remainder */
+        size pages = (len + page_size - 1) / page_size;
+        u32 chunk_cnt = (pages < threads) ? (u32)pages : threads;
+        size chunk_pages = pages / chunk_cnt;
+        prefault_chunk chunks[PREFAULT_THREADS_MAX];
+        pthread_t tids[PREFAULT_THREADS_MAX];
+        bool started[PREFAULT_THREADS_MAX];
+        for (u32 i = 0; i < chunk_cnt; ++i) {
+            chunks[i].addr = addr + i * chunk_pages * page_size;
+            chunks[i].len = (i + 1 == chunk_cnt) ? (size)(addr + len - chunks[i].addr) : chunk_pages * page_size;
+            chunks[i].page_size = page_size;
+            /* The calling thread takes the first chunk itself */
+            started[i] = (0 != i) && (0 == pthread_create(&tids[i], NULL, touch_pages, &chunks[i]));
+        }
+        for (u32 i = 0; i < chunk_cnt; ++i) {
+            if (started[i]) {
+                pthread_join(tids[i], NULL);
+            } else {
+                touch_pages(&chunks[i]);
+            }
+        }
+    }
+    return mempool_status_ok;
+}
+
+size mempool_committed_bytes(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, 0);
+    if (commit_impl != pool->commit_fn) {
+        return 0;
+    }
+    const vm_backing* vm = pool->backing;
+    return __atomic_load_n(&vm->committed, __ATOMIC_RELAXED);
+}
+
+u32 mempool_direct_maps(const mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, 0);
+    if (direct_impl != pool->direct_fn) {
+        return 0;
+    }
+    const vm_backing* vm = pool->backing;
+    return __atomic_load_n(&vm->direct_cnt, __ATOMIC_RELAXED);
+}
+
+bool mempool_direct_owns(const mempool_instance* pool, const void* memory)
+{
+    ERROR_IF(pool, NULL, false);
+    if (direct_impl != pool->direct_fn || 0 == mempool_direct_maps(pool)) {
+        return false;
+    }
+
+    vm_backing* vm = pool->backing;
+    const char* addr = memory;
+    bool owned = false;
+    futex_lock_acquire(&vm->direct_lock);
+    for (u32 i = 0; i < vm->direct_cnt && !owned; ++i) {
+        const mempool_region* map = &vm->direct_maps[i];
+        owned = addr >= map->base_addr && addr < map->base_addr + map->size;
+    }
+    futex_lock_release(&vm->direct_lock);
+    return owned;
+}
+
+u32 mempool_mapped_array_owner(const mempool_instance* pools, u32 cnt, const void* memory)
+{
+    ERROR_IF(pools, NULL, cnt);
+    ERROR_IF(cnt, 0, 0);
+
+    /* Pool buffers lie back to back in a single mapping. Addresses below it wrap around to large offsets */
+    uintptr_t off = (uintptr_t)memory - (uintptr_t)pools[0].base_addr;
+    if (LIKELY(off < (uintptr_t)pools[0].size * cnt)) {
+        return (u32)(off >> BIT_64_CTZ(pools[0].size));
+    }
+    for (u32 i = 0; i < cnt; ++i) {
+        if (pool_owns_extra(&pools[i], memory)) {
+            return i;
+        }
+    }
+    return cnt;
+}
+
+mempool_status mempool_destroy(mempool_instance* pool)
+{
+    ERROR_IF(pool, NULL, mempool_status_nullptr);
+
+    vm_backing* vm = pool->backing;
+    if (UNLIKELY(NULL == vm || BACKING_MAGIC != vm->magic)) {
+        return mempool_status_not_supported;
+    }
+
+    /* Direct mappings are owned by the pool as well */
+    for (u32 i = 0; i < vm->direct_cnt; ++i) {
+        munmap(vm->direct_maps[i].base_addr, vm->direct_maps[i].size);
+    }
+
+    munmap(vm->map_addr, vm->map_len);
+    munmap(vm, vm->desc_len);
+    pool->base_addr = NULL;
+    pool->size = 0;
+    pool->backing = NULL;
+    pool->commit_fn = NULL;
+    pool->release_fn = NULL;
+    pool->direct_fn = NULL;
+    pool->direct_threshold = 0;
+    return mempool_status_ok;
+}
+
+bool mempool_release_pages(void* backing, void* addr, size len)
+{
+    (void)backing;
+
+    char* first;
+    char* last;
+    if (!page_interior((size)sysconf(_SC_PAGESIZE), addr, len, &first, &last)) {
+        return false;
+    }
+    /* MADV_FREE would be cheaper but it does not guarantee that pages read as zeros afterwards */
+    return 0 == madvise(first, (size)(last - first), MADV_DONTNEED);
+}
@@ -135,4 +135,52 @@ TEST(Bit, BIT_32_GET_MUL__Misc__ValidResults)
     const u8 msk3 = 0b00000111;
     const u8 pos3 = 28;
     CHECK_EQUAL(0b00000010, BIT_32_GET_MUL(word3, msk3, pos3));
-}
\ No newline at end of file
+}
+
+TEST(Bit, BIT_64_GET_AT_POS__MiscValues__CorrectResults)
+{
+    CHECK_EQUAL(1, BIT_64_GET_AT_POS(0));
+    CHECK_EQUAL(2147483648, BIT_64_GET_AT_POS(31));
+    CHECK_EQUAL(4294967296, BIT_64_GET_AT_POS(32));
+    CHECK_EQUAL(9223372036854775808ULL, BIT_64_GET_AT_POS(63));
+}
+
+TEST(Bit, BIT_64_SET_CLR__MiscValues__ValidResults)
+{
+    u64 v = 0;
+    BIT_64_SET(v, 40);
+    BIT_64_SET(v, 0);
+    CHECK_EQUAL(1099511627777ULL, v);
+    CHECK_TRUE(BIT_64_IS_SET(v, 40));
+    CHECK_TRUE(BIT_64_IS_NOT_SET(v, 39));
+
+    BIT_64_CLR(v, 40);
+    CHECK_EQUAL(1, v);
+    CHECK_EQUAL(UINT64_MAX - 1, BIT_64_NOT(v));
+}
+
+TEST(Bit, BIT_64_CLZ_CTZ__MiscValues__ValidResults)
+{
+    CHECK_EQUAL(63, BIT_64_CLZ(1));
+    CHECK_EQUAL(31, BIT_64_CLZ(4294967296ULL));
+    CHECK_EQUAL(0, BIT_64_CLZ(UINT64_MAX));
+    CHECK_EQUAL(0, BIT_64_CTZ(1));
+    CHECK_EQUAL(32, BIT_64_CTZ(4294967296ULL));
+    CHECK_EQUAL(63, BIT_64_CTZ(9223372036854775808ULL));
+}
+
+TEST(Bit, BIT_64_LOG2__MiscValues__ValidResults)
+{
+    CHECK_EQUAL(0, BIT_64_LOG2_FLOOR(1));
+    CHECK_EQUAL(9, BIT_64_LOG2_FLOOR(1023));
+    CHECK_EQUAL(32, BIT_64_LOG2_FLOOR(4294967297ULL));
+
+    CHECK_EQUAL(0, BIT_64_LOG2_CEIL(0));
+    CHECK_EQUAL(0, BIT_64_LOG2_CEIL(1));
+    CHECK_EQUAL(10, BIT_64_LOG2_CEIL(1023));
+    CHECK_EQUAL(10, BIT_64_LOG2_CEIL(1024));
+    CHECK_EQUAL(33, BIT_64_LOG2_CEIL(4294967297ULL));
+    CHECK_EQUAL(34, BIT_64_LOG2_CEIL(8589934633ULL));
+    CHECK_EQUAL(63, BIT_64_LOG2_CEIL(9223372036854775808ULL));
+    CHECK_EQUAL(64, BIT_64_LOG2_CEIL(9223372036854775809ULL));
+}
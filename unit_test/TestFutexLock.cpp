@@ -0,0 +1,149 @@
+#include "TestRunner.h"
+#include "futex_lock.h"
+
+#include <chrono>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+TEST_GROUP(FutexLock)
+{
+    futex_lock lock {};
+
+    void setup() override
+    {
+        futex_lock_init(&lock);
+    }
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(FutexLock, futex_lock_init__LockIsFree)
+{
+    CHECK_EQUAL(0, lock.state);
+    CHECK_TRUE(futex_lock_try_acquire(&lock));
+    futex_lock_release(&lock);
+}
+
+TEST(FutexLock, futex_lock_try_acquire__LockHeld__Fails)
+{
+    futex_lock_acquire(&lock);
+    CHECK_FALSE(futex_lock_try_acquire(&lock));
+    futex_lock_release(&lock);
+    CHECK_TRUE(futex_lock_try_acquire(&lock));
+    CHECK_FALSE(futex_lock_try_acquire(&lock));
+    futex_lock_release(&lock);
+    CHECK_EQUAL(0, lock.state);
+}
+
+TEST(FutexLock, futex_lock_acquire__MultipleThreads__CounterConsistent)
+{
+    const size threadsNum = 8;
+    const size increments = 20000;
+    size counter = 0;
+
+    std::vector<std::thread> threads;
+    for (size i = 0; i < threadsNum; ++i) {
+        threads.emplace_back([&]() {
+            for (size j = 0; j < increments; ++j) {
+                futex_lock_acquire(&lock);
+                /* Plain read-modify-write that would lose updates without the lock */
+                size value = counter;
+                if (0 == j % 1000) {
+                    std::this_thread::yield();
+                }
+                counter = value + 1;
+                futex_lock_release(&lock);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK_EQUAL(threadsNum * increments, counter);
+    CHECK_EQUAL(0, lock.state);
+}
+
+TEST(FutexLock, futex_lock_acquire_pshared__TwoProcesses__CounterConsistent)
+{
+    struct Shared
+    {
+        futex_lock lock;
+        size counter;
+    };
+    const size increments = 20000;
+    void* mem = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(MAP_FAILED != mem);
+    auto shared = static_cast<Shared*>(mem);
+    futex_lock_init(&shared->lock);
+    shared->counter = 0;
+
+    auto work = [shared, increments]() {
+        for (size j = 0; j < increments; ++j) {
+            futex_lock_acquire_pshared(&shared->lock);
+            size value = shared->counter;
+            if (0 == j % 1000) {
+                std::this_thread::yield();
+            }
+            shared->counter = value + 1;
+            futex_lock_release_pshared(&shared->lock);
+        }
+    };
+    pid_t pid = fork();
+    if (0 == pid) {
+        work();
+        _exit(0);
+    }
+    work();
+    int status = 0;
+    CHECK_EQUAL(pid, waitpid(pid, &status, 0));
+    CHECK_EQUAL(2 * increments, shared->counter);
+    CHECK_EQUAL(0, shared->lock.state);
+
+    /* Waking a word nobody sleeps on is harmless */
+    u32 word = 1;
+    CHECK_TRUE(futex_wait_pshared(&word, 0, FUTEX_WAIT_FOREVER));
+    futex_wake_pshared(&word);
+    munmap(mem, sizeof(Shared));
+}
+
+TEST(FutexLock, futex_wait__ValueChanged__ReturnsImmediately)
+{
+    u32 word = 1;
+    CHECK_TRUE(futex_wait(&word, 0, FUTEX_WAIT_FOREVER));
+}
+
+TEST(FutexLock, futex_wait__NobodyWakes__TimeoutExpires)
+{
+    u32 word = 0;
+    auto start = std::chrono::steady_clock::now();
+    CHECK_FALSE(futex_wait(&word, 0, 10 * 1000 * 1000));
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(10));
+}
+
+TEST(FutexLock, futex_wake__WordChanged__AllWaitersWoken)
+{
+    u32 word = 0;
+    std::vector<std::thread> threads;
+    for (u32 t = 0; t < 4; ++t) {
+        threads.emplace_back([&word]() {
+            while (0 == __atomic_load_n(&word, __ATOMIC_ACQUIRE)) {
+                futex_wait(&word, 0, FUTEX_WAIT_FOREVER);
+            }
+        });
+    }
+    __atomic_store_n(&word, 1, __ATOMIC_RELEASE);
+    futex_wake(&word);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK_EQUAL(1, word);
+}
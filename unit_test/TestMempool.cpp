@@ -1,5 +1,15 @@
 #include "TestRunner.h"
 #include "mempool.h"
+#include "mempool_vm.h"
+#include "bit.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
 
 /* ------------------------------------------------------------ */
 /* ------------------------ Test groups ----------------------- */
@@ -31,7 +41,7 @@ TEST_GROUP(Mempool)
     }
 
     /* The pool has to be initialized */
-    static auto claimMemory(const mempool_instance* pool, size len)
+    static auto claimMemory(mempool_instance* pool, size len)
     {
         void* dst = nullptr;
         auto status = mempool_claim_memory(pool, len, &dst);
@@ -54,6 +64,7 @@ TEST_GROUP(Mempool)
             CHECK_EQUAL(expectedInfo->is_first, actualInfo->is_first);
             CHECK_EQUAL(expectedInfo->is_last, actualInfo->is_last);
             CHECK_EQUAL(expectedInfo->room_occupied, actualInfo->room_occupied);
+            CHECK_EQUAL(expectedInfo->released, actualInfo->released);
             CHECK_EQUAL(expectedInfo->room_size, actualInfo->room_size);
             CHECK_EQUAL(expectedInfo->usable_size, actualInfo->usable_size);
             POINTERS_EQUAL(expectedInfo->base_addr, actualInfo->base_addr);
@@ -62,6 +73,237 @@ TEST_GROUP(Mempool)
     }
 };
 
+/* Pools extended with extra regions */
+TEST_GROUP(MempoolRegion)
+{
+    static const size BUFFER_1K_SIZE = 1024;
+    static const size REGION_SIZE = 4096;
+    static const size NUM_REGIONS = MEMPOOL_REGIONS_MAX;
+    char* buffer1K = nullptr;
+    char* regions = nullptr; /* Single allocation split into NUM_REGIONS regions */
+
+    void setup() override
+    {
+        buffer1K = new char[BUFFER_1K_SIZE];
+        regions = new char[REGION_SIZE * NUM_REGIONS];
+    }
+
+    void teardown() override
+    {
+        delete[] buffer1K;
+        delete[] regions;
+    }
+
+    auto initMempoolWith1KBuffer() const
+    {
+        mempool_instance inst;
+        inst.base_addr = buffer1K;
+        inst.size = BUFFER_1K_SIZE;
+        CHECK_EQUAL(mempool_status_ok, mempool_init(&inst));
+        return inst;
+    }
+
+    char* getRegion(size idx) const
+    {
+        return regions + idx * REGION_SIZE;
+    }
+};
+
+/* Pools using compact header formats */
+TEST_GROUP(MempoolCompactHdr)
+{
+    static const size BUFFER_64K_SIZE = 65536;
+    char* buffer64K = nullptr;
+
+    void setup() override
+    {
+        buffer64K = new char[BUFFER_64K_SIZE];
+    }
+
+    void teardown() override
+    {
+        delete[] buffer64K;
+    }
+
+    auto initMempool(mempool_hdr_type hdrType, size bufferSize) const
+    {
+        mempool_config config;
+        mempool_default_config(&config);
+        config.hdr_type = hdrType;
+
+        mempool_instance inst;
+        inst.base_addr = buffer64K;
+        inst.size = bufferSize;
+        CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&inst, &config));
+        return inst;
+    }
+};
+
+/* Pools larger than 4 GiB backed by a sparse anonymous mapping - only pages holding headers are ever touched */
+TEST_GROUP(MempoolLargePool)
+{
+    static const size BUFFER_16G_SIZE = (size)1 << 34;
+    char* buffer16G = nullptr;
+
+    void setup() override
+    {
+        void* mem = mmap(nullptr, BUFFER_16G_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        CHECK(MAP_FAILED != mem);
+        buffer16G = static_cast<char*>(mem);
+    }
+
+    void teardown() override
+    {
+        munmap(buffer16G, BUFFER_16G_SIZE);
+    }
+
+    auto initMempoolWith16GBuffer() const
+    {
+        mempool_instance inst;
+        inst.base_addr = buffer16G;
+        inst.size = BUFFER_16G_SIZE;
+        CHECK_EQUAL(mempool_status_ok, mempool_init(&inst));
+        return inst;
+    }
+};
+
+/* Pools with a fake release function */
+TEST_GROUP(MempoolTrim)
+{
+    static const size BUFFER_1K_SIZE = 1024;
+    static const size MIN_RELEASE_SIZE = 128; /* Emulates page granularity of real backing providers */
+    char* buffer1K = nullptr;
+    size releaseCalls = 0;
+    mempool_instance pool {};
+
+    static bool fakeRelease(void* backing, void* addr, size len)
+    {
+        if (len < MIN_RELEASE_SIZE) {
+            return false;
+        }
+        memset(addr, 0, len);
+        (*static_cast<size*>(backing))++;
+        return true;
+    }
+
+    void setup() override
+    {
+        buffer1K = new char[BUFFER_1K_SIZE];
+        mempool_config config;
+        mempool_default_config(&config);
+        config.release_fn = fakeRelease;
+        config.backing = &releaseCalls;
+        pool.base_addr = buffer1K;
+        pool.size = BUFFER_1K_SIZE;
+        CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    }
+
+    void teardown() override
+    {
+        delete[] buffer1K;
+    }
+
+    /* Check released flag of all partitions, ordered by address */
+    void checkReleased(const bool* expected, size len) const
+    {
+        CHECK_EQUAL(len, mempool_partitions_used(&pool));
+        mempool_debug_info dbgInfo[len];
+        mempool_decode_debug_info(&pool, &dbgInfo[0]);
+        for (size i = 0; i < len; ++i) {
+            CHECK_EQUAL(expected[i], dbgInfo[i].released);
+        }
+    }
+};
+
+/* Pools shared between threads */
+TEST_GROUP(MempoolThreadSafe)
+{
+    static const size BUFFER_1M_SIZE = (size)1 << 20;
+    static const size THREADS_NUM = 8;
+    char* buffer1M = nullptr;
+    mempool_instance pool {};
+    mempool_ext ext {};
+
+    void setup() override
+    {
+        buffer1M = new char[BUFFER_1M_SIZE];
+    }
+
+    void teardown() override
+    {
+        delete[] buffer1M;
+    }
+
+    void initPool(mempool_hdr_type hdrType, bool lockFree = false)
+    {
+        mempool_config config;
+        mempool_default_config(&config);
+        config.hdr_type = hdrType;
+        config.thread_safe = true;
+        config.lock_free = lockFree;
+        config.ext = &ext;
+        pool.base_addr = buffer1M;
+        pool.size = BUFFER_1M_SIZE;
+        CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    }
+
+    /* Each thread claims blocks of random sizes, fills them with its own pattern and frees them in random order.
+     * With thread caches enabled blocks are passed between threads through the pool depot */
+    void runWorkers(size iterations, bool useTcache = false)
+    {
+        std::vector<std::thread> threads;
+        std::vector<size> errors(THREADS_NUM, 0);
+        for (size t = 0; t < THREADS_NUM; ++t) {
+            threads.emplace_back([this, t, iterations, useTcache, &errors]() {
+                mempool_tcache cache;
+                errors[t] += (mempool_status_ok != mempool_tcache_init(&cache, &pool));
+                auto claimFn = [&](size len, void** dst) {
+                    return useTcache ? mempool_tcache_claim(&cache, len, dst) : mempool_claim_memory(&pool, len, dst);
+                };
+                auto freeFn = [&](void* mem) {
+                    return useTcache ? mempool_tcache_free(&cache, mem) : mempool_free_memory(&pool, mem);
+                };
+                const size slotsNum = 16;
+                void* slots[slotsNum] = {};
+                size lens[slotsNum] = {};
+                u64 seed = 0x9E3779B97F4A7C15ull * (t + 1);
+                for (size i = 0; i < iterations; ++i) {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 7;
+                    seed ^= seed << 17;
+                    size idx = seed % slotsNum;
+                    if (nullptr != slots[idx]) {
+                        /* Another thread must not have touched the block */
+                        for (size j = 0; j < lens[idx]; ++j) {
+                            errors[t] += (static_cast<u8>(t) != static_cast<u8*>(slots[idx])[j]);
+                        }
+                        errors[t] += (mempool_status_ok != freeFn(slots[idx]));
+                        slots[idx] = nullptr;
+                    } else {
+                        lens[idx] = 1 + (seed >> 32) % 2000;
+                        if (mempool_status_ok == claimFn(lens[idx], &slots[idx])) {
+                            memset(slots[idx], static_cast<int>(t), lens[idx]);
+                        }
+                    }
+                }
+                for (auto slot : slots) {
+                    if (nullptr != slot) {
+                        errors[t] += (mempool_status_ok != freeFn(slot));
+                    }
+                }
+                mempool_tcache_release(&cache);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (auto err : errors) {
+            CHECK_EQUAL(0, err);
+        }
+    }
+};
+
 /* ------------------------------------------------------------ */
 /* ------------------------ Test cases ------------------------ */
 /* ------------------------------------------------------------ */
@@ -160,7 +402,7 @@ TEST(Mempool, mempool_claim_memory__AfterInit__ClaimAllMemory__Success)
     auto dst = claimMemory(&pool, claimSize);
     CHECK_EQUAL(1, mempool_partitions_used(&pool));
 
-    mempool_debug_info expectedDbgInfo;
+    mempool_debug_info expectedDbgInfo {};
     expectedDbgInfo.usable_space_addr = dst;
     expectedDbgInfo.base_addr = pool.base_addr;
     expectedDbgInfo.usable_size = claimSize;
@@ -180,7 +422,7 @@ TEST(Mempool, mempool_claim_memory__AfterInit__ClaimMemory__SizeRoundedUp)
     auto dst = claimMemory(&pool, claimSize);
     CHECK_EQUAL(1, mempool_partitions_used(&pool));
 
-    mempool_debug_info expectedDbgInfo;
+    mempool_debug_info expectedDbgInfo {};
     expectedDbgInfo.usable_space_addr = dst;
     expectedDbgInfo.base_addr = pool.base_addr;
     expectedDbgInfo.usable_size = claimSize + 1;
@@ -212,7 +454,7 @@ TEST(Mempool, mempool_claim_memory__AfterInit__TwoMemoryRequests__SecondPartitio
     auto pool = initMempoolWith1KBuffer();
     void* buff = claimMemory(&pool, claimSize);
 
-    mempool_debug_info expectedDbgInfo[2];
+    mempool_debug_info expectedDbgInfo[2] {};
 
     /* Partition 0 */
     expectedDbgInfo[0].usable_space_addr = buff;
@@ -413,6 +655,68 @@ TEST(Mempool, mempool_free_memory__AllocateAndFreeBuffers__Success)
     CHECK_EQUAL(1, mempool_partitions_used(&pool));
 }
 
+TEST(Mempool, mempool_free_memory__AdjacentPartitionsThatAreNotBuddies__NotMerged)
+{
+    const size claimSize = (BUFFER_1K_SIZE / 4) - mempool_calc_hdr_size();
+    auto pool = initMempoolWith1KBuffer();
+    auto dst1 = claimMemory(&pool, claimSize);
+    auto dst2 = claimMemory(&pool, claimSize);
+    auto dst3 = claimMemory(&pool, claimSize);
+    auto dst4 = claimMemory(&pool, claimSize);
+
+    /* Second and third partitions have the same size and are adjacent, but they belong to different buddies */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst2));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst3));
+    CHECK_EQUAL(4, mempool_partitions_used(&pool));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst1));
+    CHECK_EQUAL(3, mempool_partitions_used(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst4));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(Mempool, mempool_free_batch__InvalidParams__ErrorReturned)
+{
+    auto pool = initMempoolWith1KBuffer();
+    void* blocks[2] = {claimMemory(&pool, 10), nullptr};
+    CHECK_EQUAL(mempool_status_nullptr, mempool_free_batch(nullptr, blocks, 1));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_free_batch(&pool, nullptr, 1));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_batch(&pool, blocks, 0));
+
+    /* Valid blocks are freed even if some are not */
+    CHECK_EQUAL(mempool_status_nullptr, mempool_free_batch(&pool, blocks, 2));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_free_batch(&pool, blocks, 1));
+}
+
+TEST(Mempool, mempool_free_batch__BuddiesFreedTogether__PoolMergedBack)
+{
+    auto pool = initMempoolWith1KBuffer();
+    void* blocks[] = {claimMemory(&pool, 10), claimMemory(&pool, 64), claimMemory(&pool, 1), claimMemory(&pool, 128),
+                      claimMemory(&pool, 32)};
+    auto kept = claimMemory(&pool, 1);
+    CHECK_EQUAL(8, mempool_partitions_used(&pool));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_batch(&pool, blocks, sizeof(blocks) / sizeof(blocks[0])));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, kept));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(mempool_calc_hdr_size(), mempool_memory_used(&pool));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+}
+
+TEST(Mempool, mempool_claim_memory__SmallestFreePartitionIsUsed)
+{
+    auto pool = initMempoolWith1KBuffer();
+    auto dst1 = claimMemory(&pool, 1);
+    claimMemory(&pool, 1);
+    claimMemory(&pool, 128 - mempool_calc_hdr_size());
+
+    /* The first partition is the only free 64-byte one - it has to be reused instead of splitting larger ones */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst1));
+    POINTERS_EQUAL(dst1, claimMemory(&pool, 1));
+}
+
 TEST(Mempool, mempool_memory_used__NullPassed__ZeroReturned)
 {
     CHECK_EQUAL(0, mempool_memory_used(nullptr));
@@ -446,4 +750,1213 @@ TEST(Mempool, mempool_memory_used__MultipleClaims__ReturnedValueVaries)
     CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr1));
     CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr2));
     CHECK_EQUAL(mempool_calc_hdr_size(), mempool_memory_used(&pool));
-}
\ No newline at end of file
+}
+
+TEST(Mempool, mempool_memory_used__RandomClaimsAndFrees__CountersMatchTraversal)
+{
+    std::vector<char> buffer(65536);
+    mempool_instance pool;
+    pool.base_addr = buffer.data();
+    pool.size = buffer.size();
+    CHECK_EQUAL(mempool_status_ok, mempool_init(&pool));
+
+    std::vector<mempool_debug_info> dbgInfo(buffer.size() / 32);
+    std::vector<void*> claimed;
+    srand(7);
+    for (int i = 0; i < 2000; ++i) {
+        void* mem = nullptr;
+        if (!claimed.empty() && (rand() % 3 == 0 || claimed.size() > 40)) {
+            size idx = (size)rand() % claimed.size();
+            CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, claimed[idx]));
+            claimed.erase(claimed.begin() + (long)idx);
+        } else if (mempool_status_ok == mempool_claim_memory(&pool, 1 + (size)rand() % 3000, &mem)) {
+            claimed.push_back(mem);
+        }
+
+        size partitions = mempool_decode_debug_info(&pool, dbgInfo.data());
+        size memUsed = 0;
+        size freeCounts[MEMPOOL_ORDER_NUM] = {};
+        size usedCounts[MEMPOOL_ORDER_NUM] = {};
+        for (size j = 0; j < partitions; ++j) {
+            memUsed += dbgInfo[j].room_occupied ? dbgInfo[j].room_size : mempool_calc_hdr_size();
+            u32 order = BIT_64_CTZ(dbgInfo[j].room_size);
+            (dbgInfo[j].room_occupied ? usedCounts : freeCounts)[order]++;
+        }
+        CHECK_EQUAL(partitions, mempool_partitions_used(&pool));
+        CHECK_EQUAL(memUsed, mempool_memory_used(&pool));
+
+        mempool_stats stats;
+        CHECK_EQUAL(mempool_status_ok, mempool_get_stats(&pool, &stats));
+        for (u32 order = 0; order < MEMPOOL_ORDER_NUM; ++order) {
+            CHECK_EQUAL(freeCounts[order], stats.free_counts[order]);
+            CHECK_EQUAL(usedCounts[order], stats.used_counts[order]);
+        }
+    }
+}
+
+TEST(Mempool, mempool_memory_requested__ClaimsAndFrees__LiveBytesReported)
+{
+    auto pool = initMempoolWith1KBuffer();
+    CHECK_EQUAL(0, mempool_memory_requested(nullptr));
+    CHECK_EQUAL(0, mempool_memory_granted(nullptr));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+
+    size hdrSize = mempool_calc_hdr_size();
+    void* ptr = claimMemory(&pool, 100 - hdrSize);
+    void* other = claimMemory(&pool, 256 - hdrSize);
+    CHECK_EQUAL(356 - 2 * hdrSize, mempool_memory_requested(&pool));
+    CHECK_EQUAL(128 + 256, mempool_memory_granted(&pool));
+
+    /* Frees give the bytes back, failed claims are not counted */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_memory(&pool, BUFFER_1K_SIZE, &ptr));
+    CHECK_EQUAL(256 - hdrSize, mempool_memory_requested(&pool));
+    CHECK_EQUAL(256, mempool_memory_granted(&pool));
+
+    /* Shrinking in place keeps the partition */
+    CHECK_EQUAL(mempool_status_ok, mempool_realloc_memory(&pool, &other, 10));
+    CHECK_EQUAL(10, mempool_memory_requested(&pool));
+    CHECK_EQUAL(256, mempool_memory_granted(&pool));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, other));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+}
+
+TEST(Mempool, mempool_get_stats__InvalidParams__ErrorReturned)
+{
+    auto pool = initMempoolWith1KBuffer();
+    mempool_stats stats;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_get_stats(nullptr, &stats));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_get_stats(&pool, nullptr));
+}
+
+TEST(Mempool, mempool_get_stats__SplitPool__HistogramAndFragmentationReported)
+{
+    std::vector<char> buffer(65536);
+    mempool_instance pool;
+    pool.base_addr = buffer.data();
+    pool.size = buffer.size();
+    CHECK_EQUAL(mempool_status_ok, mempool_init(&pool));
+
+    /* Free memory forms a single partition */
+    mempool_stats stats;
+    CHECK_EQUAL(mempool_status_ok, mempool_get_stats(&pool, &stats));
+    CHECK_EQUAL(1, stats.free_counts[16]);
+    CHECK_EQUAL(65536, stats.free_bytes);
+    CHECK_EQUAL(65536, stats.largest_free);
+    CHECK_EQUAL(0, stats.fragmentation);
+
+    /* A small claim splits the pool into free partitions of orders 7 to 15 */
+    void* ptr = claimMemory(&pool, 100 - mempool_calc_hdr_size());
+    CHECK_EQUAL(mempool_status_ok, mempool_get_stats(&pool, &stats));
+    CHECK_EQUAL(1, stats.used_counts[7]);
+    for (u32 order = 7; order < 16; ++order) {
+        CHECK_EQUAL(1, stats.free_counts[order]);
+    }
+    CHECK_EQUAL(0, stats.free_counts[16]);
+    CHECK_EQUAL(65536 - 128, stats.free_bytes);
+    CHECK_EQUAL(32768, stats.largest_free);
+    CHECK_EQUAL((65536 - 128 - 32768) * 1000 / (65536 - 128), stats.fragmentation);
+    CHECK_EQUAL(100 - mempool_calc_hdr_size(), stats.requested_bytes);
+    CHECK_EQUAL(128, stats.granted_bytes);
+
+    /* Claim larger than the largest free partition fails although enough memory is free */
+    void* dst;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_memory(&pool, 40000, &dst));
+    CHECK(stats.free_bytes > 40000);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr));
+    CHECK_EQUAL(mempool_status_ok, mempool_get_stats(&pool, &stats));
+    CHECK_EQUAL(0, stats.used_counts[7]);
+    CHECK_EQUAL(0, stats.fragmentation);
+}
+
+TEST(Mempool, mempool_snapshot__InvalidParams__ErrorReturned)
+{
+    auto pool = initMempoolWith1KBuffer();
+    std::vector<char> snapshot(mempool_calc_snapshot_size(&pool));
+    size snapLen = 0;
+    CHECK_EQUAL(0, mempool_calc_snapshot_size(nullptr));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_snapshot(nullptr, snapshot.data(), snapshot.size(), &snapLen));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_snapshot(&pool, nullptr, snapshot.size(), &snapLen));
+    CHECK_EQUAL(mempool_status_size_err, mempool_snapshot(&pool, snapshot.data(), snapshot.size() - 1, &snapLen));
+    CHECK_EQUAL(snapshot.size(), snapLen);
+    CHECK_EQUAL(mempool_status_nullptr, mempool_restore(nullptr, snapshot.data()));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_restore(&pool, nullptr));
+
+    /* Neither garbage nor a snapshot of another pool is accepted */
+    std::memset(snapshot.data(), 0, snapshot.size());
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_restore(&pool, snapshot.data()));
+    std::vector<char> otherBuffer(BUFFER_1K_SIZE);
+    mempool_instance other;
+    other.base_addr = otherBuffer.data();
+    other.size = BUFFER_1K_SIZE;
+    CHECK_EQUAL(mempool_status_ok, mempool_init(&other));
+    CHECK_EQUAL(mempool_status_ok, mempool_snapshot(&other, snapshot.data(), snapshot.size(), nullptr));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_restore(&pool, snapshot.data()));
+}
+
+TEST(Mempool, mempool_snapshot__FreeSpace__NotCopied)
+{
+    std::vector<char> buffer(65536);
+    mempool_instance pool;
+    pool.base_addr = buffer.data();
+    pool.size = buffer.size();
+    CHECK_EQUAL(mempool_status_ok, mempool_init(&pool));
+    claimMemory(&pool, 1000);
+
+    /* The block takes a 2K partition, the rest of the pool contributes headers only */
+    size snapLen = mempool_calc_snapshot_size(&pool);
+    CHECK(snapLen > sizeof(mempool_instance) + 2048);
+    CHECK(snapLen < sizeof(mempool_instance) + 4096);
+    std::vector<char> snapshot(snapLen);
+    size written = 0;
+    CHECK_EQUAL(mempool_status_ok, mempool_snapshot(&pool, snapshot.data(), snapshot.size(), &written));
+    CHECK_EQUAL(snapLen, written);
+}
+
+TEST(Mempool, mempool_restore__SpeculativeWork__RolledBack)
+{
+    std::vector<char> buffer(65536);
+    mempool_instance pool;
+    pool.base_addr = buffer.data();
+    pool.size = buffer.size();
+    CHECK_EQUAL(mempool_status_ok, mempool_init(&pool));
+    auto kept = static_cast<char*>(claimMemory(&pool, 300));
+    auto freed = static_cast<char*>(claimMemory(&pool, 2000));
+    std::memset(kept, 0xAB, 300);
+    std::memset(freed, 0xCD, 2000);
+
+    std::vector<mempool_debug_info> before(mempool_partitions_used(&pool));
+    mempool_decode_debug_info(&pool, before.data());
+    std::vector<char> snapshot(mempool_calc_snapshot_size(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_snapshot(&pool, snapshot.data(), snapshot.size(), nullptr));
+
+    /* The same snapshot may be restored after each step */
+    for (int step = 0; step < 3; ++step) {
+        CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, freed));
+        for (int i = 0; i < 10; ++i) {
+            std::memset(claimMemory(&pool, 100 + i * 500), 0xEE, 100 + i * 500);
+        }
+        std::memset(kept, 0, 300);
+        CHECK_EQUAL(mempool_status_ok, mempool_restore(&pool, snapshot.data()));
+
+        std::vector<mempool_debug_info> after(mempool_partitions_used(&pool));
+        CHECK_EQUAL(before.size(), mempool_decode_debug_info(&pool, after.data()));
+        for (size i = 0; i < before.size(); ++i) {
+            CHECK_EQUAL(before[i].room_size, after[i].room_size);
+            CHECK_EQUAL(before[i].room_occupied, after[i].room_occupied);
+        }
+        for (size i = 0; i < 300; ++i) {
+            CHECK_EQUAL((char)0xAB, kept[i]);
+        }
+        for (size i = 0; i < 2000; ++i) {
+            CHECK_EQUAL((char)0xCD, freed[i]);
+        }
+    }
+
+    /* Free lists are restored as well - the pool merges back into a single partition */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, kept));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, freed));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    claimMemory(&pool, buffer.size() - mempool_calc_hdr_size());
+}
+
+TEST(MempoolLargePool, mempool_init__16GBuffer__SinglePartitionCreated)
+{
+    auto pool = initMempoolWith16GBuffer();
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+
+    mempool_debug_info dbgInfo;
+    CHECK_EQUAL(1, mempool_decode_debug_info(&pool, &dbgInfo));
+    CHECK_EQUAL(BUFFER_16G_SIZE, dbgInfo.room_size);
+}
+
+TEST(MempoolLargePool, mempool_claim_memory__SizeAbove8G__RoundedUpTo16G)
+{
+    auto pool = initMempoolWith16GBuffer();
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, ((size)1 << 33) + 1, &dst));
+    POINTERS_EQUAL(pool.base_addr + mempool_calc_hdr_size(), dst);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(BUFFER_16G_SIZE, mempool_memory_used(&pool));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    CHECK_EQUAL(mempool_calc_hdr_size(), mempool_memory_used(&pool));
+}
+
+TEST(MempoolLargePool, mempool_claim_memory__SmallClaim__SplitDownFrom16G)
+{
+    auto pool = initMempoolWith16GBuffer();
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 1, &dst));
+
+    /* Smallest partition is 64 bytes, so there is one buddy on each order between 2^6 and 2^33 */
+    const size expectedPartitions = 34 - 6 + 1;
+    CHECK_EQUAL(expectedPartitions, mempool_partitions_used(&pool));
+
+    mempool_debug_info dbgInfo[expectedPartitions];
+    CHECK_EQUAL(expectedPartitions, mempool_decode_debug_info(&pool, dbgInfo));
+    CHECK_EQUAL(64, dbgInfo[0].room_size);
+    CHECK_EQUAL((size)1 << 33, dbgInfo[expectedPartitions - 1].room_size);
+    POINTERS_EQUAL(pool.base_addr + ((size)1 << 33), dbgInfo[expectedPartitions - 1].base_addr);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolLargePool, mempool_claim_memory__TwoClaimsAbove4G__Success)
+{
+    auto pool = initMempoolWith16GBuffer();
+    const size claimSize = ((size)1 << 33) - mempool_calc_hdr_size();
+    void* dst1 = nullptr;
+    void* dst2 = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, claimSize, &dst1));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, claimSize, &dst2));
+    POINTERS_EQUAL(pool.base_addr + ((size)1 << 33) + mempool_calc_hdr_size(), dst2);
+
+    void* dst3 = nullptr;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_memory(&pool, 1, &dst3));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst1));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst2));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolLargePool, mempool_claim_memory__RequestNotRepresentable__ErrorReturned)
+{
+    auto pool = initMempoolWith16GBuffer();
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_memory(&pool, BUFFER_16G_SIZE, &dst));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_memory(&pool, SIZE_MAX, &dst));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_memory(&pool, SIZE_MAX / 2 + 2, &dst));
+    POINTERS_EQUAL(nullptr, dst);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolCompactHdr, mempool_calc_hdr_size__PointerHdr__FiveWordsLong)
+{
+    /* Dll node followed by the size and a word of flags */
+    CHECK_EQUAL(5 * sizeof(void*), mempool_calc_hdr_size());
+}
+
+TEST(MempoolCompactHdr, mempool_calc_hdr_size_ex__AllFormats__CompactHeadersAreSmaller)
+{
+    CHECK_EQUAL(mempool_calc_hdr_size(), mempool_calc_hdr_size_ex(mempool_hdr_ptr));
+    CHECK_EQUAL(8, mempool_calc_hdr_size_ex(mempool_hdr_off16));
+    CHECK(mempool_calc_hdr_size_ex(mempool_hdr_off32) < mempool_calc_hdr_size());
+    CHECK_EQUAL(0, mempool_calc_hdr_size_ex(static_cast<mempool_hdr_type>(100)));
+}
+
+TEST(MempoolCompactHdr, mempool_init_ex__InvalidParams__ErrorReturned)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    mempool_instance pool;
+    pool.base_addr = buffer64K;
+    pool.size = BUFFER_64K_SIZE;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_init_ex(nullptr, &config));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_init_ex(&pool, nullptr));
+
+    config.hdr_type = static_cast<mempool_hdr_type>(100);
+    CHECK_EQUAL(mempool_status_nok, mempool_init_ex(&pool, &config));
+
+    /* 16-bit offsets cannot address more than 64 KiB */
+    config.hdr_type = mempool_hdr_off16;
+    pool.size = BUFFER_64K_SIZE * 2;
+    CHECK_EQUAL(mempool_status_size_err, mempool_init_ex(&pool, &config));
+    pool.size = 8;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_init_ex(&pool, &config));
+}
+
+TEST(MempoolCompactHdr, mempool_claim_memory__Off16__SmallestPartitionIs16Bytes)
+{
+    auto pool = initMempool(mempool_hdr_off16, 1024);
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 8, &dst));
+    POINTERS_EQUAL(pool.base_addr + 8, dst);
+
+    /* 1024 bytes split down to 16 - one buddy on each level */
+    CHECK_EQUAL(7, mempool_partitions_used(&pool));
+    mempool_debug_info dbgInfo[7];
+    CHECK_EQUAL(7, mempool_decode_debug_info(&pool, dbgInfo));
+    CHECK_TRUE(dbgInfo[0].is_first);
+    CHECK_TRUE(dbgInfo[0].room_occupied);
+    CHECK_EQUAL(16, dbgInfo[0].room_size);
+    CHECK_EQUAL(8, dbgInfo[0].usable_size);
+    CHECK_EQUAL(16, dbgInfo[1].room_size);
+    CHECK_EQUAL(512, dbgInfo[6].room_size);
+    CHECK_TRUE(dbgInfo[6].is_last);
+    POINTERS_EQUAL(pool.base_addr + 520, dbgInfo[6].usable_space_addr);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(8, mempool_memory_used(&pool));
+}
+
+TEST(MempoolCompactHdr, mempool_claim_memory__Off16__FillWhole64KBuffer)
+{
+    const size numPartitions = BUFFER_64K_SIZE / 16;
+    auto pool = initMempool(mempool_hdr_off16, BUFFER_64K_SIZE);
+    void* ptrs[numPartitions];
+    for (auto& ptr : ptrs) {
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 8, &ptr));
+    }
+    POINTERS_EQUAL(pool.base_addr + BUFFER_64K_SIZE - 8, ptrs[numPartitions - 1]);
+    CHECK_EQUAL(numPartitions, mempool_partitions_used(&pool));
+    CHECK_EQUAL(BUFFER_64K_SIZE, mempool_memory_used(&pool));
+
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_memory(&pool, 1, &dst));
+
+    for (auto& ptr : ptrs) {
+        CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr));
+    }
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolCompactHdr, mempool_claim_memory__Off32__ClaimAndFree__Success)
+{
+    const size hdrSize = mempool_calc_hdr_size_ex(mempool_hdr_off32);
+    auto pool = initMempool(mempool_hdr_off32, BUFFER_64K_SIZE);
+    void* ptr1 = nullptr;
+    void* ptr2 = nullptr;
+    void* ptr3 = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 1, &ptr1));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 32768 - hdrSize, &ptr2));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &ptr3));
+    POINTERS_EQUAL(pool.base_addr + hdrSize, ptr1);
+    POINTERS_EQUAL(pool.base_addr + 32768 + hdrSize, ptr2);
+    CHECK_EQUAL(0, reinterpret_cast<uintptr_t>(ptr3) % sizeof(void*));
+
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_free_memory(&pool, pool.base_addr + 16384 + hdrSize));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr2));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr1));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr3));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(hdrSize, mempool_memory_used(&pool));
+}
+
+TEST(MempoolRegion, mempool_add_region__InvalidParams__ErrorReturned)
+{
+    auto pool = initMempoolWith1KBuffer();
+    CHECK_EQUAL(mempool_status_nullptr, mempool_add_region(nullptr, getRegion(0), REGION_SIZE));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_add_region(&pool, nullptr, REGION_SIZE));
+    CHECK_EQUAL(mempool_status_size_err, mempool_add_region(&pool, getRegion(0), REGION_SIZE - 1));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_add_region(&pool, getRegion(0), 32));
+
+    /* Overlapping regions */
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_add_region(&pool, buffer1K + 512, 512));
+    CHECK_EQUAL(mempool_status_ok, mempool_add_region(&pool, getRegion(0), REGION_SIZE));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_add_region(&pool, getRegion(0) + 1024, 1024));
+    CHECK_EQUAL(2, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolRegion, mempool_snapshot__SeveralRegions__NotSupported)
+{
+    auto pool = initMempoolWith1KBuffer();
+    CHECK_EQUAL(mempool_status_ok, mempool_add_region(&pool, getRegion(0), REGION_SIZE));
+    char snapshot[64];
+    CHECK_EQUAL(0, mempool_calc_snapshot_size(&pool));
+    CHECK_EQUAL(mempool_status_not_supported, mempool_snapshot(&pool, snapshot, sizeof(snapshot), nullptr));
+    CHECK_EQUAL(mempool_status_not_supported, mempool_restore(&pool, snapshot));
+}
+
+TEST(MempoolRegion, mempool_add_region__CompactHeader__NotSupported)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    config.hdr_type = mempool_hdr_off32;
+    mempool_instance pool;
+    pool.base_addr = buffer1K;
+    pool.size = BUFFER_1K_SIZE;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    CHECK_EQUAL(mempool_status_not_supported, mempool_add_region(&pool, getRegion(0), REGION_SIZE));
+}
+
+TEST(MempoolRegion, mempool_add_region__TooManyRegions__ErrorReturned)
+{
+    auto pool = initMempoolWith1KBuffer();
+    for (size i = 0; i < MEMPOOL_REGIONS_MAX - 1; ++i) {
+        CHECK_EQUAL(mempool_status_ok, mempool_add_region(&pool, getRegion(i), REGION_SIZE));
+    }
+    CHECK_EQUAL(mempool_status_nok, mempool_add_region(&pool, getRegion(MEMPOOL_REGIONS_MAX - 1), REGION_SIZE));
+    CHECK_EQUAL(MEMPOOL_REGIONS_MAX, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolRegion, mempool_claim_memory__PoolExhausted__ServedFromNewRegion)
+{
+    auto pool = initMempoolWith1KBuffer();
+    void* dst1 = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, BUFFER_1K_SIZE - mempool_calc_hdr_size(), &dst1));
+
+    void* dst2 = nullptr;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_memory(&pool, 100, &dst2));
+    CHECK_EQUAL(mempool_status_ok, mempool_add_region(&pool, getRegion(0), REGION_SIZE));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &dst2));
+    POINTERS_EQUAL(getRegion(0) + mempool_calc_hdr_size(), dst2);
+
+    /* Region partitions are reported after the ones from the initial buffer */
+    const size expectedPartitions = 1 + 5;
+    CHECK_EQUAL(expectedPartitions, mempool_partitions_used(&pool));
+    mempool_debug_info dbgInfo[expectedPartitions];
+    CHECK_EQUAL(expectedPartitions, mempool_decode_debug_info(&pool, dbgInfo));
+    CHECK_TRUE(dbgInfo[0].is_first && dbgInfo[0].is_last);
+    CHECK_TRUE(dbgInfo[1].is_first);
+    CHECK_FALSE(dbgInfo[1].is_last);
+    POINTERS_EQUAL(getRegion(0), dbgInfo[1].base_addr);
+    CHECK_EQUAL(REGION_SIZE / 2, dbgInfo[expectedPartitions - 1].room_size);
+    CHECK_TRUE(dbgInfo[expectedPartitions - 1].is_last);
+
+    /* Partitions are merged within a region only */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst2));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst1));
+    CHECK_EQUAL(2, mempool_partitions_used(&pool));
+    CHECK_EQUAL(2 * mempool_calc_hdr_size(), mempool_memory_used(&pool));
+}
+
+TEST(MempoolRegion, mempool_claim_memory__RequestLargerThanInitialBuffer__Success)
+{
+    auto pool = initMempoolWith1KBuffer();
+    CHECK_EQUAL(mempool_status_ok, mempool_add_region(&pool, getRegion(0), REGION_SIZE));
+    CHECK_EQUAL(mempool_status_ok, mempool_add_region(&pool, getRegion(2), REGION_SIZE * 2));
+
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, REGION_SIZE, &dst));
+    POINTERS_EQUAL(getRegion(2) + mempool_calc_hdr_size(), dst);
+    CHECK_EQUAL(REGION_SIZE * 2, mempool_memory_used(&pool) - 2 * mempool_calc_hdr_size());
+
+    /* Adjacent regions are never merged together */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_memory(&pool, REGION_SIZE * 2, &dst));
+    CHECK_EQUAL(3, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolTrim, mempool_trim__NoReleaseFunction__NothingReleased)
+{
+    CHECK_EQUAL(0, mempool_trim(nullptr, 0));
+
+    char buffer[256];
+    mempool_instance plain;
+    plain.base_addr = buffer;
+    plain.size = sizeof(buffer);
+    CHECK_EQUAL(mempool_status_ok, mempool_init(&plain));
+    CHECK_EQUAL(0, mempool_trim(&plain, 0));
+}
+
+TEST(MempoolTrim, mempool_trim__FreshPool__WholePartitionReleased)
+{
+    CHECK_EQUAL(BUFFER_1K_SIZE - mempool_calc_hdr_size(), mempool_trim(&pool, 0));
+    CHECK_EQUAL(1, releaseCalls);
+    const bool expected[] = {true};
+    checkReleased(expected, 1);
+
+    /* Released partitions are not released again */
+    CHECK_EQUAL(0, mempool_trim(&pool, 0));
+    CHECK_EQUAL(1, releaseCalls);
+}
+
+TEST(MempoolTrim, mempool_trim__KeepBytes__LargestPartitionsReleasedFirst)
+{
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 50, &dst));
+
+    /* Free partitions: 128, 256 and 512 bytes. Keeping 384 bytes requires releasing the largest one only */
+    CHECK_EQUAL(BUFFER_1K_SIZE / 2 - mempool_calc_hdr_size(), mempool_trim(&pool, 384));
+    const bool expected[] = {false, false, false, true};
+    checkReleased(expected, 4);
+
+    /* Partitions too small for the backing provider stay resident */
+    CHECK_EQUAL(256 - mempool_calc_hdr_size(), mempool_trim(&pool, 0));
+    const bool expectedAll[] = {false, false, true, true};
+    checkReleased(expectedAll, 4);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+}
+
+TEST(MempoolTrim, mempool_claim_memory__ReleasedPartitionSplit__BuddiesStayReleased)
+{
+    mempool_trim(&pool, 0);
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 50, &dst));
+    const bool expected[] = {false, true, true, true};
+    checkReleased(expected, 4);
+
+    /* Merging with a dirty partition clears released state */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    const bool expectedMerged[] = {false};
+    checkReleased(expectedMerged, 1);
+}
+
+TEST(MempoolTrim, mempool_claim_zeroed__DirtyPartition__MemoryCleared)
+{
+    const size len = 200;
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, len, &dst));
+    memset(dst, 0xAB, len);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_zeroed(&pool, len, &dst));
+    for (size i = 0; i < len; ++i) {
+        CHECK_EQUAL(0, static_cast<char*>(dst)[i]);
+    }
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+}
+
+TEST(MempoolTrim, mempool_claim_zeroed__ReleasedPartition__MemoryNotTouched)
+{
+    mempool_trim(&pool, 0);
+
+    /* Marker placed behind the back of the pool shows that released memory is not cleared again */
+    char* usable = pool.base_addr + mempool_calc_hdr_size();
+    usable[0] = 0x11;
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_zeroed(&pool, 100, &dst));
+    POINTERS_EQUAL(usable, dst);
+    CHECK_EQUAL(0x11, usable[0]);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+}
+
+TEST(MempoolTrim, mempool_claim_zeroed__InvalidParams__ErrorReturned)
+{
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_claim_zeroed(nullptr, 1, &dst));
+    CHECK_EQUAL(mempool_status_size_err, mempool_claim_zeroed(&pool, 0, &dst));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_claim_zeroed(&pool, 1, nullptr));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_zeroed(&pool, BUFFER_1K_SIZE, &dst));
+}
+
+TEST(MempoolTrim, mempool_set_trim_threshold__LargePartitionFreed__ReleasedImmediately)
+{
+    mempool_set_trim_threshold(&pool, BUFFER_1K_SIZE);
+    void* small = nullptr;
+    void* large = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &small));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 300, &large));
+
+    /* Partition below the threshold is kept */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, small));
+    CHECK_EQUAL(0, releaseCalls);
+
+    /* The whole pool is merged back and released */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, large));
+    CHECK_EQUAL(1, releaseCalls);
+    const bool expected[] = {true};
+    checkReleased(expected, 1);
+
+    mempool_set_trim_threshold(&pool, 0);
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &small));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, small));
+    CHECK_EQUAL(1, releaseCalls);
+}
+
+TEST(MempoolThreadSafe, mempool_init_ex__DefaultConfig__NotThreadSafe)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    CHECK_FALSE(config.thread_safe);
+    POINTERS_EQUAL(nullptr, config.ext);
+    initPool(mempool_hdr_ptr);
+    CHECK_TRUE(pool.thread_safe);
+    POINTERS_EQUAL(&ext, mempool_ext_addr(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_init_ex__ThreadSafeWithoutExtendedState__NotSupported)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    config.thread_safe = true;
+    pool.base_addr = buffer1M;
+    pool.size = BUFFER_1M_SIZE;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_init_ex(&pool, &config));
+    config.thread_safe = false;
+    config.lock_free = true;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_init_ex(&pool, &config));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_memory__ConcurrentClaimsAndFrees__PoolMergedBack)
+{
+    initPool(mempool_hdr_ptr);
+    runWorkers(20000);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(mempool_calc_hdr_size(), mempool_memory_used(&pool));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_memory__CompactHeaders__PoolMergedBack)
+{
+    initPool(mempool_hdr_off32);
+    runWorkers(20000);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_memory__PartitionsDetachedConcurrently__NoSpuriousOutOfMemory)
+{
+    initPool(mempool_hdr_ptr);
+
+    /* Blocks of all threads together take half of the pool, so every claim has to succeed even while the partition
+     * it would be carved out of is being split or merged by another thread */
+    const size blockLen = BUFFER_1M_SIZE / (2 * THREADS_NUM) - mempool_calc_hdr_size();
+    std::vector<std::thread> threads;
+    std::vector<size> errors(THREADS_NUM, 0);
+    for (size t = 0; t < THREADS_NUM; ++t) {
+        threads.emplace_back([this, t, blockLen, &errors]() {
+            for (size i = 0; i < 20000; ++i) {
+                void* dst = nullptr;
+                errors[t] += (mempool_status_ok != mempool_claim_memory(&pool, blockLen, &dst));
+                errors[t] += (nullptr != dst && mempool_status_ok != mempool_free_memory(&pool, dst));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto err : errors) {
+        CHECK_EQUAL(0, err);
+    }
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_memory__DirectMappings__TableConsistent)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_create_mapped(&pool, BUFFER_1M_SIZE, MEMPOOL_MAP_THREAD_SAFE));
+    CHECK_EQUAL(mempool_status_ok, mempool_set_direct_threshold(&pool, 1024));
+    runWorkers(5000);
+    CHECK_EQUAL(0, mempool_direct_maps(&pool));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_init_ex__LockFree__ThreadSafeImplied)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    CHECK_FALSE(config.lock_free);
+    config.lock_free = true;
+    config.ext = &ext;
+    pool.base_addr = buffer1M;
+    pool.size = BUFFER_1M_SIZE;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    CHECK_TRUE(pool.thread_safe);
+    CHECK_TRUE(pool.lock_free);
+    CHECK_EQUAL(0, mempool_drain_cache(nullptr));
+}
+
+TEST(MempoolThreadSafe, mempool_init_ex__LockFreeBufferAbove48Bits__NotSupported)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    config.lock_free = true;
+    config.ext = &ext;
+
+    /* Tagged pointers and buffers crossing the limit are rejected before any header is written */
+    pool.base_addr = reinterpret_cast<char*>(static_cast<uintptr_t>(0x5A) << 56);
+    pool.size = BUFFER_1M_SIZE;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_init_ex(&pool, &config));
+    pool.base_addr = reinterpret_cast<char*>((static_cast<uintptr_t>(1) << 48) - BUFFER_1M_SIZE / 2);
+    CHECK_EQUAL(mempool_status_not_supported, mempool_init_ex(&pool, &config));
+
+    pool.base_addr = buffer1M;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    CHECK_EQUAL(mempool_status_not_supported,
+                mempool_add_region(&pool, reinterpret_cast<char*>(static_cast<uintptr_t>(0x5A) << 56), BUFFER_1M_SIZE));
+}
+
+TEST(MempoolThreadSafe, mempool_free_memory__LockFree__BlockCachedAndReused)
+{
+    initPool(mempool_hdr_ptr, true);
+    void* first = nullptr;
+    void* second = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &first));
+    const size partitions = mempool_partitions_used(&pool);
+
+    /* The block is not merged back */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, first));
+    CHECK_EQUAL(partitions, mempool_partitions_used(&pool));
+    mempool_debug_info dbgInfo[partitions];
+    mempool_decode_debug_info(&pool, &dbgInfo[0]);
+    CHECK_TRUE(dbgInfo[0].cached);
+    CHECK_TRUE(dbgInfo[0].room_occupied);
+
+    /* Double free is detected */
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_free_memory(&pool, first));
+
+    /* A claim of the same order gets the cached block */
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 90, &second));
+    POINTERS_EQUAL(first, second);
+    mempool_decode_debug_info(&pool, &dbgInfo[0]);
+    CHECK_FALSE(dbgInfo[0].cached);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, second));
+    CHECK_EQUAL(1, mempool_drain_cache(&pool));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(0, mempool_drain_cache(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_memory__LockFreeTreeExhausted__CacheDrained)
+{
+    initPool(mempool_hdr_ptr, true);
+    const size blockLen = BUFFER_1M_SIZE / 4 - mempool_calc_hdr_size();
+    void* blocks[4];
+    for (auto& block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, blockLen, &block));
+    }
+    for (auto block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, block));
+    }
+
+    /* Only merged blocks can serve the whole buffer */
+    void* whole = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, BUFFER_1M_SIZE - mempool_calc_hdr_size(), &whole));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, whole));
+    CHECK_EQUAL(1, mempool_drain_cache(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_memory__LockFreeConcurrentClaimsAndFrees__PoolMergedBackAfterDrain)
+{
+    initPool(mempool_hdr_ptr, true);
+    runWorkers(20000);
+    mempool_drain_cache(&pool);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(mempool_calc_hdr_size(), mempool_memory_used(&pool));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_memory__LockFreeCompactHeaders__PoolMergedBackAfterDrain)
+{
+    initPool(mempool_hdr_off32, true);
+    runWorkers(20000);
+    mempool_drain_cache(&pool);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_tcache__InvalidParams__ErrorReturned)
+{
+    initPool(mempool_hdr_ptr);
+    mempool_tcache cache;
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_tcache_init(nullptr, &pool));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_tcache_init(&cache, nullptr));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&cache, &pool));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_tcache_claim(nullptr, 10, &mem));
+    CHECK_EQUAL(mempool_status_size_err, mempool_tcache_claim(&cache, 0, &mem));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_tcache_claim(&cache, 10, nullptr));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_tcache_free(nullptr, buffer1M));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_tcache_free(&cache, nullptr));
+    CHECK_EQUAL(0, mempool_tcache_flush(nullptr));
+    CHECK_EQUAL(0, mempool_tcache_flush(&cache));
+}
+
+TEST(MempoolThreadSafe, mempool_tcache_claim__EmptyCache__MagazineCarvedFromOnePartition)
+{
+    initPool(mempool_hdr_ptr);
+    mempool_tcache cache;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&cache, &pool));
+
+    /* 100 bytes with a header fit into 256-byte blocks, so a 4K partition is carved */
+    void* first = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&cache, 100, &first));
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE - 1, cache.counts[8]);
+    std::vector<mempool_debug_info> dbgInfo(mempool_partitions_used(&pool));
+    mempool_decode_debug_info(&pool, dbgInfo.data());
+    POINTERS_EQUAL(first, dbgInfo[0].usable_space_addr);
+    CHECK_FALSE(dbgInfo[0].cached);
+    for (size i = 1; i < MEMPOOL_TCACHE_MAGAZINE; ++i) {
+        CHECK_EQUAL(256, dbgInfo[i].room_size);
+        CHECK_TRUE(dbgInfo[i].room_occupied);
+        CHECK_TRUE(dbgInfo[i].cached);
+    }
+
+    /* Next claims of the order do not split the tree */
+    const size partitions = mempool_partitions_used(&pool);
+    void* second = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&cache, 200, &second));
+    CHECK_EQUAL(partitions, mempool_partitions_used(&pool));
+
+    /* A freed block is cached and reused first, double free is detected */
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&cache, second));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_tcache_free(&cache, second));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_free_memory(&pool, second));
+    void* third = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&cache, 150, &third));
+    POINTERS_EQUAL(second, third);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&cache, first));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&cache, third));
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE, mempool_tcache_flush(&cache));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_memory_requested__CachedBlocks__CountedWhileClaimed)
+{
+    initPool(mempool_hdr_ptr, true);
+    mempool_tcache cache;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&cache, &pool));
+
+    /* Blocks reused from the lock-free cache are counted like any other claim */
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &mem));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, mem));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 150, &mem));
+    CHECK_EQUAL(150, mempool_memory_requested(&pool));
+    CHECK_EQUAL(256, mempool_memory_granted(&pool));
+
+    /* Thread caches uncount blocks of the pool they keep and do not count their own claims */
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&cache, mem));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&cache, 150, &mem));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, mem));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+    mempool_tcache_release(&cache);
+}
+
+TEST(MempoolThreadSafe, mempool_tcache_claim__LargeClaim__PassedToPool)
+{
+    initPool(mempool_hdr_ptr);
+    mempool_tcache cache;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&cache, &pool));
+
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&cache, (size)1 << MEMPOOL_TCACHE_ORDERS, &mem));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&cache, mem));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(0, mempool_tcache_flush(&cache));
+}
+
+TEST(MempoolThreadSafe, mempool_tcache_free__TwoFullMagazines__OneHandedOverToAnotherCache)
+{
+    initPool(mempool_hdr_ptr);
+    mempool_tcache producer;
+    mempool_tcache consumer;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&producer, &pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&consumer, &pool));
+
+    void* blocks[2 * MEMPOOL_TCACHE_MAGAZINE];
+    for (auto& block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &block));
+    }
+    for (auto block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&producer, block));
+    }
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE, producer.counts[8]);
+    CHECK(nullptr != ext.depot_heads[8]);
+
+    /* The consumer gets the magazine with the oldest blocks */
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&consumer, 100, &mem));
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE - 1, consumer.counts[8]);
+    POINTERS_EQUAL(nullptr, ext.depot_heads[8]);
+    bool fromProducer = false;
+    for (size i = 0; i < MEMPOOL_TCACHE_MAGAZINE; ++i) {
+        fromProducer |= (blocks[i] == mem);
+    }
+    CHECK_TRUE(fromProducer);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&consumer, mem));
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE, mempool_tcache_flush(&consumer));
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE, mempool_tcache_flush(&producer));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_drain_cache__MagazinesInDepot__Coalesced)
+{
+    initPool(mempool_hdr_ptr);
+    mempool_tcache cache;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&cache, &pool));
+
+    void* blocks[2 * MEMPOOL_TCACHE_MAGAZINE];
+    for (auto& block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&cache, 100, &block));
+    }
+    for (auto block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&cache, block));
+    }
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE, mempool_drain_cache(&pool));
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE, mempool_tcache_flush(&cache));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_tcache_claim__ConcurrentClaimsAndFrees__PoolMergedBackAfterFlush)
+{
+    initPool(mempool_hdr_ptr);
+    runWorkers(20000, true);
+    mempool_drain_cache(&pool);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(mempool_calc_hdr_size(), mempool_memory_used(&pool));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_tcache_claim__CompactHeadersLockFree__PoolMergedBackAfterFlush)
+{
+    initPool(mempool_hdr_off32, true);
+    runWorkers(20000, true);
+    mempool_drain_cache(&pool);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_tcache_init__OwnerIds__AssignedUntilTableFull)
+{
+    initPool(mempool_hdr_ptr);
+    std::vector<mempool_tcache> caches(MEMPOOL_TCACHE_OWNERS_MAX + 1);
+    for (size i = 0; i < caches.size(); ++i) {
+        CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&caches[i], &pool));
+        CHECK_EQUAL((i < MEMPOOL_TCACHE_OWNERS_MAX) ? i + 1 : 0, caches[i].owner_id);
+    }
+
+    /* A released id is reused */
+    CHECK_EQUAL(0, mempool_tcache_release(&caches[3]));
+    CHECK_EQUAL(0, caches[3].owner_id);
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&caches[MEMPOOL_TCACHE_OWNERS_MAX], &pool));
+    CHECK_EQUAL(4, caches[MEMPOOL_TCACHE_OWNERS_MAX].owner_id);
+    CHECK_EQUAL(0, mempool_tcache_release(nullptr));
+}
+
+TEST(MempoolThreadSafe, mempool_tcache_free__ForeignBlock__QueuedToOwnerAndDrainedOnClaim)
+{
+    initPool(mempool_hdr_ptr);
+    mempool_tcache owner;
+    mempool_tcache other;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&owner, &pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&other, &pool));
+
+    void* first = nullptr;
+    void* second = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&owner, 100, &first));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&owner, 100, &second));
+    const u32 ownerCount = owner.counts[8];
+
+    /* The foreign cache does not keep the blocks */
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&other, first));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&other, second));
+    CHECK_EQUAL(0, other.counts[8]);
+    POINTERS_EQUAL(static_cast<char*>(second) - mempool_calc_hdr_size(), owner.remote_head);
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_tcache_free(&other, first));
+
+    /* The owner takes the whole queue on its next claim and reuses the last freed block */
+    void* third = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&owner, 100, &third));
+    POINTERS_EQUAL(nullptr, owner.remote_head);
+    POINTERS_EQUAL(first, third);
+    CHECK_EQUAL(ownerCount + 1, owner.counts[8]);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&owner, third));
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE, mempool_tcache_release(&owner));
+    CHECK_EQUAL(0, mempool_tcache_release(&other));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_tcache_free__ReleasedOwnerOrCompactHeaders__KeptLocally)
+{
+    initPool(mempool_hdr_ptr);
+    mempool_tcache owner;
+    mempool_tcache other;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&owner, &pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&other, &pool));
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_claim(&owner, 100, &mem));
+    CHECK_EQUAL(MEMPOOL_TCACHE_MAGAZINE - 1, mempool_tcache_release(&owner));
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_free(&other, mem));
+    CHECK_EQUAL(1, other.counts[8]);
+    CHECK_EQUAL(1, mempool_tcache_release(&other));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+
+    initPool(mempool_hdr_off32);
+    CHECK_EQUAL(mempool_status_ok, mempool_tcache_init(&owner, &pool));
+    CHECK_EQUAL(0, owner.owner_id);
+}
+
+TEST(MempoolThreadSafe, mempool_tcache_free__ProducerConsumer__PoolMergedBackAfterRelease)
+{
+    initPool(mempool_hdr_ptr);
+    const size blocksNum = 20000;
+    std::vector<void*> queue;
+    std::mutex queueLock;
+    bool producerDone = false;
+    size producerErrors = 0;
+    size consumerErrors = 0;
+
+    /* Blocks are claimed by one thread and freed by the other one */
+    std::thread producer([&]() {
+        mempool_tcache cache;
+        mempool_tcache_init(&cache, &pool);
+        for (size i = 0; i < blocksNum; ++i) {
+            void* mem = nullptr;
+            while (mempool_status_ok != mempool_tcache_claim(&cache, 16 + i % 500, &mem)) {
+                std::this_thread::yield();
+            }
+            std::lock_guard<std::mutex> guard(queueLock);
+            queue.push_back(mem);
+        }
+        /* Keep draining the remote queue until the consumer is done */
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> guard(queueLock);
+                if (producerDone) {
+                    break;
+                }
+            }
+            void* mem = nullptr;
+            if (mempool_status_ok == mempool_tcache_claim(&cache, 16, &mem)) {
+                producerErrors += (mempool_status_ok != mempool_tcache_free(&cache, mem));
+            }
+            std::this_thread::yield();
+        }
+        mempool_tcache_release(&cache);
+    });
+    std::thread consumer([&]() {
+        mempool_tcache cache;
+        mempool_tcache_init(&cache, &pool);
+        for (size freed = 0; freed < blocksNum;) {
+            std::vector<void*> batch;
+            {
+                std::lock_guard<std::mutex> guard(queueLock);
+                batch.swap(queue);
+            }
+            for (auto mem : batch) {
+                consumerErrors += (mempool_status_ok != mempool_tcache_free(&cache, mem));
+            }
+            freed += batch.size();
+            std::this_thread::yield();
+        }
+        mempool_tcache_release(&cache);
+        std::lock_guard<std::mutex> guard(queueLock);
+        producerDone = true;
+    });
+    producer.join();
+    consumer.join();
+
+    CHECK_EQUAL(0, producerErrors);
+    CHECK_EQUAL(0, consumerErrors);
+    mempool_drain_cache(&pool);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_wait__InvalidParams__ErrorReturned)
+{
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_claim_wait(nullptr, 10, &mem, 0));
+    initPool(mempool_hdr_ptr);
+    CHECK_EQUAL(mempool_status_size_err, mempool_claim_wait(&pool, 0, &mem, 0));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_claim_wait(&pool, 10, nullptr, 0));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_wait(&pool, (size)-1, &mem, MEMPOOL_WAIT_FOREVER));
+
+    pool.thread_safe = false;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_claim_wait(&pool, 10, &mem, 0));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_wait__MemoryAvailable__ClaimedWithoutWaiting)
+{
+    initPool(mempool_hdr_ptr);
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_wait(&pool, 100, &mem, 0));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, mem));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_wait__NothingFreed__TimeoutExpires)
+{
+    initPool(mempool_hdr_ptr);
+    void* whole = nullptr;
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, BUFFER_1M_SIZE - mempool_calc_hdr_size(), &whole));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_wait(&pool, 100, &mem, 0));
+
+    auto start = std::chrono::steady_clock::now();
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_claim_wait(&pool, 100, &mem, 10 * 1000 * 1000));
+    CHECK(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(10));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, whole));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_wait__PoolRestored__WaiterWoken)
+{
+    initPool(mempool_hdr_ptr);
+    std::vector<char> snapshot(mempool_calc_snapshot_size(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_snapshot(&pool, snapshot.data(), snapshot.size(), nullptr));
+    void* whole = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, BUFFER_1M_SIZE - mempool_calc_hdr_size(), &whole));
+
+    /* The snapshot of the empty pool has room for the waiter. Its timeout only keeps a broken wake-up from hanging */
+    void* waited = nullptr;
+    mempool_status waitStatus = mempool_status_nok;
+    std::thread waiter([&]() {
+        waitStatus = mempool_claim_wait(&pool, 100, &waited, (u64)5 * 1000 * 1000 * 1000);
+    });
+    while (0 == __atomic_load_n(&ext.wait_map, __ATOMIC_SEQ_CST)) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    CHECK_EQUAL(mempool_status_ok, mempool_restore(&pool, snapshot.data()));
+    waiter.join();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    CHECK_EQUAL(mempool_status_ok, waitStatus);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, waited));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_free_batch__ConcurrentBatches__PoolMergedBack)
+{
+    initPool(mempool_hdr_off32);
+    std::vector<std::thread> threads;
+    std::vector<size> errors(THREADS_NUM, 0);
+    for (size t = 0; t < THREADS_NUM; ++t) {
+        threads.emplace_back([this, t, &errors]() {
+            void* blocks[64];
+            u64 seed = 0x9E3779B97F4A7C15ull * (t + 1);
+            for (size i = 0; i < 500; ++i) {
+                for (auto& block : blocks) {
+                    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+                    errors[t] += (mempool_status_ok != mempool_claim_memory(&pool, 1 + (seed >> 33) % 1000, &block));
+                }
+                errors[t] += (mempool_status_ok != mempool_free_batch(&pool, blocks, 64));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto err : errors) {
+        CHECK_EQUAL(0, err);
+    }
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+}
+
+TEST(MempoolThreadSafe, mempool_claim_wait__LargeBlockWaited__WokenOnlyWhenSatisfiable)
+{
+    initPool(mempool_hdr_ptr);
+    const size halfLen = BUFFER_1M_SIZE / 2 - mempool_calc_hdr_size();
+    const size wholeLen = BUFFER_1M_SIZE - mempool_calc_hdr_size();
+    const u32 wholeOrder = 20;
+    void* small = nullptr;
+    void* half = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &small));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, halfLen, &half));
+
+    /* The waiter needs the whole pool, which exists only after both blocks are freed */
+    void* waited = nullptr;
+    mempool_status waitStatus = mempool_status_nok;
+    std::thread waiter([&]() {
+        waitStatus = mempool_claim_wait(&pool, wholeLen, &waited, MEMPOOL_WAIT_FOREVER);
+    });
+    while (0 == (__atomic_load_n(&ext.wait_map, __ATOMIC_SEQ_CST) & ((u64)1 << wholeOrder))) {
+        std::this_thread::yield();
+    }
+
+    /* A small free merges up to a half of the pool only, which is not enough for the waiter */
+    const u32 seq = __atomic_load_n(&ext.wait_seqs[wholeOrder], __ATOMIC_SEQ_CST);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, small));
+    CHECK_EQUAL(seq, __atomic_load_n(&ext.wait_seqs[wholeOrder], __ATOMIC_SEQ_CST));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, half));
+    waiter.join();
+    CHECK_EQUAL(mempool_status_ok, waitStatus);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, waited));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
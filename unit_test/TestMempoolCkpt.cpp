@@ -0,0 +1,202 @@
+#include "TestRunner.h"
+#include "mempool_ckpt.h"
+#include "mempool_persist.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+TEST_GROUP(MempoolCkpt)
+{
+    static const size POOL_SIZE = (size)1 << 20;
+    size pageSize = 0;
+    char path[32] = "/tmp/mempool_ckpt_XXXXXX";
+    int fd = -1;
+    char* buffer = nullptr;
+    mempool_instance pool {};
+    mempool_ckpt ckpt {};
+
+    void setup() override
+    {
+        pageSize = (size)sysconf(_SC_PAGESIZE);
+        fd = mkstemp(path);
+        CHECK(fd >= 0);
+        buffer = static_cast<char*>(mmap(nullptr, POOL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                                         -1, 0));
+        CHECK(MAP_FAILED != buffer);
+        pool.base_addr = buffer;
+        pool.size = POOL_SIZE;
+        CHECK_EQUAL(mempool_status_ok, mempool_init(&pool));
+    }
+
+    void teardown() override
+    {
+        munmap(buffer, POOL_SIZE);
+        close(fd);
+        unlink(path);
+    }
+
+    mempool_ckpt_manifest readManifest()
+    {
+        mempool_ckpt_manifest manifest {};
+        CHECK_EQUAL((ssize_t)sizeof(manifest), pread(fd, &manifest, sizeof(manifest), 0));
+        return manifest;
+    }
+
+    /* Check that the file holds the current content of a page */
+    void checkPage(size page)
+    {
+        std::vector<char> image(pageSize);
+        const mempool_ckpt_manifest manifest = readManifest();
+        CHECK_EQUAL((ssize_t)pageSize, pread(fd, image.data(), pageSize, (off_t)(manifest.data_off + page * pageSize)));
+        CHECK_EQUAL(0, memcmp(image.data(), buffer + page * pageSize, pageSize));
+    }
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(MempoolCkpt, mempool_ckpt_start__InvalidParams__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ckpt_start(nullptr, &pool));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ckpt_start(&ckpt, nullptr));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ckpt_stop(nullptr));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_checkpoint(nullptr, fd));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ckpt_touch(nullptr, buffer, 1));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ckpt_touch(&ckpt, nullptr, 1));
+
+    /* Releasing memory changes it without writes */
+    pool.release_fn = [](void*, void*, size) { return true; };
+    CHECK_EQUAL(mempool_status_not_supported, mempool_ckpt_start(&ckpt, &pool));
+    pool.release_fn = nullptr;
+
+    pool.base_addr = buffer + 64;
+    CHECK_EQUAL(mempool_status_size_err, mempool_ckpt_start(&ckpt, &pool));
+    pool.base_addr = buffer;
+}
+
+TEST(MempoolCkpt, mempool_checkpoint__NothingChanged__NoPagesWritten)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_start(&ckpt, &pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK_EQUAL(POOL_SIZE / pageSize, ckpt.pages_written);
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK_EQUAL(0, ckpt.pages_written);
+
+    const mempool_ckpt_manifest manifest = readManifest();
+    CHECK_EQUAL(MEMPOOL_CKPT_MAGIC, manifest.magic);
+    CHECK_EQUAL(2, manifest.seq);
+    CHECK_EQUAL(POOL_SIZE, manifest.pool_size);
+    CHECK_EQUAL((u64)(uintptr_t)buffer, manifest.base_addr);
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_stop(&ckpt));
+}
+
+TEST(MempoolCkpt, mempool_checkpoint__BlocksWritten__OnlyDirtyPagesWritten)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_start(&ckpt, &pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+
+    /* A claim touches headers of the split buddies, which lie on a few pages */
+    void* small = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &small));
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK(ckpt.pages_written > 0);
+    CHECK(ckpt.pages_written < POOL_SIZE / pageSize);
+
+    /* Writing far into a large block dirties a single page */
+    void* large = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, POOL_SIZE / 4, &large));
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    char* target = static_cast<char*>(large) + POOL_SIZE / 8;
+    memset(target, 0x5A, 64);
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK_EQUAL(1, ckpt.pages_written);
+    checkPage((size)(target - buffer) / pageSize);
+
+    /* The manifest carries the metadata */
+    mempool_instance copy {};
+    CHECK_EQUAL((ssize_t)sizeof(copy), pread(fd, &copy, sizeof(copy), sizeof(mempool_ckpt_manifest)));
+    CHECK_EQUAL(pool.free_map, copy.free_map);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_stop(&ckpt));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, large));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, small));
+}
+
+TEST(MempoolCkpt, mempool_checkpoint__WriteFails__AllPagesWrittenNextTime)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_start(&ckpt, &pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK_EQUAL(mempool_status_nok, mempool_checkpoint(&ckpt, -1));
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK_EQUAL(POOL_SIZE / pageSize, ckpt.pages_written);
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_stop(&ckpt));
+}
+
+TEST(MempoolCkpt, mempool_ckpt_touch__ReadIntoTrackedBlock__PageWrittenNextTime)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_start(&ckpt, &pool));
+    void* block = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, POOL_SIZE / 4, &block));
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_ckpt_touch(&ckpt, buffer - 1, 16));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_ckpt_touch(&ckpt, buffer + POOL_SIZE - 8, 16));
+
+    /* The kernel does not fault on read-only pages, it fails the call */
+    int pipeFds[2];
+    CHECK_EQUAL(0, pipe(pipeFds));
+    CHECK_EQUAL(16, write(pipeFds[1], "checkpoint data!", 16));
+    CHECK_EQUAL(-1, read(pipeFds[0], block, 16));
+    CHECK_EQUAL(EFAULT, errno);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_touch(&ckpt, block, 16));
+    CHECK_EQUAL(16, read(pipeFds[0], block, 16));
+    CHECK_EQUAL(0, memcmp(block, "checkpoint data!", 16));
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK_EQUAL(1, ckpt.pages_written);
+    checkPage((size)(static_cast<char*>(block) - buffer) / pageSize);
+
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_stop(&ckpt));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, block));
+}
+
+TEST(MempoolCkpt, mempool_checkpoint__PersistPool__BufferLocatedRelativelyToInstance)
+{
+    char poolPath[32] = "/tmp/mempool_ckpt_pool_XXXXXX";
+    int poolFd = mkstemp(poolPath);
+    CHECK(poolFd >= 0);
+    mempool_shm shm {};
+    CHECK_EQUAL(mempool_status_ok, mempool_persist_open(&shm, poolFd, POOL_SIZE, nullptr));
+    char* base = mempool_base_addr(shm.pool);
+
+    /* Another process opening the pool would leave an address that is not valid here */
+    shm.pool->base_addr = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_start(&ckpt, shm.pool));
+    POINTERS_EQUAL(base, ckpt.base_addr);
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK_EQUAL(POOL_SIZE / pageSize, ckpt.pages_written);
+
+    void* block = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(shm.pool, POOL_SIZE / 4, &block));
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    memset(static_cast<char*>(block) + POOL_SIZE / 8, 0x5A, 64);
+    CHECK_EQUAL(mempool_status_ok, mempool_checkpoint(&ckpt, fd));
+    CHECK_EQUAL(1, ckpt.pages_written);
+    CHECK_EQUAL((u64)(uintptr_t)base, readManifest().base_addr);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_ckpt_stop(&ckpt));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(shm.pool, block));
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+    close(poolFd);
+    unlink(poolPath);
+}
@@ -0,0 +1,202 @@
+#include "TestRunner.h"
+#include "mempool_ebr.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+TEST_GROUP(MempoolEbr)
+{
+    static const size BUFFER_1M_SIZE = (size)1 << 20;
+    static const size CLAIM_LEN = 100;
+    char* buffer1M = nullptr;
+    mempool_instance pool {};
+    mempool_ext ext {};
+    mempool_ebr ebr {};
+    /* Retire buckets make thread states too large for the stack */
+    std::unique_ptr<mempool_ebr_thread> reader {new mempool_ebr_thread};
+    std::unique_ptr<mempool_ebr_thread> writer {new mempool_ebr_thread};
+
+    void setup() override
+    {
+        buffer1M = new char[BUFFER_1M_SIZE];
+        mempool_config config;
+        mempool_default_config(&config);
+        config.thread_safe = true;
+        config.ext = &ext;
+        pool.base_addr = buffer1M;
+        pool.size = BUFFER_1M_SIZE;
+        CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+        CHECK_EQUAL(mempool_status_ok, mempool_ebr_init(&ebr, &pool));
+    }
+
+    void teardown() override
+    {
+        delete[] buffer1M;
+    }
+
+    void* claim()
+    {
+        void* mem = nullptr;
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, CLAIM_LEN, &mem));
+        return mem;
+    }
+};
+
+/* Node of a lock-free stack shared by test threads */
+struct StackNode
+{
+    StackNode* next;
+    u64 value;
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(MempoolEbr, mempool_ebr_init__InvalidParams__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ebr_init(nullptr, &pool));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ebr_init(&ebr, nullptr));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ebr_register(nullptr, reader.get()));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ebr_register(&ebr, nullptr));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_ebr_unregister(nullptr));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_retire(nullptr, buffer1M));
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_register(&ebr, reader.get()));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_retire(reader.get(), nullptr));
+    CHECK_EQUAL(0, mempool_ebr_collect(nullptr));
+    mempool_ebr_enter(nullptr);
+    mempool_ebr_exit(nullptr);
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_unregister(reader.get()));
+
+    pool.thread_safe = false;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_ebr_init(&ebr, &pool));
+}
+
+TEST(MempoolEbr, mempool_ebr_register__AllSlotsUsed__ErrorReturned)
+{
+    std::unique_ptr<mempool_ebr_thread[]> threads {new mempool_ebr_thread[MEMPOOL_EBR_THREADS_MAX]};
+    for (u32 i = 0; i < MEMPOOL_EBR_THREADS_MAX; ++i) {
+        CHECK_EQUAL(mempool_status_ok, mempool_ebr_register(&ebr, &threads[i]));
+        CHECK_EQUAL(i, threads[i].slot);
+    }
+    CHECK_EQUAL(mempool_status_nok, mempool_ebr_register(&ebr, reader.get()));
+
+    /* Released slots are reused */
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_unregister(&threads[5]));
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_register(&ebr, reader.get()));
+    CHECK_EQUAL(5, reader->slot);
+}
+
+TEST(MempoolEbr, mempool_retire__ReaderInsideSection__FreedAfterGracePeriod)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_register(&ebr, reader.get()));
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_register(&ebr, writer.get()));
+    const size used = mempool_memory_used(&pool);
+    void* mem = claim();
+
+    /* The reader pins the epoch the block was retired in */
+    mempool_ebr_enter(reader.get());
+    mempool_ebr_enter(reader.get());
+    CHECK_EQUAL(mempool_status_ok, mempool_retire(writer.get(), mem));
+    CHECK_EQUAL(0, mempool_ebr_collect(writer.get()));
+    CHECK_EQUAL(0, mempool_ebr_collect(writer.get()));
+    mempool_ebr_exit(reader.get());
+    CHECK_EQUAL(0, mempool_ebr_collect(writer.get()));
+    CHECK(mempool_memory_used(&pool) > used);
+
+    mempool_ebr_exit(reader.get());
+    CHECK_EQUAL(1, mempool_ebr_collect(writer.get()));
+    CHECK_EQUAL(used, mempool_memory_used(&pool));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_unregister(reader.get()));
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_unregister(writer.get()));
+}
+
+TEST(MempoolEbr, mempool_retire__BucketsFullInsideSection__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_register(&ebr, writer.get()));
+    std::vector<void*> blocks(2 * MEMPOOL_EBR_BATCH + 1);
+    for (auto& block : blocks) {
+        block = claim();
+    }
+
+    /* The epoch advances once past the one pinned by the writer and then stalls */
+    mempool_ebr_enter(writer.get());
+    for (size i = 0; i < 2 * MEMPOOL_EBR_BATCH; ++i) {
+        CHECK_EQUAL(mempool_status_ok, mempool_retire(writer.get(), blocks[i]));
+    }
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_retire(writer.get(), blocks.back()));
+    mempool_ebr_exit(writer.get());
+
+    CHECK_EQUAL(mempool_status_ok, mempool_retire(writer.get(), blocks.back()));
+    CHECK_EQUAL(mempool_status_ok, mempool_ebr_unregister(writer.get()));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolEbr, mempool_retire__ConcurrentStack__AllMemoryReclaimed)
+{
+    static const int THREADS_NUM = 4;
+    static const int ITERATIONS = 20000;
+    static const u64 NODE_MAGIC = 0x5EEDC0DE;
+    StackNode* top = nullptr;
+    for (int i = 0; i < THREADS_NUM; ++i) {
+        auto node = static_cast<StackNode*>(claim());
+        node->value = NODE_MAGIC;
+        node->next = top;
+        top = node;
+    }
+
+    /* Each thread replaces the top node and retires the old one while others traverse the stack */
+    std::vector<u32> errors(THREADS_NUM, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS_NUM; ++t) {
+        threads.emplace_back([&, t]() {
+            std::unique_ptr<mempool_ebr_thread> self {new mempool_ebr_thread};
+            CHECK_EQUAL(mempool_status_ok, mempool_ebr_register(&ebr, self.get()));
+            for (int i = 0; i < ITERATIONS; ++i) {
+                void* mem = nullptr;
+                if (mempool_status_ok != mempool_claim_memory(&pool, CLAIM_LEN, &mem)) {
+                    errors[t]++;
+                    continue;
+                }
+                auto fresh = static_cast<StackNode*>(mem);
+                fresh->value = NODE_MAGIC;
+
+                mempool_ebr_enter(self.get());
+                StackNode* old = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+                for (StackNode* node = old; nullptr != node; node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) {
+                    errors[t] += (NODE_MAGIC != __atomic_load_n(&node->value, __ATOMIC_RELAXED));
+                }
+                do {
+                    fresh->next = __atomic_load_n(&old->next, __ATOMIC_ACQUIRE);
+                } while (!__atomic_compare_exchange_n(&top, &old, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+                mempool_ebr_exit(self.get());
+
+                errors[t] += (mempool_status_ok != mempool_retire(self.get(), old));
+            }
+            CHECK_EQUAL(mempool_status_ok, mempool_ebr_unregister(self.get()));
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto error : errors) {
+        CHECK_EQUAL(0, error);
+    }
+
+    /* Only the nodes left on the stack remain claimed */
+    size nodes = 0;
+    for (StackNode* node = top; nullptr != node;) {
+        StackNode* next = node->next;
+        CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, node));
+        node = next;
+        nodes++;
+    }
+    CHECK_EQUAL(THREADS_NUM, nodes);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
@@ -0,0 +1,232 @@
+#include "TestRunner.h"
+#include "mempool_maint.h"
+
+#include <chrono>
+#include <thread>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+TEST_GROUP(MempoolMaint)
+{
+    static const size BUFFER_1M_SIZE = (size)1 << 20;
+    /* 100 bytes with a header fit into 256-byte partitions */
+    static const size CLAIM_LEN = 100;
+    static const u32 CLAIM_ORDER = 8;
+    static const u32 LOW_MARK = 8;
+    char* buffer1M = nullptr;
+    mempool_instance pool {};
+    mempool_ext ext {};
+    mempool_maint maint {};
+
+    void setup() override
+    {
+        buffer1M = new char[BUFFER_1M_SIZE];
+        mempool_config config;
+        mempool_default_config(&config);
+        config.thread_safe = true;
+        config.ext = &ext;
+        pool.base_addr = buffer1M;
+        pool.size = BUFFER_1M_SIZE;
+        CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    }
+
+    void teardown() override
+    {
+        delete[] buffer1M;
+    }
+
+    /* Wait until the stock is full or a second passes */
+    bool waitForStock(u32 count)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (__atomic_load_n(&pool.free_counts[CLAIM_ORDER], __ATOMIC_RELAXED) < count) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(MempoolMaint, mempool_set_low_watermark__InvalidParams__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_set_low_watermark(nullptr, CLAIM_LEN, LOW_MARK));
+    CHECK_EQUAL(mempool_status_size_err, mempool_set_low_watermark(&pool, 0, LOW_MARK));
+    CHECK_EQUAL(mempool_status_size_err, mempool_set_low_watermark(&pool, (size)-1, LOW_MARK));
+    CHECK_EQUAL(0, ext.stock_map);
+    CHECK_EQUAL(0, mempool_replenish(nullptr, 1));
+}
+
+TEST(MempoolMaint, mempool_replenish__LowWatermarkSet__StockSplitInAdvance)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_set_low_watermark(&pool, CLAIM_LEN, LOW_MARK));
+    CHECK_EQUAL(1, mempool_replenish(&pool, 1));
+    CHECK_EQUAL(2, pool.free_counts[CLAIM_ORDER]);
+    CHECK_EQUAL(LOW_MARK / 2 - 1, mempool_replenish(&pool, (size)-1));
+    CHECK_EQUAL(LOW_MARK, pool.free_counts[CLAIM_ORDER]);
+    CHECK_EQUAL(0, mempool_replenish(&pool, (size)-1));
+
+    /* A claim takes a stocked partition without splitting, a free does not merge it back */
+    const size partitions = mempool_partitions_used(&pool);
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, CLAIM_LEN, &mem));
+    CHECK_EQUAL(partitions, mempool_partitions_used(&pool));
+    CHECK_EQUAL(LOW_MARK - 1, pool.free_counts[CLAIM_ORDER]);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, mem));
+    CHECK_EQUAL(LOW_MARK, pool.free_counts[CLAIM_ORDER]);
+
+    /* Stocks are coalesced when a claim cannot be served otherwise */
+    void* whole = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, BUFFER_1M_SIZE - mempool_calc_hdr_size(), &whole));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, whole));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_set_low_watermark(&pool, CLAIM_LEN, 0));
+    CHECK_EQUAL(0, ext.stock_map);
+}
+
+TEST(MempoolMaint, mempool_maint_start__InvalidParams__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_maint_start(nullptr, &pool, 0));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_maint_start(&maint, nullptr, 0));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_maint_stop(nullptr));
+    pool.thread_safe = false;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_maint_start(&maint, &pool, 0));
+}
+
+TEST(MempoolMaint, mempool_maint_start__ClaimsDrainStock__RefilledInBackground)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_set_low_watermark(&pool, CLAIM_LEN, LOW_MARK));
+    CHECK_EQUAL(mempool_status_ok, mempool_maint_start(&maint, &pool, FUTEX_WAIT_FOREVER));
+    CHECK_TRUE(waitForStock(LOW_MARK));
+
+    /* Each claim below the watermark kicks the thread */
+    void* blocks[LOW_MARK];
+    for (auto& block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, CLAIM_LEN, &block));
+    }
+    CHECK_TRUE(waitForStock(LOW_MARK));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_maint_stop(&maint));
+    CHECK(maint.passes >= 2);
+    for (auto block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, block));
+    }
+}
+
+TEST(MempoolMaint, mempool_maint_start__LockFreeCache__DrainedPeriodically)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    config.lock_free = true;
+    config.ext = &ext;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, CLAIM_LEN, &mem));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, mem));
+
+    /* The cached block is merged back by the thread */
+    CHECK_EQUAL(mempool_status_ok, mempool_maint_start(&maint, &pool, 1000 * 1000));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (__atomic_load_n(&maint.passes, __ATOMIC_RELAXED) < 2 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+    CHECK_EQUAL(mempool_status_ok, mempool_maint_stop(&maint));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolMaint, mempool_maintain__InvalidParams__NoWorkReported)
+{
+    CHECK_FALSE(mempool_maintain(nullptr, 1));
+    CHECK_FALSE(mempool_maintain(&pool, 1));
+}
+
+TEST(MempoolMaint, mempool_maintain__BudgetedSlices__WorkDoneIncrementally)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    config.lock_free = true;
+    config.ext = &ext;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    void* blocks[4];
+    for (auto& block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, CLAIM_LEN, &block));
+    }
+    for (auto block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, block));
+    }
+    CHECK_EQUAL(mempool_status_ok, mempool_set_low_watermark(&pool, CLAIM_LEN, 2));
+
+    /* Four cached blocks, one step per call. Two of them stay unmerged as the stock, so nothing has to be split */
+    CHECK_TRUE(mempool_maintain(&pool, 0));
+    size calls = 1;
+    while (mempool_maintain(&pool, 1)) {
+        calls++;
+    }
+    CHECK_EQUAL(4, calls);
+    CHECK_EQUAL(2, pool.free_counts[CLAIM_ORDER]);
+    CHECK_FALSE(mempool_maintain(&pool, (size)-1));
+    CHECK_FALSE(mempool_maintain(&pool, 0));
+}
+
+TEST(MempoolMaint, mempool_maintain__BudgetMatchesWork__NoWorkReported)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    config.lock_free = true;
+    config.ext = &ext;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    CHECK_FALSE(mempool_maintain(&pool, 0));
+    void* blocks[2];
+    for (auto& block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, CLAIM_LEN, &block));
+    }
+    for (auto block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, block));
+    }
+
+    /* The budget is used up by the last cached block, nothing is left afterwards */
+    CHECK_TRUE(mempool_maintain(&pool, 0));
+    CHECK_FALSE(mempool_maintain(&pool, 2));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+static size releaseCalls = 0;
+
+static bool countRelease(void* backing, void* addr, size len)
+{
+    (void)backing;
+    (void)addr;
+    (void)len;
+    releaseCalls++;
+    return true;
+}
+
+TEST(MempoolMaint, mempool_maintain__TrimThresholdSet__LargePartitionsReleased)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    config.release_fn = countRelease;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, CLAIM_LEN, &mem));
+    CHECK_FALSE(mempool_maintain(&pool, (size)-1));
+
+    /* Free partitions of 256K and 512K are released one per step */
+    releaseCalls = 0;
+    mempool_set_trim_threshold(&pool, BUFFER_1M_SIZE / 4);
+    CHECK_TRUE(mempool_maintain(&pool, 1));
+    CHECK_EQUAL(1, releaseCalls);
+    CHECK_FALSE(mempool_maintain(&pool, (size)-1));
+    CHECK_EQUAL(2, releaseCalls);
+    CHECK_FALSE(mempool_maintain(&pool, (size)-1));
+    CHECK_EQUAL(2, releaseCalls);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, mem));
+}
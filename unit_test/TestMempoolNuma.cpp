@@ -0,0 +1,132 @@
+#include "TestRunner.h"
+#include "mempool_numa.h"
+#include "mempool_vm.h"
+
+#include <cstring>
+#include <vector>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+TEST_GROUP(MempoolNuma)
+{
+    static const size POOL_1M_SIZE = (size)1 << 20;
+    mempool_numa_set* set = nullptr;
+
+    void setup() override
+    {
+        set = new mempool_numa_set;
+        CHECK_EQUAL(mempool_status_ok, mempool_numa_create(set, POOL_1M_SIZE, 0));
+    }
+
+    void teardown() override
+    {
+        CHECK_EQUAL(mempool_status_ok, mempool_numa_destroy(set));
+        CHECK_EQUAL(0, set->node_cnt);
+        delete set;
+    }
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(MempoolNuma, mempool_numa_create__InvalidParams__ErrorReturned)
+{
+    mempool_numa_set other;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_numa_create(nullptr, POOL_1M_SIZE, 0));
+    CHECK_EQUAL(mempool_status_size_err, mempool_numa_create(&other, POOL_1M_SIZE + 1, 0));
+    CHECK_EQUAL(0, other.node_cnt);
+    CHECK_EQUAL(mempool_status_nullptr, mempool_numa_destroy(nullptr));
+}
+
+TEST(MempoolNuma, mempool_numa_create__OnlineNodes__PoolPerNodeCreated)
+{
+    CHECK(set->node_cnt >= 1);
+    CHECK(set->node_cnt <= MEMPOOL_NUMA_NODES_MAX);
+    for (u32 i = 0; i < set->node_cnt; ++i) {
+        CHECK_EQUAL(POOL_1M_SIZE, set->pools[i].size);
+        CHECK_EQUAL(1, mempool_partitions_used(&set->pools[i]));
+    }
+}
+
+TEST(MempoolNuma, mempool_numa_claim__ClaimAndFree__ReturnedToOwner)
+{
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_numa_claim(set, 1000, &dst));
+    u32 owner = mempool_numa_owner(set, dst);
+    CHECK(owner < set->node_cnt);
+    CHECK(mempool_partitions_used(&set->pools[owner]) > 1);
+    memset(dst, 0xAB, 1000);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_numa_free(set, dst));
+    CHECK_EQUAL(1, mempool_partitions_used(&set->pools[owner]));
+}
+
+TEST(MempoolNuma, mempool_numa_claim__LocalPoolExhausted__OtherNodesUsed)
+{
+    /* Each pool can serve a single claim of half of its size plus one byte */
+    const size len = POOL_1M_SIZE / 2 + 1;
+    void* claims[MEMPOOL_NUMA_NODES_MAX];
+    for (u32 i = 0; i < set->node_cnt; ++i) {
+        CHECK_EQUAL(mempool_status_ok, mempool_numa_claim(set, len, &claims[i]));
+    }
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_numa_claim(set, len, &dst));
+
+    for (u32 i = 0; i < set->node_cnt; ++i) {
+        CHECK_EQUAL(mempool_status_ok, mempool_numa_free(set, claims[i]));
+    }
+}
+
+TEST(MempoolNuma, mempool_numa_free__ForeignMemory__ErrorReturned)
+{
+    char foreign[64];
+    CHECK_EQUAL(mempool_status_nullptr, mempool_numa_free(nullptr, foreign));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_numa_free(set, nullptr));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_numa_free(set, foreign));
+    CHECK_EQUAL(MEMPOOL_NUMA_NODES_MAX, mempool_numa_owner(set, foreign));
+    CHECK_EQUAL(MEMPOOL_NUMA_NODES_MAX, mempool_numa_owner(nullptr, foreign));
+}
+
+TEST(MempoolNuma, mempool_numa_free__DirectMapping__ReturnedToOwner)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_set_direct_threshold(&set->pools[0], 4096));
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&set->pools[0], POOL_1M_SIZE, &dst));
+    CHECK_EQUAL(0, mempool_numa_owner(set, dst));
+    CHECK_EQUAL(mempool_status_ok, mempool_numa_free(set, dst));
+    CHECK_EQUAL(0, mempool_direct_maps(&set->pools[0]));
+}
+
+TEST(MempoolNuma, mempool_numa_free__ExtraRegion__ReturnedToOwner)
+{
+    const size regionLen = (size)1 << 16;
+    std::vector<u64> region(regionLen / sizeof(u64));
+    mempool_instance* pool = &set->pools[set->node_cnt - 1];
+    CHECK_EQUAL(mempool_status_ok, mempool_add_region(pool, region.data(), regionLen));
+
+    /* The whole buffer is taken, so the second claim is served from the region */
+    void* whole = nullptr;
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(pool, POOL_1M_SIZE / 2 + 1, &whole));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(pool, 1000, &dst));
+    CHECK(static_cast<char*>(dst) >= reinterpret_cast<char*>(region.data()));
+    CHECK(static_cast<char*>(dst) < reinterpret_cast<char*>(region.data()) + regionLen);
+
+    CHECK_EQUAL(set->node_cnt - 1, mempool_numa_owner(set, dst));
+    CHECK_EQUAL(mempool_status_ok, mempool_numa_free(set, dst));
+    CHECK_EQUAL(mempool_status_ok, mempool_numa_free(set, whole));
+}
+
+TEST(MempoolNuma, mempool_numa_create__PoolsInSingleMapping__OwnerComputedFromAddress)
+{
+    for (u32 i = 0; i < set->node_cnt; ++i) {
+        POINTERS_EQUAL(set->pools[0].base_addr + i * POOL_1M_SIZE, set->pools[i].base_addr);
+        CHECK_EQUAL(i, mempool_numa_owner(set, set->pools[i].base_addr + POOL_1M_SIZE - 1));
+    }
+    CHECK_EQUAL(MEMPOOL_NUMA_NODES_MAX, mempool_numa_owner(set, set->pools[0].base_addr - 1));
+    CHECK_EQUAL(MEMPOOL_NUMA_NODES_MAX,
+                mempool_numa_owner(set, set->pools[0].base_addr + set->node_cnt * POOL_1M_SIZE));
+}
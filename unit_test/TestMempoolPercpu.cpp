@@ -0,0 +1,168 @@
+#include "TestRunner.h"
+#include "mempool_percpu.h"
+#include "mempool_vm.h"
+
+#include <cstring>
+#include <sched.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+TEST_GROUP(MempoolPercpu)
+{
+    static const size POOL_1M_SIZE = (size)1 << 20;
+    mempool_percpu_set* set = nullptr;
+
+    void setup() override
+    {
+        set = new mempool_percpu_set;
+        CHECK_EQUAL(mempool_status_ok, mempool_percpu_create(set, POOL_1M_SIZE, 0));
+    }
+
+    void teardown() override
+    {
+        CHECK_EQUAL(mempool_status_ok, mempool_percpu_destroy(set));
+        CHECK_EQUAL(0, set->pool_cnt);
+        delete set;
+    }
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(MempoolPercpu, mempool_percpu_create__InvalidParams__ErrorReturned)
+{
+    auto other = new mempool_percpu_set;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_percpu_create(nullptr, POOL_1M_SIZE, 0));
+    CHECK_EQUAL(mempool_status_size_err, mempool_percpu_create(other, POOL_1M_SIZE + 1, 0));
+    CHECK_EQUAL(0, other->pool_cnt);
+    CHECK_EQUAL(mempool_status_nullptr, mempool_percpu_destroy(nullptr));
+    CHECK_EQUAL(0, mempool_percpu_current(nullptr));
+    CHECK_EQUAL(MEMPOOL_PERCPU_MAX, mempool_percpu_owner(nullptr, set->pools[0].base_addr));
+    delete other;
+}
+
+TEST(MempoolPercpu, mempool_percpu_create__ConfiguredCpus__ThreadSafePoolPerCpu)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    CHECK_EQUAL((cpus > MEMPOOL_PERCPU_MAX) ? MEMPOOL_PERCPU_MAX : cpus, set->pool_cnt);
+    for (u32 i = 0; i < set->pool_cnt; ++i) {
+        CHECK_EQUAL(POOL_1M_SIZE, set->pools[i].size);
+        CHECK_TRUE(set->pools[i].thread_safe);
+        CHECK_EQUAL(1, mempool_partitions_used(&set->pools[i]));
+    }
+    CHECK(mempool_percpu_current(set) < set->pool_cnt);
+}
+
+TEST(MempoolPercpu, mempool_percpu_claim__ClaimAndFree__ServedByCurrentCpu)
+{
+    /* Pin the thread, so the CPU cannot change between the calls */
+    cpu_set_t oldMask;
+    cpu_set_t mask;
+    CHECK_EQUAL(0, sched_getaffinity(0, sizeof(oldMask), &oldMask));
+    CPU_ZERO(&mask);
+    CPU_SET(sched_getcpu(), &mask);
+    CHECK_EQUAL(0, sched_setaffinity(0, sizeof(mask), &mask));
+
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_percpu_claim(set, 1000, &dst));
+    u32 owner = mempool_percpu_owner(set, dst);
+    CHECK_EQUAL(mempool_percpu_current(set), owner);
+    CHECK_EQUAL((u32)sched_getcpu() % set->pool_cnt, owner);
+    CHECK(mempool_partitions_used(&set->pools[owner]) > 1);
+    memset(dst, 0xAB, 1000);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_percpu_free(set, dst));
+    CHECK_EQUAL(1, mempool_partitions_used(&set->pools[owner]));
+    CHECK_EQUAL(0, sched_setaffinity(0, sizeof(oldMask), &oldMask));
+}
+
+TEST(MempoolPercpu, mempool_percpu_claim__LocalPoolExhausted__OtherPoolUsedOrOutOfMemory)
+{
+    u32 local = mempool_percpu_current(set);
+    void* whole = nullptr;
+    CHECK_EQUAL(mempool_status_ok,
+                mempool_claim_memory(&set->pools[local], POOL_1M_SIZE - mempool_calc_hdr_size(), &whole));
+
+    void* dst = nullptr;
+    mempool_status status = mempool_percpu_claim(set, 100, &dst);
+    if (1 == set->pool_cnt) {
+        CHECK_EQUAL(mempool_status_out_of_memory, status);
+    } else {
+        CHECK_EQUAL(mempool_status_ok, status);
+        CHECK(mempool_percpu_owner(set, dst) < set->pool_cnt);
+        CHECK_EQUAL(mempool_status_ok, mempool_percpu_free(set, dst));
+    }
+    CHECK_EQUAL(mempool_status_ok, mempool_percpu_free(set, whole));
+}
+
+TEST(MempoolPercpu, mempool_percpu_free__ForeignMemory__ErrorReturned)
+{
+    char buffer[64];
+    CHECK_EQUAL(mempool_status_nullptr, mempool_percpu_free(nullptr, buffer));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_percpu_free(set, nullptr));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_percpu_free(set, buffer));
+    CHECK_EQUAL(MEMPOOL_PERCPU_MAX, mempool_percpu_owner(set, buffer));
+}
+
+TEST(MempoolPercpu, mempool_percpu_owner__PoolsInSingleMapping__OwnerComputedFromAddress)
+{
+    for (u32 i = 0; i < set->pool_cnt; ++i) {
+        POINTERS_EQUAL(set->pools[0].base_addr + i * POOL_1M_SIZE, set->pools[i].base_addr);
+        CHECK_EQUAL(i, mempool_percpu_owner(set, set->pools[i].base_addr));
+        CHECK_EQUAL(i, mempool_percpu_owner(set, set->pools[i].base_addr + POOL_1M_SIZE - 1));
+    }
+    CHECK_EQUAL(MEMPOOL_PERCPU_MAX, mempool_percpu_owner(set, set->pools[0].base_addr - 1));
+    CHECK_EQUAL(MEMPOOL_PERCPU_MAX,
+                mempool_percpu_owner(set, set->pools[0].base_addr + set->pool_cnt * POOL_1M_SIZE));
+}
+
+TEST(MempoolPercpu, mempool_percpu_free__DirectMapping__ReturnedToOwner)
+{
+    mempool_instance* pool = &set->pools[set->pool_cnt - 1];
+    CHECK_EQUAL(mempool_status_ok, mempool_set_direct_threshold(pool, 4096));
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(pool, POOL_1M_SIZE, &dst));
+    CHECK_EQUAL(set->pool_cnt - 1, mempool_percpu_owner(set, dst));
+    CHECK_EQUAL(mempool_status_ok, mempool_percpu_free(set, dst));
+    CHECK_EQUAL(0, mempool_direct_maps(pool));
+}
+
+TEST(MempoolPercpu, mempool_percpu_claim__ManyThreads__AllPoolsMergedBack)
+{
+    std::vector<std::thread> threads;
+    std::vector<size> errors(32, 0);
+    for (size t = 0; t < errors.size(); ++t) {
+        threads.emplace_back([this, t, &errors]() {
+            void* slots[8] = {};
+            for (size i = 0; i < 2000; ++i) {
+                void*& slot = slots[i % 8];
+                if (nullptr != slot) {
+                    errors[t] += (mempool_status_ok != mempool_percpu_free(set, slot));
+                    slot = nullptr;
+                } else {
+                    errors[t] += (mempool_status_ok != mempool_percpu_claim(set, 16 + (i * 7) % 1000, &slot));
+                }
+            }
+            for (auto slot : slots) {
+                if (nullptr != slot) {
+                    errors[t] += (mempool_status_ok != mempool_percpu_free(set, slot));
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto err : errors) {
+        CHECK_EQUAL(0, err);
+    }
+    for (u32 i = 0; i < set->pool_cnt; ++i) {
+        CHECK_EQUAL(1, mempool_partitions_used(&set->pools[i]));
+    }
+}
@@ -0,0 +1,228 @@
+#include "TestRunner.h"
+#include "mempool_persist.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+TEST_GROUP(MempoolPersist)
+{
+    static const size POOL_SIZE = (size)1 << 20;
+    static const size BLOCK_LEN = 100;
+    char path[32] = "/tmp/mempool_persist_XXXXXX";
+    int fd = -1;
+    mempool_shm shm {};
+
+    void setup() override
+    {
+        fd = mkstemp(path);
+        CHECK(fd >= 0);
+    }
+
+    void teardown() override
+    {
+        close(fd);
+        unlink(path);
+    }
+
+    /* Run a function in a child process and return its wait status */
+    template<typename Fn>
+    int runChild(Fn fn)
+    {
+        pid_t pid = fork();
+        if (0 == pid) {
+            fn();
+            _exit(0);
+        }
+        int status = 0;
+        CHECK_EQUAL(pid, waitpid(pid, &status, 0));
+        return status;
+    }
+
+    /* Free all claimed blocks. The pool is consistent if it merges back into a single partition */
+    void freeAll()
+    {
+        std::vector<mempool_debug_info> info(mempool_partitions_used(shm.pool));
+        mempool_decode_debug_info(shm.pool, info.data());
+        for (const auto& part : info) {
+            if (part.room_occupied) {
+                CHECK_EQUAL(mempool_status_ok, mempool_free_memory(shm.pool, const_cast<void*>(part.usable_space_addr)));
+            }
+        }
+        CHECK_EQUAL(1, mempool_partitions_used(shm.pool));
+        CHECK_EQUAL(shm.pool->hdr_size, mempool_memory_used(shm.pool));
+    }
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(MempoolPersist, mempool_persist_open__InvalidParams__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_persist_open(nullptr, fd, POOL_SIZE, nullptr));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_persist_sync(nullptr));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_recover(nullptr, nullptr));
+    CHECK_EQUAL(mempool_status_size_err, mempool_persist_open(&shm, fd, POOL_SIZE + 1, nullptr));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_persist_open(&shm, -1, POOL_SIZE, nullptr));
+
+    /* A file that does not hold a pool is rejected */
+    CHECK_EQUAL(1, write(fd, "x", 1));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_persist_open(&shm, fd, POOL_SIZE, nullptr));
+    CHECK_EQUAL(0, ftruncate(fd, 3 * POOL_SIZE));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_persist_open(&shm, fd, POOL_SIZE, nullptr));
+}
+
+TEST(MempoolPersist, mempool_init_ex__UndoLogWithUnsupportedOptions__ErrorReturned)
+{
+    static char buffer[4096];
+    static char log[64];
+    static mempool_ext ext;
+    mempool_instance pool {};
+    pool.base_addr = buffer;
+    pool.size = sizeof(buffer);
+    mempool_config config;
+    mempool_default_config(&config);
+    config.hdr_type = mempool_hdr_off16;
+    config.undo_log = log;
+    config.undo_log_len = sizeof(log);
+    CHECK_EQUAL(mempool_status_not_supported, mempool_init_ex(&pool, &config));
+    config.shared = true;
+    config.thread_safe = true;
+    config.ext = &ext;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_init_ex(&pool, &config));
+    config.thread_safe = false;
+    CHECK_EQUAL(mempool_status_size_err, mempool_init_ex(&pool, &config));
+}
+
+TEST(MempoolPersist, mempool_persist_open__Reopened__DataIntact)
+{
+    static const size BLOCKS_NUM = 16;
+    size undone = 1;
+    CHECK_EQUAL(mempool_status_ok, mempool_persist_open(&shm, fd, POOL_SIZE, &undone));
+    CHECK_EQUAL(0, undone);
+
+    /* The first block holds offsets of the others */
+    void* root = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(shm.pool, BLOCKS_NUM * sizeof(u64), &root));
+    const u64 rootOffset = mempool_shm_offset(&shm, root);
+    for (size i = 0; i < BLOCKS_NUM; ++i) {
+        void* block = nullptr;
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(shm.pool, BLOCK_LEN * (i + 1), &block));
+        memset(block, (int)i, BLOCK_LEN * (i + 1));
+        static_cast<u64*>(root)[i] = mempool_shm_offset(&shm, block);
+    }
+    const size partitions = mempool_partitions_used(shm.pool);
+    CHECK_EQUAL(mempool_status_ok, mempool_persist_sync(&shm));
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_persist_open(&shm, fd, 0, &undone));
+    CHECK_EQUAL(0, undone);
+    CHECK_EQUAL(partitions, mempool_partitions_used(shm.pool));
+    auto offsets = static_cast<u64*>(mempool_shm_pointer(&shm, rootOffset));
+    for (size i = 0; i < BLOCKS_NUM; ++i) {
+        auto block = static_cast<unsigned char*>(mempool_shm_pointer(&shm, offsets[i]));
+        for (size j = 0; j < BLOCK_LEN * (i + 1); ++j) {
+            CHECK_EQUAL(i, block[j]);
+        }
+    }
+    freeAll();
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+}
+
+TEST(MempoolPersist, mempool_recover__ClaimInterrupted__RolledBack)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_persist_open(&shm, fd, POOL_SIZE, nullptr));
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+
+    /* Splitting the whole pool down to a small block touches the header at 128 KiB after two splits */
+    int status = runChild([&]() {
+        mempool_shm child {};
+        (void)mempool_persist_open(&child, fd, 0, nullptr);
+        mprotect(child.pool->base_addr + POOL_SIZE / 8, (size)sysconf(_SC_PAGESIZE), PROT_READ);
+        void* block = nullptr;
+        (void)mempool_claim_memory(child.pool, BLOCK_LEN, &block);
+    });
+    CHECK_TRUE(WIFSIGNALED(status));
+
+    size undone = 0;
+    CHECK_EQUAL(mempool_status_ok, mempool_persist_open(&shm, fd, 0, &undone));
+    CHECK(undone > 0);
+    CHECK_EQUAL(1, mempool_partitions_used(shm.pool));
+    CHECK_EQUAL(shm.pool->hdr_size, mempool_memory_used(shm.pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+}
+
+TEST(MempoolPersist, mempool_recover__FreeInterrupted__BlockStaysClaimed)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_persist_open(&shm, fd, POOL_SIZE, nullptr));
+    void* block = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(shm.pool, BLOCK_LEN, &block));
+    const u64 blockOffset = mempool_shm_offset(&shm, block);
+    const size partitions = mempool_partitions_used(shm.pool);
+    const size used = mempool_memory_used(shm.pool);
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+
+    /* Merging back removes the free buddy at 64 KiB from its list after a few merges */
+    int status = runChild([&]() {
+        mempool_shm child {};
+        (void)mempool_persist_open(&child, fd, 0, nullptr);
+        mprotect(child.pool->base_addr + POOL_SIZE / 16, (size)sysconf(_SC_PAGESIZE), PROT_READ);
+        (void)mempool_free_memory(child.pool, mempool_shm_pointer(&child, blockOffset));
+    });
+    CHECK_TRUE(WIFSIGNALED(status));
+
+    size undone = 0;
+    CHECK_EQUAL(mempool_status_ok, mempool_persist_open(&shm, fd, 0, &undone));
+    CHECK(undone > 0);
+    CHECK_EQUAL(partitions, mempool_partitions_used(shm.pool));
+    CHECK_EQUAL(used, mempool_memory_used(shm.pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(shm.pool, mempool_shm_pointer(&shm, blockOffset)));
+    CHECK_EQUAL(1, mempool_partitions_used(shm.pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+}
+
+TEST(MempoolPersist, mempool_recover__ProcessKilledRepeatedly__PoolConsistent)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_persist_open(&shm, fd, POOL_SIZE, nullptr));
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+
+    for (unsigned round = 0; round < 8; ++round) {
+        pid_t pid = fork();
+        if (0 == pid) {
+            mempool_shm child {};
+            if (mempool_status_ok != mempool_persist_open(&child, fd, 0, nullptr)) {
+                _exit(1);
+            }
+            void* blocks[32] = {};
+            for (unsigned i = round;; ++i) {
+                void*& block = blocks[(i * 7) % 32];
+                if (nullptr != block) {
+                    (void)mempool_free_memory(child.pool, block);
+                }
+                block = nullptr;
+                (void)mempool_claim_memory(child.pool, (size)(16 + (i % 11) * 300), &block);
+            }
+        }
+        usleep(1000 + round * 700);
+        kill(pid, SIGKILL);
+        int status = 0;
+        CHECK_EQUAL(pid, waitpid(pid, &status, 0));
+        CHECK_TRUE(WIFSIGNALED(status));
+
+        /* Blocks of the killed process are leaked, but the pool has to be intact */
+        CHECK_EQUAL(mempool_status_ok, mempool_persist_open(&shm, fd, 0, nullptr));
+        if (0 == round % 2) {
+            freeAll();
+        }
+        CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+    }
+}
@@ -32,6 +32,12 @@ TEST_GROUP(MempoolSanityCheck)
 /* ------------------------ Test cases ------------------------ */
 /* ------------------------------------------------------------ */
 
+TEST(MempoolSanityCheck, mempool_calc_hdr_size__MagicIncluded__SizeNotChanged)
+{
+    /* Magic number shares the word of flags, so headers are as long as without sanity checks */
+    CHECK_EQUAL(5 * sizeof(void*), mempool_calc_hdr_size());
+}
+
 TEST(MempoolSanityCheck, mempool_free_memory__AfterInit__InvalidPointerGiven__Error)
 {
     mempool_instance pool;
@@ -57,4 +63,35 @@ TEST(MempoolSanityCheck, mempool_free_memory__AfterInit__ReservedAndFree_Ok)
     CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr));
     CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr2));
     CHECK_EQUAL(1, mempool_partitions_used(&pool));
-}
\ No newline at end of file
+}
+
+TEST(MempoolSanityCheck, mempool_free_memory__CompactHdr__InvalidPointerGiven__Error)
+{
+    mempool_config config;
+    mempool_default_config(&config);
+    config.hdr_type = mempool_hdr_off16;
+
+    mempool_instance pool;
+    pool.base_addr = &buffer2K[0];
+    pool.size = BUFFER_2K_SIZE;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+
+    void* ptr = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &ptr));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_free_memory(&pool, static_cast<char*>(ptr) + 8));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolSanityCheck, mempool_realloc_memory__InvalidPointerGiven__Error)
+{
+    mempool_instance pool;
+    initMempool(&pool);
+
+    void* ptr = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &ptr));
+    void* invalid = static_cast<char*>(ptr) + 8;
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_realloc_memory(&pool, &invalid, 200));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, ptr));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
@@ -0,0 +1,158 @@
+#include "TestRunner.h"
+#include "mempool_shard.h"
+
+#include <thread>
+#include <vector>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+TEST_GROUP(MempoolShard)
+{
+    static const size BUFFER_1M_SIZE = (size)1 << 20;
+    static const u32 SHARDS_NUM = 4;
+    char* buffer1M = nullptr;
+    mempool_sharded* pool = nullptr;
+    mempool_config config {};
+    mempool_ext exts[MEMPOOL_SHARDS_MAX] {};
+
+    void setup() override
+    {
+        buffer1M = new char[BUFFER_1M_SIZE];
+        pool = new mempool_sharded;
+        pool->base_addr = buffer1M;
+        pool->size = BUFFER_1M_SIZE;
+        mempool_default_config(&config);
+        config.ext = exts;
+    }
+
+    void teardown() override
+    {
+        delete pool;
+        delete[] buffer1M;
+    }
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(MempoolShard, mempool_shard_init__InvalidParams__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_shard_init(nullptr, SHARDS_NUM, &config));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_shard_init(pool, SHARDS_NUM, nullptr));
+    CHECK_EQUAL(mempool_status_size_err, mempool_shard_init(pool, 0, &config));
+    CHECK_EQUAL(mempool_status_size_err, mempool_shard_init(pool, 3, &config));
+    CHECK_EQUAL(mempool_status_size_err, mempool_shard_init(pool, MEMPOOL_SHARDS_MAX * 2, &config));
+    pool->size = BUFFER_1M_SIZE - 1;
+    CHECK_EQUAL(mempool_status_size_err, mempool_shard_init(pool, SHARDS_NUM, &config));
+    CHECK_EQUAL(0, pool->shard_cnt);
+
+    /* Shards too small to hold a header */
+    pool->size = 64;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_shard_init(pool, MEMPOOL_SHARDS_MAX, &config));
+    CHECK_EQUAL(0, pool->shard_cnt);
+
+    pool->base_addr = nullptr;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_shard_init(pool, SHARDS_NUM, &config));
+
+    /* Each shard needs an extended state */
+    pool->base_addr = buffer1M;
+    pool->size = BUFFER_1M_SIZE;
+    config.ext = nullptr;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_shard_init(pool, SHARDS_NUM, &config));
+    CHECK_EQUAL(0, pool->shard_cnt);
+}
+
+TEST(MempoolShard, mempool_shard_init__FourShards__EqualThreadSafeSubRanges)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_shard_init(pool, SHARDS_NUM, &config));
+    CHECK_EQUAL(SHARDS_NUM, pool->shard_cnt);
+    for (u32 i = 0; i < SHARDS_NUM; ++i) {
+        POINTERS_EQUAL(buffer1M + i * (BUFFER_1M_SIZE / SHARDS_NUM), pool->shards[i].base_addr);
+        CHECK_EQUAL(BUFFER_1M_SIZE / SHARDS_NUM, pool->shards[i].size);
+        CHECK_TRUE(pool->shards[i].thread_safe);
+        CHECK_EQUAL(i, mempool_shard_of(pool, pool->shards[i].base_addr));
+    }
+    CHECK(mempool_shard_current(pool) < SHARDS_NUM);
+    CHECK_EQUAL(0, mempool_shard_current(nullptr));
+}
+
+TEST(MempoolShard, mempool_shard_claim__ClaimAndFree__ServedByThreadShard)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_shard_init(pool, SHARDS_NUM, &config));
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_shard_claim(pool, 1000, &dst));
+    u32 shard = mempool_shard_of(pool, dst);
+    CHECK_EQUAL(mempool_shard_current(pool), shard);
+    CHECK(mempool_partitions_used(&pool->shards[shard]) > 1);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_shard_free(pool, dst));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool->shards[shard]));
+}
+
+TEST(MempoolShard, mempool_shard_claim__ThreadShardExhausted__OtherShardsUsed)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_shard_init(pool, SHARDS_NUM, &config));
+    const size shardLen = BUFFER_1M_SIZE / SHARDS_NUM - mempool_calc_hdr_size();
+    void* blocks[SHARDS_NUM];
+    for (auto& block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_shard_claim(pool, shardLen, &block));
+    }
+    for (u32 i = 0; i < SHARDS_NUM; ++i) {
+        CHECK_EQUAL((mempool_shard_current(pool) + i) % SHARDS_NUM, mempool_shard_of(pool, blocks[i]));
+    }
+
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_shard_claim(pool, 1, &dst));
+    for (auto block : blocks) {
+        CHECK_EQUAL(mempool_status_ok, mempool_shard_free(pool, block));
+    }
+}
+
+TEST(MempoolShard, mempool_shard_free__ForeignMemory__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_shard_init(pool, SHARDS_NUM, &config));
+    char other[64];
+    CHECK_EQUAL(mempool_status_nullptr, mempool_shard_free(nullptr, other));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_shard_free(pool, nullptr));
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_shard_free(pool, other));
+    CHECK_EQUAL(MEMPOOL_SHARDS_MAX, mempool_shard_of(pool, buffer1M + BUFFER_1M_SIZE));
+    CHECK_EQUAL(MEMPOOL_SHARDS_MAX, mempool_shard_of(nullptr, buffer1M));
+}
+
+TEST(MempoolShard, mempool_shard_claim__ManyThreads__AllShardsMergedBack)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_shard_init(pool, SHARDS_NUM, &config));
+    std::vector<std::thread> threads;
+    std::vector<size> errors(16, 0);
+    for (size t = 0; t < errors.size(); ++t) {
+        threads.emplace_back([this, t, &errors]() {
+            void* slots[8] = {};
+            for (size i = 0; i < 4000; ++i) {
+                void*& slot = slots[i % 8];
+                if (nullptr != slot) {
+                    errors[t] += (mempool_status_ok != mempool_shard_free(pool, slot));
+                    slot = nullptr;
+                } else {
+                    errors[t] += (mempool_status_ok != mempool_shard_claim(pool, 16 + (i * 7) % 1000, &slot));
+                }
+            }
+            for (auto slot : slots) {
+                if (nullptr != slot) {
+                    errors[t] += (mempool_status_ok != mempool_shard_free(pool, slot));
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (auto err : errors) {
+        CHECK_EQUAL(0, err);
+    }
+    for (u32 i = 0; i < SHARDS_NUM; ++i) {
+        CHECK_EQUAL(1, mempool_partitions_used(&pool->shards[i]));
+    }
+}
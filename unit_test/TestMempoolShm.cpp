@@ -0,0 +1,175 @@
+#include "TestRunner.h"
+#include "mempool_shm.h"
+
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+TEST_GROUP(MempoolShm)
+{
+    static const size POOL_SIZE = (size)1 << 20;
+    static const size MESSAGE_LEN = 64 * 1024;
+    int fd = -1;
+    mempool_shm shm {};
+
+    void setup() override
+    {
+        fd = memfd_create("mempool_shm_test", 0);
+        CHECK(fd >= 0);
+    }
+
+    void teardown() override
+    {
+        close(fd);
+    }
+
+    /* Run a function in a child process. True is returned if the function succeeded */
+    template<typename Fn>
+    bool runChild(Fn fn)
+    {
+        pid_t pid = fork();
+        if (0 == pid) {
+            _exit(fn() ? 0 : 1);
+        }
+        int status = 0;
+        return pid > 0 && pid == waitpid(pid, &status, 0) && WIFEXITED(status) && 0 == WEXITSTATUS(status);
+    }
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(MempoolShm, mempool_shm_create__InvalidParams__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_shm_create(nullptr, fd, POOL_SIZE));
+    CHECK_EQUAL(mempool_status_size_err, mempool_shm_create(&shm, fd, 0));
+    CHECK_EQUAL(mempool_status_size_err, mempool_shm_create(&shm, fd, POOL_SIZE + 1));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_shm_create(&shm, -1, POOL_SIZE));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_shm_attach(nullptr, fd));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_shm_detach(nullptr));
+    CHECK_EQUAL(MEMPOOL_SHM_OFFSET_NULL, mempool_shm_offset(nullptr, &shm));
+    CHECK_EQUAL(nullptr, mempool_shm_pointer(nullptr, 0));
+
+    /* An empty segment does not hold a pool */
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_shm_attach(&shm, fd));
+}
+
+TEST(MempoolShm, mempool_init_ex__SharedWithUnsupportedOptions__ErrorReturned)
+{
+    static char buffer[4096];
+    mempool_instance pool {};
+    pool.base_addr = buffer;
+    pool.size = sizeof(buffer);
+    mempool_config config;
+    mempool_default_config(&config);
+    config.shared = true;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_init_ex(&pool, &config));
+    config.hdr_type = mempool_hdr_off16;
+    config.lock_free = true;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_init_ex(&pool, &config));
+    config.lock_free = false;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&pool, &config));
+
+    mempool_tcache cache;
+    CHECK_EQUAL(mempool_status_not_supported, mempool_tcache_init(&cache, &pool));
+}
+
+TEST(MempoolShm, mempool_shm_offset__OffsetsConverted__SameMemory)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_create(&shm, fd, POOL_SIZE));
+    void* mem = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(shm.pool, MESSAGE_LEN, &mem));
+    u64 offset = mempool_shm_offset(&shm, mem);
+    CHECK_EQUAL(mem, mempool_shm_pointer(&shm, offset));
+    CHECK_EQUAL(MEMPOOL_SHM_OFFSET_NULL, mempool_shm_offset(&shm, &offset));
+    CHECK_EQUAL(nullptr, mempool_shm_pointer(&shm, shm.map_len));
+
+    /* A second mapping of the segment sees the same pool at a different address */
+    mempool_shm second {};
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_attach(&second, fd));
+    CHECK(second.map_addr != shm.map_addr);
+    CHECK_EQUAL(mempool_partitions_used(shm.pool), mempool_partitions_used(second.pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(second.pool, mempool_shm_pointer(&second, offset)));
+    CHECK_EQUAL(1, mempool_partitions_used(shm.pool));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&second));
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+    CHECK_EQUAL(nullptr, shm.pool);
+}
+
+TEST(MempoolShm, mempool_shm_attach__MessageFromChild__ReceivedWithoutCopy)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_create(&shm, fd, POOL_SIZE));
+    void* mailbox = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(shm.pool, sizeof(u64), &mailbox));
+    const u64 mailboxOffset = mempool_shm_offset(&shm, mailbox);
+
+    /* The child maps the segment on its own, claims a message and hands over its offset */
+    CHECK_TRUE(runChild([&]() {
+        mempool_shm child {};
+        if (mempool_status_ok != mempool_shm_attach(&child, fd)) {
+            return false;
+        }
+        void* message = nullptr;
+        if (mempool_status_ok != mempool_claim_memory(child.pool, MESSAGE_LEN, &message)) {
+            return false;
+        }
+        memset(message, 0xA5, MESSAGE_LEN);
+        auto box = static_cast<u64*>(mempool_shm_pointer(&child, mailboxOffset));
+        __atomic_store_n(box, mempool_shm_offset(&child, message), __ATOMIC_RELEASE);
+        return mempool_status_ok == mempool_shm_detach(&child);
+    }));
+
+    auto message = static_cast<unsigned char*>(mempool_shm_pointer(&shm, *static_cast<u64*>(mailbox)));
+    CHECK(nullptr != message);
+    for (size i = 0; i < MESSAGE_LEN; ++i) {
+        CHECK_EQUAL(0xA5, message[i]);
+    }
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(shm.pool, message));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(shm.pool, mailbox));
+    CHECK_EQUAL(1, mempool_partitions_used(shm.pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+}
+
+TEST(MempoolShm, mempool_claim_memory__ParentAndChildConcurrently__PoolConsistent)
+{
+    static const int ITERATIONS = 20000;
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_create(&shm, fd, POOL_SIZE));
+    auto churn = [&](mempool_instance* pool) {
+        void* blocks[8] = {};
+        for (int i = 0; i < ITERATIONS; ++i) {
+            void*& block = blocks[i % 8];
+            if (nullptr != block && mempool_status_ok != mempool_free_memory(pool, block)) {
+                return false;
+            }
+            block = nullptr;
+            if (mempool_status_ok != mempool_claim_memory(pool, (size)(16 + (i % 5) * 200), &block)) {
+                return false;
+            }
+        }
+        for (auto block : blocks) {
+            if (mempool_status_ok != mempool_free_memory(pool, block)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    pid_t pid = fork();
+    if (0 == pid) {
+        mempool_shm child {};
+        _exit(mempool_status_ok == mempool_shm_attach(&child, fd) && churn(child.pool) ? 0 : 1);
+    }
+    CHECK_TRUE(churn(shm.pool));
+    int status = 0;
+    CHECK_EQUAL(pid, waitpid(pid, &status, 0));
+    CHECK_TRUE(WIFEXITED(status) && 0 == WEXITSTATUS(status));
+    CHECK_EQUAL(1, mempool_partitions_used(shm.pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_shm_detach(&shm));
+}
@@ -0,0 +1,543 @@
+#include "TestRunner.h"
+#include "mempool_vm.h"
+
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test groups ----------------------- */
+/* ------------------------------------------------------------ */
+
+/* Count resident pages of a page-aligned range */
+static size residentPages(const void* addr, size len)
+{
+    const size pageSize = static_cast<size>(sysconf(_SC_PAGESIZE));
+    const size pages = len / pageSize;
+    std::vector<unsigned char> resident(pages);
+    CHECK_EQUAL(0, mincore(const_cast<void*>(addr), len, resident.data()));
+    size cnt = 0;
+    for (auto page : resident) {
+        cnt += (page & 1);
+    }
+    return cnt;
+}
+
+TEST_GROUP(MempoolReserved)
+{
+    static const size RESERVE_1G_SIZE = (size)1 << 30;
+    size pageSize = 0;
+    mempool_instance pool {};
+
+    void setup() override
+    {
+        pageSize = static_cast<size>(sysconf(_SC_PAGESIZE));
+        CHECK_EQUAL(mempool_status_ok, mempool_create_reserved(&pool, RESERVE_1G_SIZE));
+    }
+
+    void teardown() override
+    {
+        CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+    }
+};
+
+/* Pools placed in dedicated mappings */
+TEST_GROUP(MempoolMapped)
+{
+    static const size POOL_4M_SIZE = (size)4 << 20;
+    mempool_instance pool {};
+
+    /* Create a pool and check that it is usable */
+    void createAndCheck(size len, u32 flags)
+    {
+        CHECK_EQUAL(mempool_status_ok, mempool_create_mapped(&pool, len, flags));
+        CHECK_EQUAL(0, reinterpret_cast<uintptr_t>(pool.base_addr) % MEMPOOL_MAP_ALIGNMENT);
+        CHECK_EQUAL(len, pool.size);
+
+        void* dst = nullptr;
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, len / 2, &dst));
+        memset(dst, 0xAB, len / 2);
+        CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+        CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    }
+
+    /* Check whether all pages of the pool are resident */
+    bool allResident() const
+    {
+        return residentPages(pool.base_addr, pool.size) == pool.size / static_cast<size>(sysconf(_SC_PAGESIZE));
+    }
+};
+
+/* Pools serving large claims with direct mappings */
+TEST_GROUP(MempoolDirect)
+{
+    static const size BUFFER_64K_SIZE = (size)1 << 16;
+    static const size THRESHOLD = 4096;
+    mempool_instance pool {};
+
+    void setup() override
+    {
+        CHECK_EQUAL(mempool_status_ok, mempool_create_mapped(&pool, BUFFER_64K_SIZE, 0));
+        CHECK_EQUAL(mempool_status_ok, mempool_set_direct_threshold(&pool, THRESHOLD));
+    }
+
+    void teardown() override
+    {
+        CHECK_EQUAL(0, mempool_direct_maps(&pool));
+        CHECK_EQUAL(1, mempool_partitions_used(&pool));
+        CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+    }
+
+    bool insidePool(const void* ptr) const
+    {
+        auto addr = static_cast<const char*>(ptr);
+        return addr >= pool.base_addr && addr < pool.base_addr + BUFFER_64K_SIZE;
+    }
+
+    static void fillPattern(void* ptr, size len)
+    {
+        for (size i = 0; i < len; ++i) {
+            static_cast<u8*>(ptr)[i] = static_cast<u8>(i * 7);
+        }
+    }
+
+    static void checkPattern(const void* ptr, size len)
+    {
+        for (size i = 0; i < len; ++i) {
+            CHECK_EQUAL(static_cast<u8>(i * 7), static_cast<const u8*>(ptr)[i]);
+        }
+    }
+};
+
+/* ------------------------------------------------------------ */
+/* ------------------------ Test cases ------------------------ */
+/* ------------------------------------------------------------ */
+
+TEST(MempoolReserved, mempool_create_reserved__InvalidParams__ErrorReturned)
+{
+    mempool_instance other;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_create_reserved(nullptr, RESERVE_1G_SIZE));
+    CHECK_EQUAL(mempool_status_size_err, mempool_create_reserved(&other, 0));
+    CHECK_EQUAL(mempool_status_size_err, mempool_create_reserved(&other, RESERVE_1G_SIZE + 1));
+    CHECK_EQUAL(mempool_status_size_err, mempool_create_reserved(&other, pageSize / 2));
+}
+
+TEST(MempoolReserved, mempool_create_reserved__AfterInit__OnlyFirstPageCommitted)
+{
+    CHECK_EQUAL(RESERVE_1G_SIZE, pool.size);
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+    CHECK_EQUAL(pageSize, mempool_committed_bytes(&pool));
+}
+
+TEST(MempoolReserved, mempool_claim_memory__ClaimedPartitionAndBuddyHeadersCommitted)
+{
+    const size claimOrder = 20;
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, ((size)1 << claimOrder) - mempool_calc_hdr_size(), &dst));
+
+    /* Claimed partition plus a single page for each buddy header between 2^20 and 2^29 */
+    const size expectedCommitted = ((size)1 << claimOrder) + (30 - claimOrder) * pageSize;
+    CHECK_EQUAL(expectedCommitted, mempool_committed_bytes(&pool));
+    memset(dst, 0xAB, ((size)1 << claimOrder) - mempool_calc_hdr_size());
+
+    /* Reusing already committed memory does not commit anything */
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &dst));
+    CHECK_EQUAL(expectedCommitted, mempool_committed_bytes(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+}
+
+TEST(MempoolReserved, mempool_claim_memory__HighBlocksCommittedOnDemand)
+{
+    const size halfSize = RESERVE_1G_SIZE / 2;
+    void* low = nullptr;
+    void* high = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &low));
+    const size committedLow = mempool_committed_bytes(&pool);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, halfSize - mempool_calc_hdr_size(), &high));
+    POINTERS_EQUAL(pool.base_addr + halfSize + mempool_calc_hdr_size(), high);
+    CHECK_EQUAL(committedLow + halfSize - pageSize, mempool_committed_bytes(&pool));
+
+    /* The whole partition is writable */
+    static_cast<char*>(high)[halfSize - mempool_calc_hdr_size() - 1] = 1;
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, high));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, low));
+}
+
+TEST(MempoolReserved, mempool_committed_bytes__PoolNotReserved__ZeroReturned)
+{
+    char buffer[256];
+    mempool_instance plain;
+    plain.base_addr = buffer;
+    plain.size = sizeof(buffer);
+    CHECK_EQUAL(mempool_status_ok, mempool_init(&plain));
+    CHECK_EQUAL(0, mempool_committed_bytes(&plain));
+    CHECK_EQUAL(0, mempool_committed_bytes(nullptr));
+    CHECK_EQUAL(mempool_status_not_supported, mempool_destroy(&plain));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_destroy(nullptr));
+}
+
+TEST(MempoolReserved, mempool_trim__FreedMemory__DecommittedAndZeroed)
+{
+    const size claimSize = (size)1 << 20;
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, claimSize, &dst));
+    memset(dst, 0xAB, claimSize);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+
+    /* Only the page holding the root header stays committed */
+    CHECK(mempool_trim(&pool, 0) > 0);
+    CHECK_EQUAL(pageSize, mempool_committed_bytes(&pool));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_zeroed(&pool, claimSize, &dst));
+    for (size i = 0; i < claimSize; i += pageSize / 2) {
+        CHECK_EQUAL(0, static_cast<char*>(dst)[i]);
+    }
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+}
+
+TEST(MempoolReserved, mempool_release_pages__AnonymousMemory__PagesDropped)
+{
+    const size pages = 8;
+    auto mem = static_cast<char*>(mmap(nullptr, pages * pageSize, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    CHECK(MAP_FAILED != mem);
+    memset(mem, 0xAB, pages * pageSize);
+
+    /* Range starting in the middle of the first page - only whole pages are dropped */
+    CHECK(mempool_release_pages(nullptr, mem + pageSize / 2, pages * pageSize - pageSize / 2));
+    unsigned char resident[pages];
+    CHECK_EQUAL(0, mincore(mem, pages * pageSize, resident));
+    CHECK_EQUAL(1, resident[0] & 1);
+    for (size i = 1; i < pages; ++i) {
+        CHECK_EQUAL(0, resident[i] & 1);
+    }
+    CHECK_EQUAL(static_cast<char>(0xAB), mem[pageSize / 2 - 1]);
+    for (size i = pageSize / 2; i < pages * pageSize; i += 64) {
+        CHECK_EQUAL(0, mem[i]);
+    }
+
+    /* Range not covering a whole page cannot be released */
+    CHECK_FALSE(mempool_release_pages(nullptr, mem + 1, pageSize));
+    munmap(mem, pages * pageSize);
+}
+
+TEST(MempoolReserved, mempool_map_backing_get__ReservedPool__NoneReturned)
+{
+    CHECK_EQUAL(mempool_map_backing_none, mempool_map_backing_get(&pool));
+    CHECK_EQUAL(mempool_map_backing_none, mempool_map_backing_get(nullptr));
+}
+
+TEST(MempoolMapped, mempool_create_mapped__InvalidParams__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_create_mapped(nullptr, POOL_4M_SIZE, 0));
+    CHECK_EQUAL(mempool_status_size_err, mempool_create_mapped(&pool, 0, 0));
+    CHECK_EQUAL(mempool_status_size_err, mempool_create_mapped(&pool, POOL_4M_SIZE + 1, 0));
+    CHECK_EQUAL(mempool_status_size_err, mempool_create_mapped(&pool, 64, 0));
+}
+
+TEST(MempoolMapped, mempool_create_mapped__RegularPages__AlignedPoolCreated)
+{
+    createAndCheck(POOL_4M_SIZE, 0);
+    CHECK_EQUAL(mempool_map_backing_pages, mempool_map_backing_get(&pool));
+    CHECK_EQUAL(0, mempool_committed_bytes(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+}
+
+TEST(MempoolMapped, mempool_create_mapped__PoolSmallerThanAlignment__AlignedPoolCreated)
+{
+    createAndCheck(static_cast<size>(sysconf(_SC_PAGESIZE)), 0);
+    CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+}
+
+TEST(MempoolMapped, mempool_create_mapped__TransparentHugePages__AdviceApplied)
+{
+    /* The advice is rejected when the kernel is built without transparent huge page support */
+    createAndCheck(POOL_4M_SIZE, MEMPOOL_MAP_THP);
+    auto backing = mempool_map_backing_get(&pool);
+    CHECK(mempool_map_backing_thp == backing || mempool_map_backing_pages == backing);
+    CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+}
+
+TEST(MempoolMapped, mempool_create_mapped__HugeTlbWithFallback__AlwaysCreated)
+{
+    createAndCheck(POOL_4M_SIZE, MEMPOOL_MAP_HUGETLB | MEMPOOL_MAP_THP);
+    CHECK(mempool_map_backing_none != mempool_map_backing_get(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+}
+
+TEST(MempoolMapped, mempool_create_mapped__HugeTlbForPoolSmallerThanHugePage__ErrorReturned)
+{
+    /* There is no fallback requested */
+    CHECK_EQUAL(mempool_status_out_of_memory,
+                mempool_create_mapped(&pool, static_cast<size>(sysconf(_SC_PAGESIZE)), MEMPOOL_MAP_HUGETLB));
+}
+
+TEST(MempoolMapped, mempool_create_mapped__Populate__AllPagesResident)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_create_mapped(&pool, POOL_4M_SIZE, MEMPOOL_MAP_POPULATE));
+    CHECK(allResident());
+    CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+}
+
+TEST(MempoolMapped, mempool_prefault__MultipleThreads__AllPagesResidentAndContentKept)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_prefault(nullptr, 1));
+    CHECK_EQUAL(mempool_status_ok, mempool_create_mapped(&pool, POOL_4M_SIZE, 0));
+    CHECK_FALSE(allResident());
+
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &dst));
+    memset(dst, 0xAB, 100);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_prefault(&pool, 3));
+    CHECK(allResident());
+    CHECK_EQUAL(static_cast<char>(0xAB), static_cast<char*>(dst)[99]);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    CHECK_EQUAL(1, mempool_partitions_used(&pool));
+
+    /* Thread count is limited internally */
+    CHECK_EQUAL(mempool_status_ok, mempool_prefault(&pool, 0));
+    CHECK_EQUAL(mempool_status_ok, mempool_prefault(&pool, 1000));
+    CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+}
+
+TEST(MempoolMapped, mempool_prefault__ReservedPool__WholeReservationCommitted)
+{
+    CHECK_EQUAL(mempool_status_ok, mempool_create_reserved(&pool, POOL_4M_SIZE));
+    CHECK_EQUAL(mempool_status_ok, mempool_prefault(&pool, 2));
+    CHECK_EQUAL(POOL_4M_SIZE, mempool_committed_bytes(&pool));
+    CHECK(allResident());
+    CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+}
+
+/* Resident pages seen by each call of preparePool() */
+static size preparedResident[4];
+static u32 preparedCnt = 0;
+
+static void preparePool(void* arg, u32 index, void* addr, size len)
+{
+    POINTERS_EQUAL(&preparedCnt, arg);
+    CHECK_EQUAL(preparedCnt, index);
+    preparedResident[preparedCnt++] = residentPages(addr, len);
+}
+
+TEST(MempoolMapped, mempool_create_mapped_array__InvalidParams__ErrorReturned)
+{
+    mempool_instance pools[2];
+    CHECK_EQUAL(mempool_status_nullptr, mempool_create_mapped_array(nullptr, 2, POOL_4M_SIZE, 0, nullptr, nullptr));
+    CHECK_EQUAL(mempool_status_size_err, mempool_create_mapped_array(pools, 0, POOL_4M_SIZE, 0, nullptr, nullptr));
+    CHECK_EQUAL(mempool_status_size_err, mempool_create_mapped_array(pools, 2, POOL_4M_SIZE + 1, 0, nullptr, nullptr));
+    CHECK_EQUAL(mempool_status_size_err, mempool_create_mapped_array(pools, 2, (size)1 << 63, 0, nullptr, nullptr));
+}
+
+TEST(MempoolMapped, mempool_create_mapped_array__Populate__PoolsPreparedBeforeFaultedIn)
+{
+    const u32 cnt = 3;
+    mempool_instance pools[cnt];
+    preparedCnt = 0;
+    CHECK_EQUAL(mempool_status_ok, mempool_create_mapped_array(pools, cnt, POOL_4M_SIZE, MEMPOOL_MAP_POPULATE,
+                                                               preparePool, &preparedCnt));
+    CHECK_EQUAL(cnt, preparedCnt);
+    for (u32 i = 0; i < cnt; ++i) {
+        CHECK_EQUAL(0, preparedResident[i]);
+        POINTERS_EQUAL(pools[0].base_addr + i * POOL_4M_SIZE, pools[i].base_addr);
+        CHECK_EQUAL(POOL_4M_SIZE / static_cast<size>(sysconf(_SC_PAGESIZE)),
+                    residentPages(pools[i].base_addr, POOL_4M_SIZE));
+        CHECK_EQUAL(1, mempool_partitions_used(&pools[i]));
+    }
+
+    /* Pools are destroyed one by one */
+    for (auto& pool : pools) {
+        CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+    }
+}
+
+TEST(MempoolMapped, mempool_mapped_array_owner__PoolMemoryAndDirectMappings__OwnerFound)
+{
+    const u32 cnt = 2;
+    mempool_instance pools[cnt];
+    CHECK_EQUAL(mempool_status_ok, mempool_create_mapped_array(pools, cnt, POOL_4M_SIZE, 0, nullptr, nullptr));
+    CHECK_EQUAL(cnt, mempool_mapped_array_owner(nullptr, cnt, pools[0].base_addr));
+    CHECK_EQUAL(0, mempool_mapped_array_owner(pools, 0, pools[0].base_addr));
+
+    void* inPool = nullptr;
+    void* direct = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_set_direct_threshold(&pools[1], POOL_4M_SIZE / 4));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pools[1], 100, &inPool));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pools[1], POOL_4M_SIZE, &direct));
+    CHECK_EQUAL(1, mempool_mapped_array_owner(pools, cnt, inPool));
+    CHECK_EQUAL(1, mempool_mapped_array_owner(pools, cnt, direct));
+    CHECK_EQUAL(0, mempool_mapped_array_owner(pools, cnt, pools[0].base_addr + POOL_4M_SIZE - 1));
+    CHECK_EQUAL(cnt, mempool_mapped_array_owner(pools, cnt, &pools[0]));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pools[1], direct));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pools[1], inPool));
+    for (auto& pool : pools) {
+        CHECK_EQUAL(mempool_status_ok, mempool_destroy(&pool));
+    }
+}
+
+TEST(MempoolDirect, mempool_set_direct_threshold__InvalidParams__ErrorReturned)
+{
+    CHECK_EQUAL(mempool_status_nullptr, mempool_set_direct_threshold(nullptr, THRESHOLD));
+
+    /* Compact headers and pools that cannot map memory */
+    std::vector<char> buffer(BUFFER_64K_SIZE);
+    mempool_config config;
+    mempool_default_config(&config);
+    config.hdr_type = mempool_hdr_off32;
+    config.direct_fn = pool.direct_fn;
+    config.backing = pool.backing;
+    mempool_instance other;
+    other.base_addr = buffer.data();
+    other.size = BUFFER_64K_SIZE;
+    CHECK_EQUAL(mempool_status_ok, mempool_init_ex(&other, &config));
+    CHECK_EQUAL(mempool_status_not_supported, mempool_set_direct_threshold(&other, THRESHOLD));
+    CHECK_EQUAL(mempool_status_ok, mempool_init(&other));
+    CHECK_EQUAL(mempool_status_not_supported, mempool_set_direct_threshold(&other, THRESHOLD));
+}
+
+TEST(MempoolDirect, mempool_claim_memory__AboveThreshold__TreeNotSplit)
+{
+    void* small = nullptr;
+    void* large = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, THRESHOLD - 1, &small));
+    CHECK(insidePool(small));
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, BUFFER_64K_SIZE, &large));
+    CHECK_FALSE(insidePool(large));
+    CHECK_EQUAL(1, mempool_direct_maps(&pool));
+    memset(large, 0xAB, BUFFER_64K_SIZE);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, large));
+    CHECK_EQUAL(0, mempool_direct_maps(&pool));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, small));
+}
+
+TEST(MempoolDirect, mempool_claim_zeroed__AboveThreshold__MemoryZeroed)
+{
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_zeroed(&pool, THRESHOLD * 4, &dst));
+    CHECK_FALSE(insidePool(dst));
+    for (size i = 0; i < THRESHOLD * 4; ++i) {
+        CHECK_EQUAL(0, static_cast<char*>(dst)[i]);
+    }
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+}
+
+TEST(MempoolDirect, mempool_claim_memory__SideTableFull__ServedFromPool)
+{
+    void* direct[MEMPOOL_DIRECT_MAPS_MAX];
+    for (auto& dst : direct) {
+        CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, THRESHOLD, &dst));
+        CHECK_FALSE(insidePool(dst));
+    }
+    void* fallback = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, THRESHOLD, &fallback));
+    CHECK(insidePool(fallback));
+
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, fallback));
+    for (auto dst : direct) {
+        CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    }
+}
+
+static mempool_status refuseDirect(void* backing, void** addr, size* len)
+{
+    (void)backing;
+    (void)addr;
+    (void)len;
+    return mempool_status_out_of_memory;
+}
+
+TEST(MempoolDirect, mempool_free_memory__UnmapFails__ClaimStillCounted)
+{
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, THRESHOLD * 2, &dst));
+    CHECK_FALSE(insidePool(dst));
+    const size granted = mempool_memory_granted(&pool);
+    CHECK(granted > THRESHOLD * 2);
+
+    /* The block stays with the caller, so do its bytes */
+    mempool_direct_fn directFn = pool.direct_fn;
+    pool.direct_fn = refuseDirect;
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_free_memory(&pool, dst));
+    CHECK_EQUAL(granted, mempool_memory_granted(&pool));
+    CHECK_EQUAL(mempool_status_out_of_memory, mempool_realloc_memory(&pool, &dst, THRESHOLD * 4));
+    CHECK_EQUAL(granted, mempool_memory_granted(&pool));
+    CHECK_EQUAL(THRESHOLD * 2, mempool_memory_requested(&pool));
+
+    pool.direct_fn = directFn;
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+    CHECK_EQUAL(0, mempool_memory_granted(&pool));
+    CHECK_EQUAL(0, mempool_memory_requested(&pool));
+}
+
+TEST(MempoolDirect, mempool_realloc_memory__InvalidParams__ErrorReturned)
+{
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_nullptr, mempool_realloc_memory(nullptr, &dst, 1));
+    CHECK_EQUAL(mempool_status_nullptr, mempool_realloc_memory(&pool, nullptr, 1));
+    CHECK_EQUAL(mempool_status_size_err, mempool_realloc_memory(&pool, &dst, 0));
+
+    /* Partition that is not claimed */
+    dst = pool.base_addr + mempool_calc_hdr_size();
+    CHECK_EQUAL(mempool_status_inv_memory, mempool_realloc_memory(&pool, &dst, 1));
+}
+
+TEST(MempoolDirect, mempool_realloc_memory__NullMemory__Claimed)
+{
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_realloc_memory(&pool, &dst, 100));
+    CHECK(insidePool(dst));
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+}
+
+TEST(MempoolDirect, mempool_realloc_memory__PoolMemory__GrowsInPlaceOrMoves)
+{
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, 100, &dst));
+    fillPattern(dst, 100);
+
+    /* 100 bytes were rounded up to a 256-byte partition */
+    void* original = dst;
+    CHECK_EQUAL(mempool_status_ok, mempool_realloc_memory(&pool, &dst, 200));
+    POINTERS_EQUAL(original, dst);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_realloc_memory(&pool, &dst, 1000));
+    CHECK(original != dst);
+    CHECK(insidePool(dst));
+    checkPattern(dst, 100);
+
+    /* Growing above the threshold moves memory to a direct mapping */
+    fillPattern(dst, 1000);
+    CHECK_EQUAL(mempool_status_ok, mempool_realloc_memory(&pool, &dst, THRESHOLD * 2));
+    CHECK_FALSE(insidePool(dst));
+    checkPattern(dst, 1000);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+}
+
+TEST(MempoolDirect, mempool_realloc_memory__DirectMemory__RemappedOrMovedBackToPool)
+{
+    const size initialLen = THRESHOLD * 2;
+    const size grownLen = (size)1 << 20;
+    void* dst = nullptr;
+    CHECK_EQUAL(mempool_status_ok, mempool_claim_memory(&pool, initialLen, &dst));
+    fillPattern(dst, initialLen);
+
+    CHECK_EQUAL(mempool_status_ok, mempool_realloc_memory(&pool, &dst, grownLen));
+    CHECK_FALSE(insidePool(dst));
+    CHECK_EQUAL(1, mempool_direct_maps(&pool));
+    checkPattern(dst, initialLen);
+    static_cast<char*>(dst)[grownLen - 1] = 1;
+
+    /* Shrinking below the threshold moves the content back to the pool */
+    CHECK_EQUAL(mempool_status_ok, mempool_realloc_memory(&pool, &dst, 1000));
+    CHECK(insidePool(dst));
+    CHECK_EQUAL(0, mempool_direct_maps(&pool));
+    checkPattern(dst, 1000);
+    CHECK_EQUAL(mempool_status_ok, mempool_free_memory(&pool, dst));
+}